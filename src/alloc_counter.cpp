@@ -0,0 +1,28 @@
+#include <new>
+#include <cstdlib>
+
+#include "metrics.h"
+
+//	Every heap allocation of wadwalk is counted for --metrics. Only built with
+//	WAD_COUNT_ALLOCATIONS, it replaces the global operators of the whole
+//	program. Kept in a file of its own so they're never inlined into callers
+//	that would see malloc paired with delete.
+void* operator new( size_t size )
+{
+	CMetrics::count_allocation();
+
+	if (void* p = malloc( size ? size : 1 ))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void operator delete( void* p ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+	free( p );
+}
@@ -1,80 +1,254 @@
 ﻿#include <iostream>
-#include <deque>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
 
 #include "argparser.h"
 
-Argument_t g_ArgumentList[ArgCount] =
+const Option_t g_OptionList[OptCount] =
 {
-	{ Argument_t::Double, "-f", "<\"path to the file\">", "Specifies the input file" },
-	{ Argument_t::Single, "-help", "", "Displayes all arguments" },
-	{ Argument_t::Single, "-d", "", "Dumps out the WAD file information" },
-	{ Argument_t::Single, "-e", "<miplevel 1-4>", "Exports all textures from the WAD file" },
+	{ EOptionType::Flag, "--help", "-h", "", "Prints out the help of the command", 0, 0, {}, false },
+	{ EOptionType::UInt, "--threads", "-t", "<count>", "Number of threads to use, 0 means one per core (default)", 0, 1024, {}, false },
+	{ EOptionType::Flag, "--metrics", "", "", "Prints the time, bytes and allocations spent in every stage at the end", 0, 0, {}, false },
+	{ EOptionType::String, "--trace", "", "<\"path to the json\">", "Writes a Chrome trace of every timed stage at the end", 0, 0, {}, false },
+
+	{ EOptionType::String, "--out", "-o", "<path>", "Output file or directory", 0, 0, {}, false },
+	{ EOptionType::UInt, "--mips", "-m", "<1-4>", "Number of mip levels of WAD textures to export, starting from the biggest (1 by default)", 1, 4, {}, false },
+	{ EOptionType::String, "--wads", "-w", "<\"path to the WAD(s)\">", "WAD file or a directory of them, can be given more than once", 0, 0, {}, true },
+	{ EOptionType::String, "--socket", "", "<\"path to the socket\">", "Unix domain socket to listen on", 0, 0, {}, false },
+	{ EOptionType::UInt, "--cache-size", "", "<MiB>", "Memory budget of the texture cache (128 MiB by default)", 1, 1024 * 1024, {}, false },
+	{ EOptionType::String, "--add", "", "<\"path to the 8-bit BMP\">", "Adds or replaces a texture, can be given more than once", 0, 0, {}, true },
+	{ EOptionType::String, "--delete", "", "<texture name>", "Deletes a texture, can be given more than once", 0, 0, {}, true },
+	{ EOptionType::Flag, "--compact", "", "", "Reclaims the space left behind by replaced and deleted textures", 0, 0, {}, false },
+	{ EOptionType::Choice, "--mode", "", "<prefix|substring|family>", "How the query is matched (prefix by default)", 0, 0, { "prefix", "substring", "family" }, false },
+	{ EOptionType::String, "--query", "-q", "<text>", "Text to search for in the texture names", 0, 0, {}, false },
+	{ EOptionType::String, "--texture", "", "<texture name>", "Texture to compare the others against", 0, 0, {}, false },
+	{ EOptionType::UInt, "--distance", "-d", "<0-64>", "Perceptual hash bits two textures can differ in (8 by default)", 0, 64, {}, false },
+	{ EOptionType::Float, "--tolerance", "", "<0-255>", "Mean color difference allowed between a mip and mip 0 (24 by default)", 0, 255, {}, false },
+	{ EOptionType::Choice, "--compression", "-c", "<none|deflate>", "Compression of the lumps in the written WAD file", 0, 0, { "none", "deflate" }, false },
+	{ EOptionType::Float, "--gamma", "", "<0.1-10>", "Gamma applied to the palettes, above 1 brightens the dark colors (1 by default)", 0.1, 10, {}, false },
+	{ EOptionType::Float, "--brightness", "", "<0-16>", "Multiplier of the palette colors, applied after the gamma (1 by default)", 0, 16, {}, false },
+	{ EOptionType::Float, "--hue", "", "<degrees>", "Rotation of the palette hues, -360 to 360 (0 by default)", -360, 360, {}, false },
+	{ EOptionType::String, "--remap", "", "<\"path to the table\">", "Moves the pixels onto other palette indices, one \"<from> <to>\" or \"<first>-<last> <to>\" per line", 0, 0, {}, false },
+};
+
+//	Inputs that can be directories pick up every file with the right extension inside.
+const Command_t g_CommandList[CmdCount] =
+{
+	{ "help", "[command]", "Prints out the commands, or the options of one", 0, 1, {}, {} },
+	{ "info", "<wad(s)>", "Prints out the information about the WAD file(s) and their contents", 1, UINT32_MAX, {}, {} },
+	{ "export", "<wad(s), sprite(s) or model(s)>", "Exports every texture, sprite frame and model skin into 8-bit BMP images", 1, UINT32_MAX, { OptOut, OptMips }, {} },
+	{ "edit", "<wad>", "Adds, replaces and deletes textures in place", 1, 1, { OptAdd, OptDelete, OptCompact }, {} },
+	{ "pack", "<map(s) or name list(s)>", "Writes a WAD file with only the textures the maps or the name lists use", 1, UINT32_MAX, { OptWads, OptOut }, { OptWads, OptOut } },
+	{ "merge", "<wad(s)>", "Combines WAD files into one, the first one wins on duplicate names", 1, UINT32_MAX, { OptOut }, { OptOut } },
+	{ "serve", "<wad(s)>", "Serves textures over a unix domain socket", 1, UINT32_MAX, { OptSocket, OptCacheSize }, { OptSocket } },
+	{ "bench", "", "Benchmarks the palette expansion kernels and the BMP row writers", 0, 0, {}, {} },
+	{ "search", "<wad(s)>", "Searches the texture names", 1, UINT32_MAX, { OptQuery, OptMode }, { OptQuery } },
+	{ "similar", "<wad(s)>", "Lists the textures that look like the given one", 1, UINT32_MAX, { OptTexture, OptDistance }, { OptTexture } },
+	{ "duplicates", "<wad(s)>", "Lists the pairs of textures that look nearly the same", 1, UINT32_MAX, { OptDistance }, {} },
+	{ "analyze", "<wad(s)>", "Writes the statistics of every texture as JSON", 1, UINT32_MAX, { OptOut }, { OptOut } },
+	{ "verify", "<wad(s)>", "Lists the textures whose mips don't match mip 0", 1, UINT32_MAX, { OptTolerance }, {} },
+	{ "repair", "<wad>", "Writes a copy of the WAD file with the mismatching mips regenerated", 1, 1, { OptOut, OptTolerance }, { OptOut } },
+	{ "resolve", "<map(s)>", "Reports which WAD file every texture of the BSP map(s) comes from", 1, UINT32_MAX, { OptWads }, { OptWads } },
+	{ "extract", "<map>", "Writes the textures embedded in the BSP map into a WAD file", 1, 1, { OptOut }, { OptOut } },
+	{ "convert", "<wad>", "Writes a copy of the WAD file with every lump compressed, or decompressed", 1, 1, { OptOut, OptCompression }, { OptOut, OptCompression } },
+	{ "recolor", "<wad>", "Writes a copy of the WAD file with the palettes color corrected and the pixels remapped", 1, 1, { OptOut, OptGamma, OptBrightness, OptHue, OptRemap }, { OptOut } },
 };
 
 bool CArgumentParser::parse()
 {
-	if (!validate_args())
+	if (m_argc < 2)
+		return fail( "No command specified." );
+
+	//	"wadwalk -h" and "wadwalk --help" are the same as "wadwalk help".
+	std::string name = m_argv[1];
+	if (name == "-h" || name == "--help")
+		name = "help";
+
+	m_command = CmdCount;
+	for (uint32_t i = 0; i < CmdCount; i++)
 	{
-		printf("Error: Couldn't parse arguments.\n");
-		return false;
+		if (g_CommandList[i].m_name == name)
+			m_command = (Commands)i;
 	}
 
-	for (int32_t i = 0; i < m_argc; i++)
+	if (m_command == CmdCount)
 	{
-		for (uint32_t k = 0; k < ArgCount; k++)
+		m_command = CmdHelp;
+		return fail( "Unknown command " + name + "." );
+	}
+
+	bool only_inputs = false;
+
+	for (int32_t i = 2; i < m_argc; i++)
+	{
+		const std::string arg = m_argv[i];
+
+		//	A lone dash is an input, it usually means stdin.
+		if (only_inputs || arg.size() < 2 || arg[0] != '-')
+		{
+			m_inputs.push_back( arg );
+			continue;
+		}
+
+		if (arg == "--")
 		{
-			auto arg = &g_ArgumentList[k];
-
-			if (arg->m_name == m_argv[i])
-			{
-				switch (arg->m_type)
-				{
-					case Argument_t::Single:
-						arg->m_exists = true;
-						m_args.push_back( arg );
-						break;
-
-					case Argument_t::Double:
-						if (m_argv[i + 1])
-						{
-							arg->m_exists = true;
-							arg->m_value = m_argv[i + 1];
-							m_args.push_back( arg );
-						}
-						break;
-					case Argument_t::Triple:
-						if (m_argv[i + 1] && m_argv[i + 2])
-						{
-							arg->m_exists = true;
-							arg->m_value = m_argv[i + 1];
-							arg->m_value1 = m_argv[i + 2];
-							m_args.push_back( arg );
-						}
-						break;
-					default:
-						break;
-				}
-
-				arg->m_exists = true;
-			}
+			only_inputs = true;
+			continue;
 		}
+
+		if (!parse_option( arg, i ))
+			return false;
 	}
+
+	//	Nothing else is checked, the help of the command is printed instead.
+	if (has( OptHelp ))
+		return true;
+
+	const auto& cmd = g_CommandList[m_command];
+
+	if (m_inputs.size() < cmd.m_min_inputs || m_inputs.size() > cmd.m_max_inputs)
+	{
+		if (!cmd.m_max_inputs)
+			return fail( cmd.m_name + " takes no inputs." );
+
+		if (cmd.m_min_inputs == cmd.m_max_inputs)
+			return fail( cmd.m_name + " takes exactly " + std::to_string( cmd.m_min_inputs ) + " input " + cmd.m_usage + "." );
+
+		if (m_inputs.size() < cmd.m_min_inputs)
+			return fail( cmd.m_name + " needs at least " + std::to_string( cmd.m_min_inputs ) + " input " + cmd.m_usage + "." );
+
+		return fail( cmd.m_name + " takes at most " + std::to_string( cmd.m_max_inputs ) + " inputs." );
+	}
+
+	for (const auto opt : cmd.m_required)
+	{
+		if (!has( opt ))
+			return fail( cmd.m_name + " needs " + g_OptionList[opt].m_name + " " + g_OptionList[opt].m_usage + "." );
+	}
+
+	return true;
 }
 
-bool CArgumentParser::validate_args()
+const std::string& CArgumentParser::value( Options opt, const std::string& fallback ) const
 {
-	//	The first argument is program path
-	if (m_argc == 1)
+	return m_values[opt].empty() ? fallback : m_values[opt].back();
+}
+
+uint32_t CArgumentParser::get_uint( Options opt, uint32_t fallback ) const
+{
+	return has( opt ) ? (uint32_t)std::strtoul( m_values[opt].back().c_str(), nullptr, 10 ) : fallback;
+}
+
+float CArgumentParser::get_float( Options opt, float fallback ) const
+{
+	return has( opt ) ? std::strtof( m_values[opt].back().c_str(), nullptr ) : fallback;
+}
+
+bool CArgumentParser::accepts( Commands cmd, Options opt )
+{
+	if (opt == OptHelp || opt == OptThreads || opt == OptMetrics || opt == OptTrace)
+		return true;
+
+	const auto& options = g_CommandList[cmd].m_options;
+	return std::find( options.begin(), options.end(), opt ) != options.end();
+}
+
+bool CArgumentParser::parse_option( const std::string& arg, int32_t& i )
+{
+	//	--name=value
+	const size_t eq = arg.find( '=' );
+	const std::string name = arg.substr( 0, eq );
+
+	uint32_t k = 0;
+	while (k < OptCount && g_OptionList[k].m_name != name && g_OptionList[k].m_short_name != name)
+		k++;
+
+	if (k == OptCount)
+		return fail( "Unknown option " + name + "." );
+
+	const auto opt = (Options)k;
+	const auto& option = g_OptionList[opt];
+
+	if (!accepts( m_command, opt ))
+		return fail( option.m_name + " isn't an option of " + g_CommandList[m_command].m_name + "." );
+
+	if (has( opt ) && !option.m_repeatable)
+		return fail( option.m_name + " is given more than once." );
+
+	if (option.m_type == EOptionType::Flag)
 	{
-		printf( "Error: No arguments specified.\n" );
-		return false;
+		if (eq != std::string::npos)
+			return fail( option.m_name + " doesn't take a value." );
+
+		m_values[opt].push_back( "1" );
+		return true;
 	}
 
-	if (m_argc > ArgCount + 1)
-	{
-		printf( "Error: Too much arguments specified.\n" );
+	std::string value;
+
+	if (eq != std::string::npos)
+		value = arg.substr( eq + 1 );
+	else if (i + 1 < m_argc)
+		value = m_argv[++i];
+	else
+		return fail( option.m_name + " needs a value " + option.m_usage + "." );
+
+	if (!validate_value( opt, value ))
 		return false;
+
+	m_values[opt].push_back( value );
+	return true;
+}
+
+bool CArgumentParser::validate_value( Options opt, const std::string& value )
+{
+	const auto& option = g_OptionList[opt];
+	const std::string invalid = "Invalid value for " + option.m_name + ": \"" + value + "\", expected " + option.m_usage + ".";
+
+	switch (option.m_type)
+	{
+		case EOptionType::String:
+			if (value.empty())
+				return fail( invalid );
+			break;
+
+		case EOptionType::UInt:
+		{
+			if (value.empty() || value.find_first_not_of( "0123456789" ) != std::string::npos)
+				return fail( invalid );
+
+			const double v = std::strtod( value.c_str(), nullptr );
+			if (v < option.m_min || v > option.m_max)
+				return fail( invalid );
+			break;
+		}
+
+		case EOptionType::Float:
+		{
+			char* end = nullptr;
+			const double v = std::strtod( value.c_str(), &end );
+
+			if (value.empty() || *end || !(v >= option.m_min && v <= option.m_max))
+				return fail( invalid );
+			break;
+		}
+
+		case EOptionType::Choice:
+			if (std::find( option.m_choices.begin(), option.m_choices.end(), value ) == option.m_choices.end())
+				return fail( invalid );
+			break;
+
+		default:
+			break;
 	}
 
 	return true;
 }
+
+bool CArgumentParser::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
@@ -3,66 +3,164 @@
 
 #pragma once
 
-class Argument_t
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//	wadwalk <command> [options] <inputs...>
+//
+//	Options can come anywhere after the command, "--name value" and
+//	"--name=value" are both accepted. Everything after "--" is an input, even
+//	when it starts with a dash.
+enum class EOptionType : uint32_t
 {
-public:
-	enum Type
-	{
-		Single,
-		Double,
-		Triple,
-	};
+	Flag,
+	String,
+	UInt,
+	Float,
 
-public:
-	Argument_t( Type type, const std::string& name, const std::string& usage, const std::string& description ) :
-		m_type( type ),
-		m_name( name ),
-		m_usage( usage ),
-		m_description( description )
-	{}
+	//	One of Option_t::m_choices.
+	Choice,
+};
 
+class Option_t
+{
 public:
-	Type m_type;
+	EOptionType m_type;
 
 	std::string m_name;
-	std::string m_value;
-	std::string m_value1;
+	std::string m_short_name;
 
 	std::string m_usage;
 	std::string m_description;
 
-	bool m_exists;
+	//	Inclusive range of UInt and Float values.
+	double m_min = 0;
+	double m_max = 0;
+
+	std::vector<std::string> m_choices;
+
+	//	Can be given more than once, every value is kept.
+	bool m_repeatable = false;
+};
+
+enum Options
+{
+	//	Accepted by every command.
+	OptHelp,
+	OptThreads,
+	OptMetrics,
+	OptTrace,
+
+	OptOut,
+	OptMips,
+	OptWads,
+	OptSocket,
+	OptCacheSize,
+	OptAdd,
+	OptDelete,
+	OptCompact,
+	OptMode,
+	OptQuery,
+	OptTexture,
+	OptDistance,
+	OptTolerance,
+	OptCompression,
+	OptGamma,
+	OptBrightness,
+	OptHue,
+	OptRemap,
+
+	OptCount
 };
 
-enum Arguments
+enum Commands
 {
-	ArgFile,
-	ArgHelp,
-	ArgDump,
-	ArgExport,
+	CmdHelp,
+	CmdInfo,
+	CmdExport,
+	CmdEdit,
+	CmdPack,
+	CmdMerge,
+	CmdServe,
+	CmdBench,
+	CmdSearch,
+	CmdSimilar,
+	CmdDuplicates,
+	CmdAnalyze,
+	CmdVerify,
+	CmdRepair,
+	CmdResolve,
+	CmdExtract,
+	CmdConvert,
+	CmdRecolor,
+
+	CmdCount
+};
 
-	ArgCount
+class Command_t
+{
+public:
+	std::string m_name;
+	std::string m_usage;		// Of the inputs
+	std::string m_description;
+
+	uint32_t m_min_inputs;
+	uint32_t m_max_inputs;
+
+	//	Accepted on top of the ones every command takes.
+	std::vector<Options> m_options;
+	std::vector<Options> m_required;
 };
 
-extern Argument_t g_ArgumentList[ArgCount];
+extern const Option_t g_OptionList[OptCount];
+extern const Command_t g_CommandList[CmdCount];
 
 class CArgumentParser
 {
-private:
-	bool validate_args();
-
 public:
-	bool parse();
-
 	CArgumentParser( int32_t argc, char** argv ) :
-		m_argc(argc), 
+		m_argc(argc),
 		m_argv(argv)
 	{}
 
+	//	Validates everything, error() says what's wrong on failure.
+	bool parse();
+
+	Commands command() const { return m_command; }
+
+	//	Positional arguments after the command, in order.
+	const std::vector<std::string>& inputs() const { return m_inputs; }
+
+	bool has( Options opt ) const { return !m_values[opt].empty(); }
+
+	//	The last value given, or the fallback.
+	const std::string& value( Options opt, const std::string& fallback = "" ) const;
+	uint32_t get_uint( Options opt, uint32_t fallback = 0 ) const;
+	float get_float( Options opt, float fallback = 0.f ) const;
+
+	//	Every value of a repeatable option.
+	const std::vector<std::string>& values( Options opt ) const { return m_values[opt]; }
+
+	const std::string& error() const { return m_error; }
+
+	static bool accepts( Commands cmd, Options opt );
+
+private:
+	bool parse_option( const std::string& arg, int32_t& i );
+	bool validate_value( Options opt, const std::string& value );
+
+	bool fail( const std::string& msg );
+
+private:
 	int32_t m_argc;
 	char** m_argv;
 
-	std::deque<Argument_t*> m_args{ ArgCount };
+	Commands m_command = CmdHelp;
+	std::vector<std::string> m_inputs;
+	std::vector<std::string> m_values[OptCount];
+
+	std::string m_error;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,194 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "bench.h"
+#include "palette_kernels.h"
+#include "bmp.h"
+
+//	A 512x512 texture, about the largest the engine takes.
+static constexpr size_t kPixelCount = 512 * 512;
+static constexpr uint32_t kIterations = 200;
+
+using KernelFn_t = void (*)( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out, EKernel kernel );
+
+//	Returns the throughput in megapixels per second.
+static double time_kernel( KernelFn_t fn, EKernel kernel, const std::vector<uint8_t>& indices, const uint8_t* palette, std::vector<uint8_t>& out )
+{
+	//	Warm up the caches.
+	fn( indices.data(), indices.size(), palette, out.data(), kernel );
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < kIterations; i++)
+		fn( indices.data(), indices.size(), palette, out.data(), kernel );
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return (double)indices.size() * kIterations / elapsed.count() / 1e6;
+}
+
+static bool bench_expansion( const char* name, KernelFn_t fn, size_t bytes_per_pixel, const std::vector<uint8_t>& indices, const uint8_t* palette )
+{
+	std::vector<uint8_t> reference( indices.size() * bytes_per_pixel );
+	std::vector<uint8_t> out( reference.size() );
+
+	const double scalar = time_kernel( fn, EKernel::Scalar, indices, palette, reference );
+	printf( "%-8s %-8s %10.1f MPix/s\n", name, str_for_kernel( EKernel::Scalar ), scalar );
+
+	bool ok = true;
+
+	for (uint32_t k = (uint32_t)EKernel::Scalar + 1; k < (uint32_t)EKernel::KernelCount; k++)
+	{
+		const auto kernel = (EKernel)k;
+		if (!is_kernel_supported( kernel ))
+			continue;
+
+		std::fill( out.begin(), out.end(), 0 );
+		const double speed = time_kernel( fn, kernel, indices, palette, out );
+		const bool match = out == reference;
+
+		printf( "%-8s %-8s %10.1f MPix/s %5.2fx %s\n", name, str_for_kernel( kernel ), speed, speed / scalar, match ? "" : "MISMATCH" );
+
+		ok &= match;
+	}
+
+	return ok;
+}
+
+//	Every kernel has to agree with the scalar one on every palette length,
+//	including the partial ones, and on the transparency rule.
+static bool verify_palettes( const uint8_t* rgb )
+{
+	for (uint32_t k = (uint32_t)EKernel::Scalar + 1; k < (uint32_t)EKernel::KernelCount; k++)
+	{
+		const auto kernel = (EKernel)k;
+		if (!is_kernel_supported( kernel ))
+			continue;
+
+		for (uint32_t num_colors = 0; num_colors <= 256; num_colors++)
+		{
+			uint8_t reference[RGBA_PALETTE_SIZE], out[RGBA_PALETTE_SIZE];
+
+			for (const bool transparent : { false, true })
+			{
+				palette_rgb_to_rgba( rgb, num_colors, transparent, reference, EKernel::Scalar );
+				palette_rgb_to_rgba( rgb, num_colors, transparent, out, kernel );
+
+				if (memcmp( reference, out, sizeof( out ) ))
+				{
+					printf( "Error: %s RGBA palette mismatch (%d colors)\n", str_for_kernel( kernel ), num_colors );
+					return false;
+				}
+			}
+
+			palette_rgb_to_bgrx( rgb, num_colors, reference, EKernel::Scalar );
+			palette_rgb_to_bgrx( rgb, num_colors, out, kernel );
+
+			if (memcmp( reference, out, sizeof( out ) ))
+			{
+				printf( "Error: %s BGRX palette mismatch (%d colors)\n", str_for_kernel( kernel ), num_colors );
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//	Typical texture sizes: mostly power of two widths and a few odd ones.
+static const uint32_t kBmpSizes[][2] =
+{
+	{ 16, 16 }, { 32, 32 }, { 64, 64 }, { 64, 128 }, { 128, 128 }, { 256, 128 }, { 256, 256 }, { 512, 512 },
+	{ 48, 48 }, { 100, 60 }, { 37, 20 },
+};
+
+//	Rows written per size, the small ones get more iterations.
+static constexpr uint64_t kBmpBytes = 256ull * 1024 * 1024;
+
+//	Returns the throughput in megabytes per second.
+static double time_row_writer( CBitMap::RowWriter_t fn, const std::vector<uint8_t>& bits, uint32_t width, uint32_t height, std::vector<uint8_t>& out )
+{
+	const uint64_t iterations = std::max<uint64_t>( 1, kBmpBytes / bits.size() );
+
+	fn( bits.data(), width, height, out.data() );
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < iterations; i++)
+		fn( bits.data(), width, height, out.data() );
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return (double)bits.size() * iterations / elapsed.count() / 1e6;
+}
+
+//	The width specialized row writers against the padded one every width can use.
+static bool bench_bmp_rows( std::mt19937& rng )
+{
+	bool ok = true;
+
+	for (const auto& size : kBmpSizes)
+	{
+		const uint32_t width = size[0], height = size[1];
+
+		std::vector<uint8_t> bits( width * height );
+		for (auto& b : bits)
+			b = (uint8_t)rng();
+
+		//	Garbage in the output, so missing padding shows up as a mismatch.
+		std::vector<uint8_t> reference( ((width + 3) & ~3) * height, 0xCD );
+		std::vector<uint8_t> out( reference.size(), 0xCD );
+
+		const auto writer = CBitMap::GetRowWriter( width );
+		const char* kind = writer == CBitMap::WriteRowsPadded ? "padded" : (width >= 16 && width <= 512 && !(width & (width - 1))) ? "fixed" : "aligned";
+
+		const double generic = time_row_writer( CBitMap::WriteRowsPadded, bits, width, height, reference );
+		const double speed = time_row_writer( writer, bits, width, height, out );
+		const bool match = out == reference;
+
+		printf( "bmp rows %4dx%-4d %-8s %10.1f MB/s, padded %10.1f MB/s %5.2fx %s\n", width, height, kind, speed, generic, speed / generic, match ? "" : "MISMATCH" );
+
+		ok &= match;
+	}
+
+	return ok;
+}
+
+int run_benchmarks()
+{
+	std::mt19937 rng( 1337 );
+
+	std::vector<uint8_t> rgb( 256 * 3 );
+	for (auto& c : rgb)
+		c = (uint8_t)rng();
+
+	//	Odd length so the scalar tails get exercised as well.
+	std::vector<uint8_t> indices( kPixelCount + 13 );
+	for (auto& i : indices)
+		i = (uint8_t)rng();
+
+	alignas(32) uint8_t palette[RGBA_PALETTE_SIZE];
+	palette_rgb_to_rgba( rgb.data(), 256, true, palette, EKernel::Scalar );
+
+	printf( "Best kernel: %s\n", str_for_kernel( best_kernel() ) );
+	printf( "%d pixels, %d iterations\n\n", (uint32_t)indices.size(), kIterations );
+
+	bool ok = verify_palettes( rgb.data() );
+	ok &= bench_expansion( "rgba", expand_indexed_rgba, 4, indices, palette );
+	ok &= bench_expansion( "rgb", expand_indexed_rgb, 3, indices, palette );
+
+	printf( "\n" );
+	ok &= bench_bmp_rows( rng );
+
+	if (!ok)
+	{
+		printf( "\nError: Optimized output doesn't match the reference.\n" );
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#pragma once
+
+//	Times every kernel the CPU supports against the scalar reference and
+//	checks that they produce the same output. Returns the process exit code.
+int run_benchmarks();
+
+#endif
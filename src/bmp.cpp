@@ -1,15 +1,90 @@
-﻿#include "bmp.h"
+﻿#include <cstring>
 
+#include "bmp.h"
+#include "palette_kernels.h"
+#include "metrics.h"
+
+#ifdef _MSC_VER
 #pragma warning(disable : 4996) //_CRT_SECURE_NO_WARNINGS
+#endif
 
-EBMPResult CBitMap::Write( const char* szFile, uint32_t width, uint32_t height, uint8_t* pbBits, uint8_t* pbPalette )
+//	Widths that are a multiple of 4 have no padding. A constant width lets the
+//	compiler unroll the copy into wide moves instead of calling memcpy per row.
+template<uint32_t Width>
+static void write_rows_fixed( const uint8_t* pbBits, uint32_t, uint32_t height, uint8_t* pbOut )
 {
-	// Bogus parameter check
-	if (!pbPalette || !pbBits)
+	static_assert( Width % 16 == 0, "The fixed row writers copy 16 bytes at a time" );
+
+	const uint8_t* pb = pbBits + (height - 1) * Width;
+
+	for (uint32_t y = 0; y < height; y++, pb -= Width, pbOut += Width)
 	{
-		printf( "Error: Invalid parameter passed: %#x %#x\n", pbPalette, pbBits );
-		return EBMPResult::InvalidParameter;
+		for (uint32_t x = 0; x < Width; x += 16)
+			memcpy( pbOut + x, pb + x, 16 );
+	}
+}
+
+static void write_rows_aligned( const uint8_t* pbBits, uint32_t width, uint32_t height, uint8_t* pbOut )
+{
+	const uint8_t* pb = pbBits + (height - 1) * width;
+
+	for (uint32_t y = 0; y < height; y++, pb -= width, pbOut += width)
+		memcpy( pbOut, pb, width );
+}
+
+//	Indexed by log2 of the width, 16 to 512.
+static const CBitMap::RowWriter_t g_FixedRowWriters[] =
+{
+	write_rows_fixed<16>,
+	write_rows_fixed<32>,
+	write_rows_fixed<64>,
+	write_rows_fixed<128>,
+	write_rows_fixed<256>,
+	write_rows_fixed<512>,
+};
+
+CBitMap::RowWriter_t CBitMap::GetRowWriter( uint32_t width )
+{
+	if (width >= 16 && width <= 512 && !(width & (width - 1)))
+	{
+		uint32_t log2 = 0;
+		while ((16u << log2) != width)
+			log2++;
+
+		return g_FixedRowWriters[log2];
+	}
+
+	return width % 4 ? WriteRowsPadded : write_rows_aligned;
+}
+
+void CBitMap::WriteRowsPadded( const uint8_t* pbBits, uint32_t width, uint32_t height, uint8_t* pbOut )
+{
+	const uint32_t biTrueWidth = ((width + 3) & ~3);
+	const uint8_t* pb = pbBits + (height - 1) * width;
+
+	for (uint32_t y = 0; y < height; y++, pb -= width, pbOut += biTrueWidth)
+	{
+		memcpy( pbOut, pb, width );
+		memset( pbOut + width, 0, biTrueWidth - width );
 	}
+}
+
+EBMPResult CBitMap::Write( const char* szFile, uint32_t width, uint32_t height, uint8_t* pbBits, uint8_t* pbPalette )
+{
+	return Write( szFile, { {}, width, height, pbBits, reinterpret_cast<const ColorData_t*>(pbPalette), kColorDepth } );
+}
+
+EBMPResult CBitMap::Write( const char* szFile, const IndexedImageView_t& image )
+{
+	//	Reused between the calls, exports write thousands of these in a row.
+	static thread_local std::vector<uint8_t> bmp;
+
+	const auto result = Encode( image, bmp );
+	if (result != EBMPResult::Success)
+		return result;
+
+	METRICS_TIMER( timer, "bmp.write" );
+	timer.add_bytes( bmp.size() );
 
 	// File exists?
 	const auto pfile = fopen( szFile, "wb" );
@@ -19,12 +94,45 @@ EBMPResult CBitMap::Write( const char* szFile, uint32_t width, uint32_t height,
 		return EBMPResult::InvalidFilehandle;
 	}
 
-	ULONG biTrueWidth = ((width + 3) & ~3);
-	ULONG cbBmpBits = biTrueWidth * height;
-	ULONG cbPalBytes = kColorDepth * sizeof( RGBQUAD );
+	// Write the whole file at once
+	if (fwrite( bmp.data(), bmp.size(), sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
+	{
+		fclose( pfile );
+		printf( "Error: Failed to write bitmap (%s)\n", szFile );
+		return EBMPResult::FailBitmapBits;
+	}
+
+	fclose( pfile );
+
+	return EBMPResult::Success;
+}
+
+EBMPResult CBitMap::Encode( uint32_t width, uint32_t height, const uint8_t* pbBits, const uint8_t* pbPalette, std::vector<uint8_t>& out )
+{
+	return Encode( { {}, width, height, pbBits, reinterpret_cast<const ColorData_t*>(pbPalette), kColorDepth }, out );
+}
+
+EBMPResult CBitMap::Encode( const IndexedImageView_t& image, std::vector<uint8_t>& out )
+{
+	const uint32_t width = image.width;
+	const uint32_t height = image.height;
+	const uint8_t* pbBits = image.pixels;
 
-	BITMAPFILEHEADER bmfh;
-	BITMAPINFOHEADER bmih;
+	// Bogus parameter check
+	if (!image.palette || !pbBits || !width || !height)
+	{
+		printf( "Error: Invalid parameter passed: %p %p\n", (void*)image.palette, (void*)pbBits );
+		return EBMPResult::InvalidParameter;
+	}
+
+	METRICS_TIMER( timer, "bmp.encode" );
+
+	uint32_t biTrueWidth = ((width + 3) & ~3);
+	uint32_t cbBmpBits = biTrueWidth * height;
+	uint32_t cbPalBytes = kColorDepth * sizeof( RGBQuad_t );
+
+	BitmapFileHeader_t bmfh;
+	BitmapInfoHeader_t bmih;
 	// Bogus file header check
 	bmfh.bfType = kFileHeaderType;
 	bmfh.bfSize = sizeof( bmfh ) + sizeof( bmih ) + cbBmpBits + cbPalBytes;
@@ -32,18 +140,20 @@ EBMPResult CBitMap::Write( const char* szFile, uint32_t width, uint32_t height,
 	bmfh.bfReserved2 = 0;
 	bmfh.bfOffBits = sizeof( bmfh ) + sizeof( bmih ) + cbPalBytes;
 
-	// Write file header
-	if (fwrite( &bmfh, sizeof( bmfh ), sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
-	{
-		fclose( pfile );
-		printf( "Error: Failed to write file header\n" );
-		return EBMPResult::FailFileHeader;
-	}
+	// The whole file is built in memory, every byte of it gets written below
+	// so a reused buffer doesn't have to be cleared.
+	out.resize( bmfh.bfSize );
+	uint8_t* pout = out.data();
+
+	// File header
+	SwapBitmapFileHeader( bmfh );
+	memcpy( pout, &bmfh, sizeof( bmfh ) );
+	pout += sizeof( bmfh );
 
 	// Size of structure
 	bmih.biSize = sizeof( bmih );
-	// Width
-	bmih.biWidth = biTrueWidth;
+	// Width, the rows are padded to biTrueWidth on their own
+	bmih.biWidth = width;
 	// Height
 	bmih.biHeight = height;
 	// Only 1 plane 
@@ -62,75 +172,31 @@ EBMPResult CBitMap::Write( const char* szFile, uint32_t width, uint32_t height,
 	bmih.biClrUsed = kColorDepth;
 	bmih.biClrImportant = 0;
 
-	// Write info header
-	if (fwrite( &bmih, sizeof( bmih ), sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
-	{
-		fclose( pfile );
-		printf( "Error: Failed to write info header\n" );
-		return EBMPResult::FailInfoHeader;
-	}
+	// Info header
+	BitmapInfoHeader_t bmih_disk = bmih;
+	SwapBitmapInfoHeader( bmih_disk );
+	memcpy( pout, &bmih_disk, sizeof( bmih_disk ) );
+	pout += sizeof( bmih_disk );
 
-	// convert to expanded palette
-	uint8_t* pb = pbPalette;
+	// Palette (bmih.biClrUsed entries), expanded straight into the output
+	static_assert( sizeof( RGBQuad_t ) * kColorDepth == RGBA_PALETTE_SIZE );
+	palette_rgb_to_bgrx( reinterpret_cast<const uint8_t*>(image.palette), image.num_colors, pout );
+	pout += bmih.biClrUsed * sizeof( RGBQuad_t );
 
-	// Copy over used entries
-	RGBQUAD rgrgbPalette[kColorDepth];
-	for (int32_t i = 0; i < (int32_t)bmih.biClrUsed; i++)
-	{
-		rgrgbPalette[i].rgbRed = *pb++;
-		rgrgbPalette[i].rgbGreen = *pb++;
-		rgrgbPalette[i].rgbBlue = *pb++;
-		rgrgbPalette[i].rgbReserved = 0;
-	}
-
-	// Write palette (bmih.biClrUsed entries)
-	cbPalBytes = bmih.biClrUsed * sizeof( RGBQUAD );
-	if (fwrite( rgrgbPalette, cbPalBytes, sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
-	{
-		fclose( pfile );
-		printf( "Error: Failed to write palette (bmih.biClrUsed entries)\n" );
-		return EBMPResult::FailPalette;
-	}
-
-	uint8_t* pbBmpBits = (uint8_t*)malloc( cbBmpBits );
-
-	if (!pbBmpBits)
-	{
-		fclose( pfile );
-		printf( "Error: Failed to allocate memory\n" );
-		return EBMPResult::FailMalloc;
-	}
-
-	pb = pbBits;
 	// reverse the order of the data.
-	pb += (height - 1) * width;
-	for (int32_t i = 0; i < bmih.biHeight; i++)
-	{
-		memmove( &pbBmpBits[biTrueWidth * i], pb, width );
-		pb -= width;
-	}
+	GetRowWriter( width )( pbBits, width, height, pout );
 
-	// Write bitmap bits (remainder of file)
-	if (fwrite( pbBmpBits, cbBmpBits, sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
-	{
-		printf( "Error: Failed to write bitmap bits (remainder of file)\n" );
-		free( pbBmpBits );
-		fclose( pfile );
-		return EBMPResult::FailBitmapBits;
-	}
-
-	free( pbBmpBits );
-	fclose( pfile );
+	timer.add_bytes( out.size() );
 
 	return EBMPResult::Success;
 }
 
-EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPalette )
+EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPalette, uint32_t* pWidth, uint32_t* pHeight )
 {
 	// Bogus parameter check
 	if (!ppbPalette || !ppbBits)
 	{
-		printf( "Error: Invalid parameter passed: %#x %#x\n", ppbPalette, ppbBits );
+		printf( "Error: Invalid parameter passed: %p %p\n", (void*)ppbPalette, (void*)ppbBits );
 		return EBMPResult::InvalidParameter;
 	}
 
@@ -143,7 +209,7 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 	}
 
 	// Read file header
-	BITMAPFILEHEADER bmfh;
+	BitmapFileHeader_t bmfh;
 	if (fread( &bmfh, sizeof( bmfh ), sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
 	{
 		fclose( pfile );
@@ -151,6 +217,8 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 		return EBMPResult::FailFileHeader;
 	}
 
+	SwapBitmapFileHeader( bmfh );
+
 	// Bogus file header check
 	if (!(bmfh.bfReserved1 == 0 && bmfh.bfReserved2 == 0))
 	{
@@ -160,7 +228,7 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 	}
 
 	// Read info header
-	BITMAPINFOHEADER bmih;
+	BitmapInfoHeader_t bmih;
 	if (fread( &bmih, sizeof( bmih ), sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
 	{
 		fclose( pfile );
@@ -168,6 +236,8 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 		return EBMPResult::FailInfoHeader;
 	}
 
+	SwapBitmapInfoHeader( bmih );
+
 	// Bogus info header check
 	if (!(bmih.biSize == sizeof( bmih ) && bmih.biPlanes == 1))
 	{
@@ -192,16 +262,24 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 		return EBMPResult::InvalidBitCompression;
 	}
 
+	// Bogus palette? Only up to 256 colors.
+	if (bmih.biClrUsed > kColorDepth)
+	{
+		fclose( pfile );
+		printf( "Error: Invalid palette size: %d\n", bmih.biClrUsed );
+		return EBMPResult::FailPalette;
+	}
+
 	// Figure out how many entires are actually in the table
-	ULONG cbPalBytes = bmih.biClrUsed * sizeof( RGBQUAD );
+	uint32_t cbPalBytes = bmih.biClrUsed * sizeof( RGBQuad_t );
 	if (bmih.biClrUsed == 0)
 	{
 		bmih.biClrUsed = kColorDepth;
-		cbPalBytes = (1 << bmih.biBitCount) * sizeof( RGBQUAD );
+		cbPalBytes = (1 << bmih.biBitCount) * sizeof( RGBQuad_t );
 	}
 
 	// Read palette (bmih.biClrUsed entries)
-	RGBQUAD rgrgbPalette[kColorDepth];
+	RGBQuad_t rgrgbPalette[kColorDepth];
 	if (fread( rgrgbPalette, cbPalBytes, 1/*count*/, pfile ) != 1)
 	{
 		fclose( pfile );
@@ -228,27 +306,40 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 	}
 
 	// Fill in unused entires will 0,0,0
-	for (int32_t i = bmih.biClrUsed; i < kColorDepth; i++)
+	for (int32_t i = bmih.biClrUsed; i < (int32_t)kColorDepth; i++)
 	{
 		*pb++ = 0;
 		*pb++ = 0;
 		*pb++ = 0;
 	}
 
-	// Read bitmap bits (remainder of file)
-	ULONG cbBmpBits = bmfh.bfSize - ftell( pfile );
+	// Bogus dimensions? Top-down bitmaps have negative height.
+	const bool bTopDown = bmih.biHeight < 0;
+	const int32_t biHeight = bTopDown ? -bmih.biHeight : bmih.biHeight;
+
+	if (bmih.biWidth <= 0 || biHeight <= 0 || bmih.biWidth > kMaxDimension || biHeight > kMaxDimension)
+	{
+		fclose( pfile );
+		free( pbPal );
+		printf( "Error: Invalid dimensions: %dx%d\n", bmih.biWidth, bmih.biHeight );
+		return EBMPResult::FailInfoHeader;
+	}
+
+	// data is actually stored with the width being rounded up to a multiple of 4
+	const uint32_t biTrueWidth = (bmih.biWidth + 3) & ~3;
+	const uint32_t cbBmpBits = biTrueWidth * biHeight;
+
 	pb = (uint8_t*)malloc( cbBmpBits );
 	if (!pb)
 	{
 		printf( "Error: Failed to allocate memory\n" );
 		fclose( pfile );
 		free( pbPal );
-		free( pb );
 		return EBMPResult::FailMalloc;
 	}
 
 	// Read bitmap bits (remainder of file)
-	if (fread( pb, cbBmpBits, sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
+	if (fseek( pfile, bmfh.bfOffBits, SEEK_SET ) != 0 || fread( pb, cbBmpBits, sizeof( uint8_t ), pfile ) != sizeof( uint8_t ))
 	{
 		printf( "Error: Failed to read bitmap bits (remainder of file)\n" );
 		fclose( pfile );
@@ -257,34 +348,56 @@ EBMPResult CBitMap::Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPa
 		return EBMPResult::FailBitmapBits;
 	}
 
-	uint8_t* pbBmpBits = (uint8_t*)malloc( cbBmpBits );
+	// The output is tightly packed, without the padding.
+	uint8_t* pbBmpBits = (uint8_t*)malloc( bmih.biWidth * biHeight );
 	if (!pbBmpBits)
 	{
 		printf( "Error: Failed to allocate memory\n" );
 		fclose( pfile );
 		free( pbPal );
 		free( pb );
-		free( pbBmpBits );
 		return EBMPResult::FailMalloc;
 	}
 
-	// data is actually stored with the width being rounded up to a multiple of 4
-	int32_t biTrueWidth = (bmih.biWidth + 3) & ~3;
-
 	// reverse the order of the data.
-	pb += (bmih.biHeight - 1) * biTrueWidth;
-
-	for (int32_t i = 0; i < bmih.biHeight; i++, pb -= biTrueWidth)
-		memmove( &pbBmpBits[biTrueWidth * i], pb, biTrueWidth );
-
-	pb += biTrueWidth;
+	for (int32_t i = 0; i < biHeight; i++)
+	{
+		const int32_t row = bTopDown ? i : biHeight - 1 - i;
+		memcpy( &pbBmpBits[bmih.biWidth * i], &pb[biTrueWidth * row], bmih.biWidth );
+	}
 
 	// Set output parameters
 	*ppbPalette = pbPal;
 	*ppbBits = pbBmpBits;
 
+	if (pWidth)
+		*pWidth = bmih.biWidth;
+
+	if (pHeight)
+		*pHeight = biHeight;
+
 	fclose( pfile );
 	free( pb );
 
 	return EBMPResult::Success;
-}
\ No newline at end of file
+}
+
+EBMPResult CBitMap::Read( const char* szFile, IndexedImage_t& image )
+{
+	uint8_t* pbBits = nullptr;
+	uint8_t* pbPalette = nullptr;
+
+	const auto result = Read( szFile, &pbBits, &pbPalette, &image.width, &image.height );
+	if (result != EBMPResult::Success)
+		return result;
+
+	image.pixels.assign( pbBits, pbBits + image.width * image.height );
+
+	image.palette.resize( kColorDepth );
+	memcpy( image.palette.data(), pbPalette, kPaletteSize );
+
+	free( pbBits );
+	free( pbPalette );
+
+	return EBMPResult::Success;
+}
@@ -2,7 +2,76 @@
 #define BMP_H
 
 #include <iostream>
-#include <Windows.h>
+#include <cstdint>
+#include <vector>
+
+#include "byteorder.h"
+#include "indexed_image.h"
+
+//	On-disk BMP structures. These used to come from windows.h, they're defined
+//	here so the code builds everywhere. Everything is stored in little endian.
+#pragma pack(push, 1)
+struct BitmapFileHeader_t
+{
+	uint16_t bfType;
+	uint32_t bfSize;
+	uint16_t bfReserved1;
+	uint16_t bfReserved2;
+	uint32_t bfOffBits;
+};
+
+struct BitmapInfoHeader_t
+{
+	uint32_t biSize;
+	int32_t	 biWidth;
+	int32_t	 biHeight;
+	uint16_t biPlanes;
+	uint16_t biBitCount;
+	uint32_t biCompression;
+	uint32_t biSizeImage;
+	int32_t	 biXPelsPerMeter;
+	int32_t	 biYPelsPerMeter;
+	uint32_t biClrUsed;
+	uint32_t biClrImportant;
+};
+
+struct RGBQuad_t
+{
+	uint8_t rgbBlue;
+	uint8_t rgbGreen;
+	uint8_t rgbRed;
+	uint8_t rgbReserved;
+};
+#pragma pack(pop)
+
+static_assert( sizeof( BitmapFileHeader_t ) == 14, "BitmapFileHeader_t has to be 14 bytes long" );
+static_assert( sizeof( BitmapInfoHeader_t ) == 40, "BitmapInfoHeader_t has to be 40 bytes long" );
+static_assert( sizeof( RGBQuad_t ) == 4, "RGBQuad_t has to be 4 bytes long" );
+
+//	Converts the headers between little endian and the host byte order.
+inline void SwapBitmapFileHeader( BitmapFileHeader_t& bmfh )
+{
+	bmfh.bfType = LittleShort( bmfh.bfType );
+	bmfh.bfSize = LittleLong( bmfh.bfSize );
+	bmfh.bfReserved1 = LittleShort( bmfh.bfReserved1 );
+	bmfh.bfReserved2 = LittleShort( bmfh.bfReserved2 );
+	bmfh.bfOffBits = LittleLong( bmfh.bfOffBits );
+}
+
+inline void SwapBitmapInfoHeader( BitmapInfoHeader_t& bmih )
+{
+	bmih.biSize = LittleLong( bmih.biSize );
+	bmih.biWidth = LittleLong( bmih.biWidth );
+	bmih.biHeight = LittleLong( bmih.biHeight );
+	bmih.biPlanes = LittleShort( bmih.biPlanes );
+	bmih.biBitCount = LittleShort( bmih.biBitCount );
+	bmih.biCompression = LittleLong( bmih.biCompression );
+	bmih.biSizeImage = LittleLong( bmih.biSizeImage );
+	bmih.biXPelsPerMeter = LittleLong( bmih.biXPelsPerMeter );
+	bmih.biYPelsPerMeter = LittleLong( bmih.biYPelsPerMeter );
+	bmih.biClrUsed = LittleLong( bmih.biClrUsed );
+	bmih.biClrImportant = LittleLong( bmih.biClrImportant );
+}
 
 enum class EBMPResult : uint32_t
 {
@@ -23,15 +92,32 @@ enum class EBMPResult : uint32_t
 class CBitMap
 {
 public:
-	inline static constexpr uint16_t kFileHeaderType = MAKEWORD( 'B', 'M' );
+	//	Copies tightly packed rows bottom up into rows padded to 4 bytes.
+	using RowWriter_t = void (*)( const uint8_t* pbBits, uint32_t width, uint32_t height, uint8_t* pbOut );
+
+	inline static constexpr uint16_t kFileHeaderType = 'B' | ('M' << 8);
 	inline static constexpr uint32_t kColorDepth = ((uint8_t)-1) + 1;
 	inline static constexpr uint32_t kNumPlanes = 1;
 	inline static constexpr uint32_t kBitDepth = 8;
-	inline static constexpr uint32_t kBitCompression = BI_RGB;
+	inline static constexpr uint32_t kBitCompression = 0; // BI_RGB
 	inline static constexpr uint32_t kPaletteSize = 768;
+	inline static constexpr int32_t kMaxDimension = 8192;
 
+	static EBMPResult Write( const char* szFile, const IndexedImageView_t& image );
 	static EBMPResult Write( const char* szFile, uint32_t width, uint32_t height, uint8_t* pbBits, uint8_t* pbPalette );
-	static EBMPResult Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPalette );
+	//	Same as Write, but the whole file ends up in a memory buffer. Palette
+	//	entries past image.num_colors are written as black.
+	static EBMPResult Encode( const IndexedImageView_t& image, std::vector<uint8_t>& out );
+	static EBMPResult Encode( uint32_t width, uint32_t height, const uint8_t* pbBits, const uint8_t* pbPalette, std::vector<uint8_t>& out );
+	//	Fully unrolled copies for the power of two widths textures almost always
+	//	have, plain row copies for other multiples of 4 and padded ones for the rest.
+	static RowWriter_t GetRowWriter( uint32_t width );
+	//	Works for every width, the reference for the others.
+	static void WriteRowsPadded( const uint8_t* pbBits, uint32_t width, uint32_t height, uint8_t* pbOut );
+	//	The bits are tightly packed top to bottom, both outputs have to be freed with free().
+	static EBMPResult Read( const char* szFile, uint8_t** ppbBits, uint8_t** ppbPalette, uint32_t* pWidth = nullptr, uint32_t* pHeight = nullptr );
+	//	Same as above, the palette always has 256 entries. The image is left unnamed.
+	static EBMPResult Read( const char* szFile, IndexedImage_t& image );
 };
 
 #endif
\ No newline at end of file
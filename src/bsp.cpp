@@ -0,0 +1,191 @@
+#include <cstring>
+#include <algorithm>
+
+#include "bsp.h"
+#include "byteorder.h"
+
+static int32_t read_long( const uint8_t* p )
+{
+	int32_t value;
+	memcpy( &value, p, sizeof( value ) );
+	return LittleLong( value );
+}
+
+bool CBspFile::open()
+{
+	if (!m_mapping.open( m_path ))
+		return fail( m_mapping.error() );
+
+	const size_t filesize = m_mapping.size();
+	const uint8_t* base = m_mapping.data();
+
+	if (filesize < sizeof( BspHeader_t ))
+		return fail( "The file is too small to be a BSP file." );
+
+	BspHeader_t header;
+	memcpy( &header, base, sizeof( header ) );
+	header.version = LittleLong( header.version );
+
+	if (header.version != BSP_VERSION)
+		return fail( "Unsupported BSP version " + std::to_string( header.version ) + ", only GoldSrc maps (30) are supported." );
+
+	for (auto& lump : header.lumps)
+	{
+		lump.offset = LittleLong( lump.offset );
+		lump.length = LittleLong( lump.length );
+
+		if (lump.offset < 0 || lump.length < 0 || (uint64_t)lump.offset + lump.length > filesize)
+			return fail( "A lump is out of the range of the BSP file." );
+	}
+
+	if (!parse_textures( header.lumps[BSP_LUMP_TEXTURES] ))
+		return false;
+
+	parse_worldspawn( header.lumps[BSP_LUMP_ENTITIES] );
+
+	return true;
+}
+
+bool CBspFile::parse_textures( const BspLump_t& lump )
+{
+	m_textures.clear();
+
+	if (!lump.length)
+		return true;
+
+	const uint8_t* base = m_mapping.data() + lump.offset;
+	const uint32_t size = (uint32_t)lump.length;
+
+	if (size < sizeof( int32_t ))
+		return fail( "The texture lump is too small." );
+
+	const int32_t count = read_long( base );
+	if (count < 0 || ((uint64_t)count + 1) * sizeof( int32_t ) > size)
+		return fail( "The texture lump has an invalid texture count." );
+
+	for (int32_t i = 0; i < count; i++)
+	{
+		const int32_t offset = read_long( base + (i + 1) * sizeof( int32_t ) );
+
+		BspTexture_t tex = {};
+
+		//	Unused slots are -1, keep them so the indices match the map's.
+		if (offset < 0 || (uint64_t)offset + sizeof( MipTexture_t ) > size)
+		{
+			m_textures.push_back( std::move( tex ) );
+			continue;
+		}
+
+		MipTexture_t miptex;
+		memcpy( &miptex, base + offset, sizeof( miptex ) );
+		SwapMipTexture( miptex );
+
+		tex.name.assign( miptex.name, strnlen( miptex.name, sizeof( miptex.name ) ) );
+		tex.width = miptex.width;
+		tex.height = miptex.height;
+
+		//	External textures have no mips, only the header.
+		if (miptex.offsets[0] && CWadFile::is_texture_valid( &miptex ))
+		{
+			const uint32_t last = MIPLEVELS - 1;
+			const uint64_t palette_ofs = (uint64_t)offset + miptex.offsets[last] + (uint64_t)CWadFile::mip_width( tex.width, last ) * CWadFile::mip_height( tex.height, last );
+
+			if (palette_ofs + sizeof( uint16_t ) <= size)
+			{
+				uint16_t colors;
+				memcpy( &colors, base + palette_ofs, sizeof( colors ) );
+				colors = LittleShort( colors );
+
+				const uint64_t end = palette_ofs + sizeof( uint16_t ) + colors * 3ull;
+				if (end <= size)
+				{
+					tex.miptex = base + offset;
+					tex.miptex_size = (uint32_t)(end - offset);
+				}
+			}
+		}
+
+		m_textures.push_back( std::move( tex ) );
+	}
+
+	return true;
+}
+
+void CBspFile::parse_worldspawn( const BspLump_t& lump )
+{
+	m_wads.clear();
+
+	//	The worldspawn is the first entity: { "key" "value" ... }
+	const std::string_view text( (const char*)m_mapping.data() + lump.offset, lump.length );
+
+	const size_t begin = text.find( '{' );
+	const size_t end = text.find( '}', begin );
+	if (begin == text.npos || end == text.npos)
+		return;
+
+	const auto entity = text.substr( begin + 1, end - begin - 1 );
+
+	//	Collect the quoted strings, every odd one is a value.
+	std::vector<std::string_view> tokens;
+	for (size_t pos = 0;;)
+	{
+		const size_t open = entity.find( '"', pos );
+		if (open == entity.npos)
+			break;
+
+		const size_t close = entity.find( '"', open + 1 );
+		if (close == entity.npos)
+			break;
+
+		tokens.push_back( entity.substr( open + 1, close - open - 1 ) );
+		pos = close + 1;
+	}
+
+	for (size_t i = 0; i + 1 < tokens.size(); i += 2)
+	{
+		if (!CWadFile::names_equal( tokens[i], "wad" ))
+			continue;
+
+		//	\half-life\valve\halflife.wad;\half-life\valve\decals.wad
+		const auto value = tokens[i + 1];
+
+		for (size_t pos = 0; pos < value.size();)
+		{
+			size_t next = value.find( ';', pos );
+			if (next == value.npos)
+				next = value.size();
+
+			auto entry = value.substr( pos, next - pos );
+
+			const size_t slash = entry.find_last_of( "/\\" );
+			if (slash != entry.npos)
+				entry = entry.substr( slash + 1 );
+
+			if (!entry.empty())
+				m_wads.push_back( CWadFile::lower_name( entry ) );
+
+			pos = next + 1;
+		}
+
+		break;
+	}
+}
+
+bool CBspFile::decode_texture( uint32_t index, TextureData_t& out ) const
+{
+	if (index >= m_textures.size() || !m_textures[index].miptex)
+		return false;
+
+	return CWadFile::decode_miptex( m_textures[index].miptex, m_textures[index].miptex_size, out );
+}
+
+uint32_t CBspFile::num_embedded() const
+{
+	return (uint32_t)std::count_if( m_textures.begin(), m_textures.end(), []( const BspTexture_t& tex ) { return tex.miptex != nullptr; } );
+}
+
+bool CBspFile::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
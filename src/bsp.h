@@ -0,0 +1,90 @@
+#ifndef BSP_H
+#define BSP_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "wad.h"
+#include "mapped_file.h"
+
+//	GoldSrc maps are version 30.
+#define BSP_VERSION			30
+
+#define BSP_LUMP_ENTITIES	0
+#define BSP_LUMP_TEXTURES	2
+#define BSP_NUM_LUMPS		15
+
+struct BspLump_t
+{
+	int32_t offset;
+	int32_t length;
+};
+
+struct BspHeader_t
+{
+	int32_t version;
+	BspLump_t lumps[BSP_NUM_LUMPS];
+};
+
+static_assert( sizeof( BspHeader_t ) == 124, "BspHeader_t has to be 124 bytes long" );
+
+//	A texture referenced by the map. Embedded textures point straight into the
+//	mapped file, the rest only have a name and the dimensions and have to be
+//	found in one of the WAD files the map lists.
+struct BspTexture_t
+{
+	std::string name;		// As spelled in the map, up to 16 characters
+	uint32_t width, height;
+
+	const uint8_t* miptex;	// nullptr when the texture isn't embedded
+	uint32_t miptex_size;	// Exact size of the MipTexture_t with its mips and palette
+};
+
+//	Reads the textures and the worldspawn of a BSP file. The file is memory
+//	mapped and nothing is copied until a texture is decoded, which goes
+//	through the same CWadFile::decode_miptex() as the WAD textures.
+class CBspFile
+{
+public:
+	CBspFile( const std::filesystem::path& path ) :
+		m_path(path)
+	{}
+
+	CBspFile( const CBspFile& ) = delete;
+	CBspFile& operator=( const CBspFile& ) = delete;
+
+	bool open();
+
+	bool decode_texture( uint32_t index, TextureData_t& out ) const;
+
+	const std::filesystem::path& path() const { return m_path; }
+	const std::vector<BspTexture_t>& textures() const { return m_textures; }
+
+	//	File names of the WADs in the "wad" key of the worldspawn, lower case
+	//	and without the directories.
+	const std::vector<std::string>& wads() const { return m_wads; }
+
+	uint32_t num_embedded() const;
+	const std::string& error() const { return m_error; }
+
+private:
+	bool parse_textures( const BspLump_t& lump );
+	void parse_worldspawn( const BspLump_t& lump );
+
+	bool fail( const std::string& msg );
+
+private:
+	std::filesystem::path m_path;
+	CMappedFile m_mapping;
+
+	std::vector<BspTexture_t> m_textures;
+	std::vector<std::string> m_wads;
+
+	std::string m_error;
+};
+
+#endif
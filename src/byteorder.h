@@ -0,0 +1,56 @@
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+//	Everything on disk (WAD, BMP, ...) is stored in little endian. These are
+//	no-ops on little endian machines and swap the bytes on big endian ones.
+
+constexpr uint16_t ByteSwap16( uint16_t v )
+{
+	return (uint16_t)((v >> 8) | (v << 8));
+}
+
+constexpr uint32_t ByteSwap32( uint32_t v )
+{
+	return (v >> 24) | ((v >> 8) & 0x0000FF00) | ((v << 8) & 0x00FF0000) | (v << 24);
+}
+
+constexpr uint64_t ByteSwap64( uint64_t v )
+{
+	return ((uint64_t)ByteSwap32( (uint32_t)v ) << 32) | ByteSwap32( (uint32_t)(v >> 32) );
+}
+
+constexpr uint16_t LittleShort( uint16_t v )
+{
+	if constexpr (std::endian::native == std::endian::little)
+		return v;
+	else
+		return ByteSwap16( v );
+}
+
+constexpr uint32_t LittleLong( uint32_t v )
+{
+	if constexpr (std::endian::native == std::endian::little)
+		return v;
+	else
+		return ByteSwap32( v );
+}
+
+constexpr int32_t LittleLong( int32_t v )
+{
+	return (int32_t)LittleLong( (uint32_t)v );
+}
+
+constexpr uint64_t LittleLongLong( uint64_t v )
+{
+	if constexpr (std::endian::native == std::endian::little)
+		return v;
+	else
+		return ByteSwap64( v );
+}
+
+#endif
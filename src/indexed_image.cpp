@@ -0,0 +1,53 @@
+#include <atomic>
+
+#include "indexed_image.h"
+#include "bmp.h"
+#include "parallel.h"
+
+bool write_bmp_images( const std::vector<ImageFile_t>& files, std::string& error, uint32_t num_threads )
+{
+	std::atomic<uint32_t> first_failed = UINT32_MAX;
+
+	//	Encoding and writing a file costs roughly the same per pixel, a 512x512
+	//	texture takes as long as a thousand 16x16 sprite frames.
+	parallel_for_weighted( files.size(),
+		[&]( size_t i )
+		{
+			return (uint64_t)files[i].image.width * files[i].image.height;
+		},
+		[&]( size_t i )
+		{
+			if (CBitMap::Write( files[i].path.string().c_str(), files[i].image ) != EBMPResult::Success)
+			{
+				uint32_t failed = first_failed;
+				while (i < failed && !first_failed.compare_exchange_weak( failed, (uint32_t)i ));
+			}
+		},
+		num_threads );
+
+	if (first_failed != UINT32_MAX)
+	{
+		error = "Couldn't write " + files[first_failed].path.string() + ".";
+		return false;
+	}
+
+	return true;
+}
+
+std::string image_file_name( std::string_view name )
+{
+	//	Model skins are usually named after the BMP they were made from.
+	const auto dot = name.rfind( '.' );
+	if (dot != std::string_view::npos && dot > 0)
+		name = name.substr( 0, dot );
+
+	std::string out( name );
+
+	for (auto& c : out)
+	{
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	}
+
+	return out;
+}
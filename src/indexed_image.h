@@ -0,0 +1,68 @@
+#ifndef INDEXED_IMAGE_H
+#define INDEXED_IMAGE_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+//	Palette contains of 256-color data
+struct ColorData_t
+{
+	uint8_t Red, Green, Blue;
+};
+
+static_assert( sizeof( ColorData_t ) == 3, "ColorData_t has to be 3 bytes long" );
+
+//	An 8-bit palettized image that lives somewhere else: a mip of a decoded
+//	WAD texture, a frame inside a memory mapped sprite, a model skin, ... Every
+//	GoldSrc image format boils down to this, so the writers only deal with it.
+struct IndexedImageView_t
+{
+	std::string name;
+	uint32_t width = 0, height = 0;
+
+	//	width * height palette indices, top to bottom.
+	const uint8_t* pixels = nullptr;
+
+	const ColorData_t* palette = nullptr;
+	uint32_t num_colors = 0;	// At most 256, the rest of the palette is black
+};
+
+//	Same as IndexedImageView_t, owning its data.
+struct IndexedImage_t
+{
+	std::string name;
+	uint32_t width = 0, height = 0;
+
+	std::vector<uint8_t> pixels;
+	std::vector<ColorData_t> palette;
+
+	IndexedImageView_t view() const
+	{
+		return { name, width, height, pixels.data(), palette.data(), (uint32_t)palette.size() };
+	}
+};
+
+//	Index used for transparent pixels in textures whose name starts with '{',
+//	alpha tested sprites and masked model skins.
+#define TRANSPARENT_INDEX	255
+
+struct ImageFile_t
+{
+	std::filesystem::path path;
+	IndexedImageView_t image;
+};
+
+//	Writes every image as an 8-bit BMP, spread over num_threads threads by
+//	size. On failure the error names the first file that couldn't be written.
+bool write_bmp_images( const std::vector<ImageFile_t>& files, std::string& error, uint32_t num_threads = 0 );
+
+//	Turns an image name into something that can be used as a file name: the
+//	extension models put on their skin names is dropped and path separators
+//	are replaced.
+std::string image_file_name( std::string_view name );
+
+#endif
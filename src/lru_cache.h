@@ -0,0 +1,199 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+struct CacheStats_t
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t insertions;
+	uint64_t evictions;
+
+	//	Values that didn't fit into a shard at all.
+	uint64_t rejections;
+
+	uint64_t entries;
+	uint64_t bytes;
+	uint64_t budget;
+};
+
+static_assert( sizeof( CacheStats_t ) == 8 * sizeof( uint64_t ), "CacheStats_t has to be made out of uint64_t only" );
+
+//	LRU cache bounded by the size of the values in bytes rather than by their
+//	count. The keys are spread over several shards, each with its own lock and
+//	an equal part of the budget, so concurrent lookups rarely contend.
+//
+//	Values are handed out as shared pointers, so an evicted value stays alive
+//	for as long as someone still uses it.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class CShardedLruCache
+{
+public:
+	using ValuePtr = std::shared_ptr<const Value>;
+
+	CShardedLruCache( size_t budget_bytes, uint32_t num_shards = 16 ) :
+		m_budget(budget_bytes),
+		m_shards(num_shards ? num_shards : 1)
+	{
+		for (auto& shard : m_shards)
+			shard.budget = m_budget / m_shards.size();
+	}
+
+	CShardedLruCache( const CShardedLruCache& ) = delete;
+	CShardedLruCache& operator=( const CShardedLruCache& ) = delete;
+
+	ValuePtr get( const Key& key )
+	{
+		auto& shard = shard_for( key );
+		std::lock_guard<std::mutex> lock( shard.mutex );
+
+		const auto it = shard.map.find( key );
+		if (it == shard.map.end())
+		{
+			m_misses++;
+			return nullptr;
+		}
+
+		m_hits++;
+		shard.lru.splice( shard.lru.begin(), shard.lru, it->second );
+		return it->second->value;
+	}
+
+	//	Inserts the value unless the key is already there. Returns the value
+	//	that is in the cache for the key afterwards.
+	ValuePtr put( const Key& key, ValuePtr value, size_t bytes )
+	{
+		auto& shard = shard_for( key );
+
+		if (bytes > shard.budget)
+		{
+			m_rejections++;
+			return value;
+		}
+
+		std::lock_guard<std::mutex> lock( shard.mutex );
+
+		//	Someone else could've inserted it in the meantime.
+		const auto it = shard.map.find( key );
+		if (it != shard.map.end())
+			return it->second->value;
+
+		shard.lru.push_front( { key, std::move( value ), bytes } );
+		shard.map.emplace( key, shard.lru.begin() );
+		shard.bytes += bytes;
+		m_insertions++;
+
+		while (shard.bytes > shard.budget)
+		{
+			auto& victim = shard.lru.back();
+
+			shard.bytes -= victim.bytes;
+			shard.map.erase( victim.key );
+			shard.lru.pop_back();
+			m_evictions++;
+		}
+
+		return shard.lru.front().value;
+	}
+
+	void erase( const Key& key )
+	{
+		auto& shard = shard_for( key );
+		std::lock_guard<std::mutex> lock( shard.mutex );
+
+		const auto it = shard.map.find( key );
+		if (it == shard.map.end())
+			return;
+
+		shard.bytes -= it->second->bytes;
+		shard.lru.erase( it->second );
+		shard.map.erase( it );
+	}
+
+	void clear()
+	{
+		for (auto& shard : m_shards)
+		{
+			std::lock_guard<std::mutex> lock( shard.mutex );
+
+			shard.map.clear();
+			shard.lru.clear();
+			shard.bytes = 0;
+		}
+	}
+
+	CacheStats_t stats() const
+	{
+		CacheStats_t stats = {};
+		stats.hits = m_hits;
+		stats.misses = m_misses;
+		stats.insertions = m_insertions;
+		stats.evictions = m_evictions;
+		stats.rejections = m_rejections;
+		stats.budget = m_budget;
+
+		for (auto& shard : m_shards)
+		{
+			std::lock_guard<std::mutex> lock( shard.mutex );
+
+			stats.entries += shard.map.size();
+			stats.bytes += shard.bytes;
+		}
+
+		return stats;
+	}
+
+	size_t budget() const { return m_budget; }
+
+private:
+	struct Entry_t
+	{
+		Key key;
+		ValuePtr value;
+		size_t bytes;
+	};
+
+	struct Shard_t
+	{
+		mutable std::mutex mutex;
+
+		//	Most recently used at the front.
+		std::list<Entry_t> lru;
+		std::unordered_map<Key, typename std::list<Entry_t>::iterator, Hash> map;
+
+		size_t bytes = 0;
+		size_t budget = 0;
+	};
+
+	Shard_t& shard_for( const Key& key )
+	{
+		//	Mix the hash a bit, std::hash is the identity for integers.
+		uint64_t h = (uint64_t)Hash{}( key );
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+
+		return m_shards[h % m_shards.size()];
+	}
+
+private:
+	size_t m_budget;
+	std::vector<Shard_t> m_shards;
+
+	std::atomic<uint64_t> m_hits = 0;
+	std::atomic<uint64_t> m_misses = 0;
+	std::atomic<uint64_t> m_insertions = 0;
+	std::atomic<uint64_t> m_evictions = 0;
+	std::atomic<uint64_t> m_rejections = 0;
+};
+
+#endif
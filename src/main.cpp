@@ -1,112 +1,954 @@
 ﻿#include <iostream>
 #include <filesystem>
 #include <fstream>
-
-#include <windows.h>
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
 
 #include "wad.h"
+#include "wad_server.h"
+#include "wad_editor.h"
+#include "mipgen.h"
+#include "bmp.h"
 #include "argparser.h"
+#include "bench.h"
+#include "texture_index.h"
+#include "perceptual_hash.h"
+#include "texture_analysis.h"
+#include "wad_repair.h"
+#include "wad_writer.h"
+#include "map_resolver.h"
+#include "wad_packer.h"
+#include "wad_compression.h"
+#include "palette_transform.h"
+#include "bsp.h"
+#include "sprite.h"
+#include "model.h"
+#include "metrics.h"
 
-void display_help()
+void display_option( Options opt, bool required = false )
+{
+	const auto& option = g_OptionList[opt];
+	const auto names = option.m_short_name.empty() ? option.m_name : option.m_short_name + ", " + option.m_name;
+
+	printf( "  %-20s %-28s %s%s\n", names.c_str(), option.m_usage.c_str(), option.m_description.c_str(), required ? " (required)" : "" );
+}
+
+//	Lists the commands, or the inputs and options of a single command.
+void display_help( Commands cmd = CmdCount )
 {
 	printf( "\n" );
 	printf( "--- Help ---\n" );
-	printf( "Name usage description\n" );
-	printf( "---------------------------\n" );
 
-	for (int32_t i = 0; i < ArgCount; i++)
+	if (cmd == CmdCount)
 	{
-		const auto arg = &g_ArgumentList[i];
-		printf( "%-20s %-30s %s\n", arg->m_name.c_str(), arg->m_usage.c_str(), arg->m_description.c_str() );
+		printf( "Usage: wadwalk <command> [options] <inputs>\n" );
+		printf( "---------------------------\n" );
+
+		for (int32_t i = 0; i < CmdCount; i++)
+		{
+			const auto& command = g_CommandList[i];
+			printf( "  %-12s %-28s %s\n", command.m_name.c_str(), command.m_usage.c_str(), command.m_description.c_str() );
+		}
+
+		printf( "\n" );
+		printf( "Options of every command:\n" );
 	}
+	else
+	{
+		const auto& command = g_CommandList[cmd];
+
+		printf( "Usage: wadwalk %s [options]%s%s\n", command.m_name.c_str(), command.m_usage.empty() ? "" : " ", command.m_usage.c_str() );
+		printf( "%s\n", command.m_description.c_str() );
+		printf( "---------------------------\n" );
+
+		for (const auto opt : command.m_options)
+			display_option( opt, std::find( command.m_required.begin(), command.m_required.end(), opt ) != command.m_required.end() );
+
+		if (!command.m_options.empty())
+			printf( "\n" );
+	}
+
+	for (const auto opt : { OptHelp, OptThreads, OptMetrics, OptTrace })
+		display_option( opt );
 
 	printf( "\n" );
 }
 
+//	Keeps the console window open when the program was started from the explorer.
 void hang()
 {
+#ifdef _WIN32
 	printf( "Press any key to continue..." );
 	std::cin.get();
+#endif
 }
 
-int main( int argc, char** argv )
+//	Returns the path itself for a file, or all of the files with one of the
+//	extensions inside a directory.
+std::vector<std::filesystem::path> collect_files( const std::filesystem::path& path, std::initializer_list<std::string_view> extensions = { ".wad" } )
+{
+	std::vector<std::filesystem::path> files;
+
+	if (!std::filesystem::is_directory( path ))
+	{
+		files.push_back( path );
+		return files;
+	}
+
+	for (const auto& entry : std::filesystem::directory_iterator( path ))
+	{
+		auto ext = entry.path().extension().string();
+		std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+
+		if (entry.is_regular_file() && std::find( extensions.begin(), extensions.end(), ext ) != extensions.end())
+			files.push_back( entry.path() );
+	}
+
+	//	Keep the order stable, it decides which WAD wins on duplicates.
+	std::sort( files.begin(), files.end() );
+
+	return files;
+}
+
+//	Every input expanded with collect_files(), in the order they were given.
+std::vector<std::filesystem::path> collect_inputs( const std::vector<std::string>& inputs, std::initializer_list<std::string_view> extensions = { ".wad" } )
 {
-	CArgumentParser parser( argc, argv );
+	std::vector<std::filesystem::path> files;
 
-	if (!parser.parse())
+	for (const auto& input : inputs)
 	{
-		printf( "Error: Couldn't parse arguments.\n" );
-		display_help();
-		hang();
+		for (auto& file : collect_files( input, extensions ))
+			files.push_back( std::move( file ) );
+	}
+
+	return files;
+}
+
+//	Loads an 8-bit BMP as a texture named after the file and generates its mips.
+bool load_bmp_texture( const std::filesystem::path& path, TextureData_t& tex )
+{
+	IndexedImage_t image;
+
+	if (CBitMap::Read( path.string().c_str(), image ) != EBMPResult::Success)
+		return false;
+
+	const uint32_t width = image.width;
+	const uint32_t height = image.height;
+
+	tex.name = path.stem().string();
+	tex.width = width;
+	tex.height = height;
+	tex.pixel_data[0] = std::move( image.pixels );
+
+	tex.m_palette_colors = (uint16_t)image.palette.size();
+	tex.m_palette_data = std::move( image.palette );
+
+	if (tex.name.empty() || tex.name.size() >= sizeof( MipTexture_t::name ))
+	{
+		printf( "Error: Texture name has to be 1 to 15 characters long. (%s)\n", tex.name.c_str() );
+		return false;
+	}
+
+	//	Every mip has to have whole pixels.
+	if (width % 16 || height % 16)
+	{
+		printf( "Error: Texture dimensions have to be multiples of 16. (%dx%d)\n", width, height );
+		return false;
+	}
+
+	return generate_mips( tex );
+}
+
+int edit( const std::filesystem::path& path, const std::vector<std::string>& add, const std::vector<std::string>& remove, bool compact )
+{
+	if (add.empty() && remove.empty() && !compact)
+	{
+		printf( "Error: Nothing to do, use --add, --delete or --compact.\n" );
 		return 1;
 	}
 
-	if (!g_ArgumentList[ArgFile].m_exists)
+	CWadEditor editor( path );
+
+	if (!editor.open())
 	{
-		printf("Error: No input file.\n");
-		display_help();
-		hang();
+		printf( "Error: %s\n", editor.error().c_str() );
 		return 1;
 	}
 
-	auto path = std::filesystem::path( g_ArgumentList[ArgFile].m_value );
-	auto basepath = std::filesystem::path( argv[0] ).parent_path();
+	for (const auto& bmp : add)
+	{
+		TextureData_t tex;
+		if (!load_bmp_texture( bmp, tex ) || !editor.put_texture( tex ))
+		{
+			printf( "Error: Couldn't add texture. %s\n", editor.error().c_str() );
+			return 1;
+		}
+
+		printf( "Added %s (%dx%d)\n", tex.name.c_str(), tex.width, tex.height );
+	}
+
+	for (const auto& name : remove)
+	{
+		if (!editor.delete_lump( name ))
+		{
+			printf( "Error: %s\n", editor.error().c_str() );
+			return 1;
+		}
 
-	if (std::filesystem::is_directory( path ))
+		printf( "Deleted %s\n", name.c_str() );
+	}
+
+	if (!editor.commit() || (compact && !editor.compact()))
 	{
-		printf( "Error: Can't process a directory. Input a valid file with an valid WAD extension.\n" );
-		hang();
+		printf( "Error: %s\n", editor.error().c_str() );
 		return 1;
 	}
 
-	printf( "Processing file:\n" );
-	wprintf( L"%s\n", path.wstring().c_str() );
-	printf( "\n" );
+	printf( "%d lumps, %0.3f KiB in total, %0.3f KiB of dead space\n",
+			(uint32_t)editor.lumps().size(), editor.file_size() / 1024.f, editor.dead_bytes() / 1024.f );
+
+	return 0;
+}
+
+int search( const std::vector<std::filesystem::path>& files, const std::string& mode_name, const std::string& query )
+{
+	//	The parser only lets the known names through.
+	ESearchMode mode = ESearchMode::Prefix;
+	for (uint32_t i = 0; i < (uint32_t)ESearchMode::SearchModeCount; i++)
+	{
+		if (mode_name == CTextureIndex::str_for_mode( (ESearchMode)i ))
+			mode = (ESearchMode)i;
+	}
+
+	CTextureIndex index;
+
+	for (uint32_t i = 0; i < (uint32_t)files.size(); i++)
+	{
+		CWadFile wad( files[i] );
+		wad.set_memory_mapped( true );
+
+		if (!wad.open())
+		{
+			printf( "Error: %s: %s\n", files[i].string().c_str(), wad.error().c_str() );
+			return 1;
+		}
+
+		index.add_wad( wad, i );
+	}
+
+	index.build();
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto results = index.search( query, mode );
+	const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+	for (const auto ref : results)
+		printf( "%-16s %s\n", ref->name.c_str(), files[ref->wad_index].filename().string().c_str() );
+
+	printf( "%d of %d textures matched in %0.1f us\n", (uint32_t)results.size(), (uint32_t)index.entries().size(), elapsed.count() );
+
+	return 0;
+}
+
+int similar( const std::vector<std::filesystem::path>& files, const std::string& name, uint32_t max_distance, uint32_t num_threads )
+{
+	std::vector<TextureHash_t> hashes;
+
+	for (uint32_t i = 0; i < (uint32_t)files.size(); i++)
+	{
+		CWadFile wad( files[i] );
+		wad.set_memory_mapped( true );
+
+		if (!wad.open())
+		{
+			printf( "Error: %s: %s\n", files[i].string().c_str(), wad.error().c_str() );
+			return 1;
+		}
+
+		hash_wad_textures( wad, i, hashes, num_threads );
+	}
+
+	CHashIndex index;
+	for (uint32_t i = 0; i < (uint32_t)hashes.size(); i++)
+		index.add( hashes[i].hash, i );
+
+	uint32_t num_matches = 0;
+
+	for (uint32_t i = 0; i < (uint32_t)hashes.size(); i++)
+	{
+		const auto& tex = hashes[i];
+
+		//	Without a name every texture is compared against the others.
+		if (!name.empty() && !CWadFile::names_equal( tex.name, name ))
+			continue;
+
+		for (const auto& match : index.find( tex.hash, max_distance ))
+		{
+			//	List every pair once.
+			if (match.id == i || (name.empty() && match.id < i))
+				continue;
+
+			const auto& other = hashes[match.id];
+
+			printf( "%-16s %-16s %2d bits  %s, %s\n", tex.name.c_str(), other.name.c_str(), match.distance,
+					files[tex.wad_index].filename().string().c_str(), files[other.wad_index].filename().string().c_str() );
+
+			num_matches++;
+		}
+	}
+
+	printf( "%d matches among %d textures\n", num_matches, (uint32_t)hashes.size() );
+
+	return 0;
+}
+
+int analyze( const std::vector<std::filesystem::path>& files, const std::filesystem::path& json_path, uint32_t num_threads )
+{
+	std::vector<std::unique_ptr<CWadFile>> wads;
+	std::vector<const CWadFile*> wadptrs;
+
+	for (const auto& file : files)
+	{
+		auto wad = std::make_unique<CWadFile>( file );
+		wad->set_memory_mapped( true );
+
+		if (!wad->open())
+		{
+			printf( "Error: %s: %s\n", file.string().c_str(), wad->error().c_str() );
+			return 1;
+		}
+
+		wadptrs.push_back( wad.get() );
+		wads.push_back( std::move( wad ) );
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<TextureStats_t> stats;
+	analyze_wad_textures( wadptrs, stats, num_threads );
+
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	const auto pfile = fopen( json_path.string().c_str(), "wb" );
+	if (!pfile)
+	{
+		printf( "Error: Couldn't open %s for writing.\n", json_path.string().c_str() );
+		return 1;
+	}
+
+	uint32_t inconsistent = 0, not_pow2 = 0;
+
+	fprintf( pfile, "[\n" );
+
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		const auto& s = stats[i];
+		const auto json = stats_to_json( s );
+
+		//	Splice the WAD path in front of the other fields.
+		fprintf( pfile, "{\"wad\":\"%s\",%s%s\n", json_escape( files[s.wad_index].string() ).c_str(), json.c_str() + 1, i + 1 < stats.size() ? "," : "" );
+
+		inconsistent += !s.mips_consistent;
+		not_pow2 += !s.power_of_two;
+	}
+
+	fprintf( pfile, "]\n" );
+	fclose( pfile );
+
+	printf( "Analyzed %d textures from %d WAD files in %0.2f ms\n", (uint32_t)stats.size(), (uint32_t)files.size(), elapsed.count() );
+	printf( "%d with inconsistent mips, %d not power of two\n", inconsistent, not_pow2 );
+
+	return 0;
+}
+
+int verify( const std::vector<std::filesystem::path>& files, const std::filesystem::path& repair_path, float tolerance, uint32_t num_threads )
+{
+	if (!repair_path.empty() && files.size() != 1)
+	{
+		printf( "Error: repair takes a single WAD file.\n" );
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<CWadFile>> wads;
+	std::vector<const CWadFile*> wadptrs;
+
+	for (const auto& file : files)
+	{
+		auto wad = std::make_unique<CWadFile>( file );
+		wad->set_memory_mapped( true );
+
+		if (!wad->open())
+		{
+			printf( "Error: %s: %s\n", file.string().c_str(), wad->error().c_str() );
+			return 1;
+		}
+
+		wadptrs.push_back( wad.get() );
+		wads.push_back( std::move( wad ) );
+	}
+
+	CWadRepair repair( tolerance );
+	repair.set_num_threads( num_threads );
 
-	if (!std::filesystem::exists( path ))
+	const auto start = std::chrono::steady_clock::now();
+	const auto broken = repair.verify( wadptrs );
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	for (const auto& s : broken)
 	{
-		//	Search within executable directory
-		path = basepath.string() + "\\" + path.filename().string();
-		if (!std::filesystem::exists( path ))
+		printf( "%-16s %s  mip error %0.1f %0.1f %0.1f, transparency mismatches %d %d %d\n", s.name.c_str(), files[s.wad_index].filename().string().c_str(),
+				s.mip_error[1], s.mip_error[2], s.mip_error[3],
+				s.mip_transparency_mismatches[1], s.mip_transparency_mismatches[2], s.mip_transparency_mismatches[3] );
+	}
+
+	printf( "%d of %d textures have mismatching mips (tolerance %0.1f), checked in %0.2f ms\n",
+			(uint32_t)broken.size(), repair.num_checked(), tolerance, elapsed.count() );
+
+	if (repair_path.empty())
+		return broken.empty() ? 0 : 1;
+
+	if (!repair.repair( *wadptrs[0], broken, repair_path ))
+	{
+		printf( "Error: %s\n", repair.error().c_str() );
+		return 1;
+	}
+
+	printf( "Wrote %s with %d textures repaired\n", repair_path.string().c_str(), (uint32_t)broken.size() );
+
+	return 0;
+}
+
+int resolve( const std::vector<std::filesystem::path>& wad_files, const std::vector<std::filesystem::path>& maps, uint32_t num_threads )
+{
+	CMapResolver resolver;
+
+	for (const auto& file : wad_files)
+	{
+		if (!resolver.add_wad( file ))
 		{
-			printf( "Error: File don't exist.\n" );
-			wprintf( L"%s\n", path.c_str() );
+			printf( "Error: %s\n", resolver.error().c_str() );
 			return 1;
 		}
 	}
 
+	resolver.build();
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto reports = resolver.resolve_all( maps, num_threads );
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	uint32_t incomplete = 0;
+
+	for (const auto& report : reports)
+	{
+		const auto name = report.path.filename().string();
+
+		if (!report.ok)
+		{
+			printf( "%s: Error: %s\n", name.c_str(), report.error.c_str() );
+			incomplete++;
+			continue;
+		}
+
+		printf( "%s: %d textures, %d embedded, %d from WADs, %d from unlisted WADs, %d missing\n", name.c_str(), (uint32_t)report.textures.size(),
+				report.count( ETextureSource::Embedded ), report.count( ETextureSource::Wad ), report.count( ETextureSource::UnlistedWad ), report.count( ETextureSource::Missing ) );
+
+		for (const auto& wad : report.missing_wads)
+			printf( "  missing wad   %s\n", wad.c_str() );
+
+		for (const auto& tex : report.textures)
+		{
+			if (tex.source == ETextureSource::Missing)
+				printf( "  missing       %s\n", tex.name.c_str() );
+			else if (tex.source == ETextureSource::UnlistedWad)
+				printf( "  unlisted wad  %-16s %s\n", tex.name.c_str(), resolver.wads()[tex.wad_index].c_str() );
+		}
+
+		if (report.count( ETextureSource::Missing ) || report.count( ETextureSource::UnlistedWad ))
+			incomplete++;
+	}
+
+	printf( "%d of %d maps have unresolved textures, resolved in %0.2f ms\n", incomplete, (uint32_t)reports.size(), elapsed.count() );
+
+	return incomplete ? 1 : 0;
+}
+
+int extract( const std::filesystem::path& path, const std::filesystem::path& out )
+{
+	CBspFile bsp( path );
+	if (!bsp.open())
+	{
+		printf( "Error: %s\n", bsp.error().c_str() );
+		return 1;
+	}
+
+	CWadWriter writer;
+
+	//	The miptex bytes are copied as they are, nothing is decoded. Textures
+	//	whose name doesn't fit a lump directory entry are left out.
+	for (const auto& tex : bsp.textures())
+	{
+		if (tex.miptex && !writer.add_lump_ref( tex.name, LUMP_TYPE_TEXTURE, tex.miptex, tex.miptex_size ))
+			printf( "Warning: %s, skipped.\n", writer.error().c_str() );
+	}
+
+	if (!writer.num_lumps())
+	{
+		printf( "Error: The map has no embedded textures.\n" );
+		return 1;
+	}
+
+	if (!writer.write( out ))
+	{
+		printf( "Error: %s\n", writer.error().c_str() );
+		return 1;
+	}
+
+	printf( "Extracted %d textures into %s\n", (uint32_t)writer.num_lumps(), out.string().c_str() );
+
+	return 0;
+}
+
+int pack( const std::vector<std::filesystem::path>& wad_files, const std::filesystem::path& out, const std::vector<std::string>& inputs, uint32_t num_threads )
+{
+	CWadPacker packer;
+
+	for (const auto& file : wad_files)
+	{
+		if (!packer.add_wad( file ))
+		{
+			printf( "Error: %s\n", packer.error().c_str() );
+			return 1;
+		}
+	}
+
+	packer.build();
+
+	//	Maps, or text files with a texture name on every line.
+	std::vector<std::filesystem::path> maps;
+
+	for (const auto& input : inputs)
+	{
+		auto ext = std::filesystem::path( input ).extension().string();
+		std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+
+		if (std::filesystem::is_directory( input ) || ext == ".bsp")
+		{
+			for (auto& map : collect_files( input, { ".bsp" } ))
+				maps.push_back( std::move( map ) );
+		}
+		else if (!packer.add_name_list( input ))
+		{
+			printf( "Error: %s\n", packer.error().c_str() );
+			return 1;
+		}
+	}
+
+	if ((!maps.empty() && !packer.add_maps( maps, num_threads )) || !packer.write( out ))
+	{
+		printf( "Error: %s\n", packer.error().c_str() );
+		return 1;
+	}
+
+	for (const auto& name : packer.missing())
+		printf( "missing  %s\n", name.c_str() );
+
+	std::error_code ec;
+	printf( "Wrote %d textures into %s (%0.3f KiB), %d missing\n", (uint32_t)packer.num_selected(), out.string().c_str(),
+			std::filesystem::file_size( out, ec ) / 1024.f, (uint32_t)packer.missing().size() );
+
+	return 0;
+}
+
+int merge( const std::vector<std::filesystem::path>& files, const std::filesystem::path& out )
+{
+	CWadPacker packer;
+
+	for (const auto& file : files)
+	{
+		if (!packer.add_wad( file ))
+		{
+			printf( "Error: %s\n", packer.error().c_str() );
+			return 1;
+		}
+	}
+
+	packer.add_all();
+
+	if (!packer.write( out ))
+	{
+		printf( "Error: %s\n", packer.error().c_str() );
+		return 1;
+	}
+
+	std::error_code ec;
+	printf( "Merged %d WAD files into %s, %d lumps (%0.3f KiB)\n", (uint32_t)files.size(), out.string().c_str(),
+			(uint32_t)packer.num_selected(), std::filesystem::file_size( out, ec ) / 1024.f );
+
+	return 0;
+}
+
+int convert( const std::filesystem::path& path, const std::filesystem::path& out, const std::string& compression_name, uint32_t num_threads )
+{
+	//	The parser only lets none and deflate through.
+	const char compression = compression_name == "deflate" ? LUMP_COMPRESSION_DEFLATE : LUMP_COMPRESSION_NONE;
+
 	CWadFile wad( path );
+	wad.set_memory_mapped( true );
 
-	if (!wad.process())
+	if (!wad.open())
 	{
-		printf( "Error: Failed to process WAD file.\n" );
-		hang();
-		return 0;
+		printf( "Error: %s\n", wad.error().c_str() );
+		return 1;
+	}
+
+	std::string error;
+	if (!convert_wad( wad, out, compression, error, num_threads ))
+	{
+		printf( "Error: %s\n", error.c_str() );
+		return 1;
+	}
+
+	std::error_code ec;
+	printf( "Wrote %s, %0.3f KiB -> %0.3f KiB\n", out.string().c_str(), wad.file_size() / 1024.f, std::filesystem::file_size( out, ec ) / 1024.f );
+
+	return 0;
+}
+
+int recolor( const std::filesystem::path& path, const std::filesystem::path& out, float gamma, float brightness, float hue, const std::string& remap, uint32_t num_threads )
+{
+	CPaletteTransform transform( gamma, brightness, hue );
+	transform.set_num_threads( num_threads );
+
+	if (!remap.empty() && !transform.load_remap( remap ))
+	{
+		printf( "Error: %s\n", transform.error().c_str() );
+		return 1;
+	}
+
+	if (transform.is_identity())
+	{
+		printf( "Error: Nothing to do, use --gamma, --brightness, --hue or --remap.\n" );
+		return 1;
+	}
+
+	CWadFile wad( path );
+	wad.set_memory_mapped( true );
+
+	if (!wad.open())
+	{
+		printf( "Error: %s\n", wad.error().c_str() );
+		return 1;
 	}
 
-	if (g_ArgumentList[ArgDump].m_exists)
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	if (!transform.transform_wad( wad, out ))
+	{
+		printf( "Error: %s\n", transform.error().c_str() );
+		return 1;
+	}
+
+	for (const auto& warning : transform.warnings())
+		printf( "Warning: %s\n", warning.c_str() );
+
+	const double duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+		std::chrono::high_resolution_clock::now() - start).count();
+
+	printf( "Wrote %s with %d of %d lumps recolored in %0.4f milliseconds\n", out.string().c_str(),
+			transform.num_transformed(), (uint32_t)wad.lumps().size(), duration );
+
+	return 0;
+}
+
+static CWadServer* g_server = nullptr;
+
+void stop_server( int )
+{
+	if (g_server)
+		g_server->stop();
+}
+
+int serve( const std::vector<std::filesystem::path>& files, const std::filesystem::path& socket_path, size_t cache_budget )
+{
+	CWadServer server( cache_budget );
+	server.set_verbose( true );
+
+	for (const auto& file : files)
+	{
+		if (!server.add_wad( file ))
+			return 1;
+	}
+
+	if (!server.num_wads())
+	{
+		printf( "Error: No WAD files to serve.\n" );
+		return 1;
+	}
+
+	g_server = &server;
+	signal( SIGINT, stop_server );
+	signal( SIGTERM, stop_server );
+
+	const bool ok = server.run( socket_path );
+
+	g_server = nullptr;
+
+	return ok ? 0 : 1;
+}
+
+int info( const std::vector<std::filesystem::path>& files, uint32_t num_threads )
+{
+	for (const auto& file : files)
+	{
+		printf( "Processing file:\n" );
+		printf( "%s\n", file.string().c_str() );
+		printf( "\n" );
+
+		CWadFile wad( file );
+		wad.set_verbose( true );
+		wad.set_num_threads( num_threads );
+
+		if (!wad.process())
+		{
+			printf( "Error: Failed to process WAD file.\n" );
+			return 1;
+		}
+
 		wad.dump_wad_full();
+	}
+
+	return 0;
+}
+
+//	WADs, sprites and models are all read first, the files stay mapped and
+//	their images point into them. Then every image is written in one go, so
+//	the threads are kept busy no matter how the images are spread over the files.
+int export_images( const std::vector<std::filesystem::path>& files, const std::filesystem::path& out, uint32_t miplevel, uint32_t num_threads )
+{
+	if (miplevel < 1 || miplevel > MIPLEVELS)
+	{
+		printf( "Error: Invalid mip level specified (%d). Maximum is %d.\n", miplevel, MIPLEVELS );
+		return 1;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::unique_ptr<CWadFile>> wads;
+	std::vector<std::unique_ptr<CSpriteFile>> sprites;
+	std::vector<std::unique_ptr<CModelFile>> models;
+
+	//	Models with external textures and their T.mdl can both be inputs.
+	std::unordered_set<std::string> texture_files;
+
+	std::vector<ImageFile_t> images;
+
+	for (const auto& file : files)
+	{
+		//	Every file gets its own directory when there are more of them.
+		const auto export_path = files.size() > 1 ? out / file.stem() : out;
+		const size_t first = images.size();
+
+		auto ext = file.extension().string();
+		std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+
+		if (ext == ".spr")
+		{
+			auto& sprite = sprites.emplace_back( std::make_unique<CSpriteFile>( file ) );
+
+			if (!sprite->open())
+			{
+				printf( "Error: Failed to read sprite %s: %s\n", file.string().c_str(), sprite->error().c_str() );
+				return 1;
+			}
+
+			for (const auto& frame : sprite->frames())
+				images.push_back( { export_path / (frame.image.name + ".bmp"), frame.image } );
+		}
+		else if (ext == ".mdl")
+		{
+			auto& model = models.emplace_back( std::make_unique<CModelFile>( file ) );
+
+			if (!model->open())
+			{
+				printf( "Error: Failed to read model %s: %s\n", file.string().c_str(), model->error().c_str() );
+				return 1;
+			}
+
+			if (model->textures().empty() || !texture_files.insert( model->texture_path().lexically_normal().string() ).second)
+				continue;
+
+			for (const auto& texture : model->textures())
+				images.push_back( { export_path / (image_file_name( texture.image.name ) + ".bmp"), texture.image } );
+		}
+		else
+		{
+			auto& wad = wads.emplace_back( std::make_unique<CWadFile>( file ) );
+			wad->set_num_threads( num_threads );
 
-	if (g_ArgumentList[ArgExport].m_exists)
+			if (!wad->process())
+			{
+				printf( "Error: Failed to process WAD file %s.\n", file.string().c_str() );
+				return 1;
+			}
+
+			for (const auto& warning : wad->warnings())
+				printf( "Warning: %s: %s\n", file.string().c_str(), warning.c_str() );
+
+			wad->add_image_files( export_path, miplevel, images );
+		}
+
+		printf( "%s: %d images\n", file.string().c_str(), (uint32_t)(images.size() - first) );
+
+		std::error_code ec;
+		if (images.size() > first)
+			std::filesystem::create_directories( export_path, ec );
+	}
+
+	std::string error;
+	if (!write_bmp_images( images, error, num_threads ))
 	{
-		auto szval = g_ArgumentList[ArgExport].m_value;
-		uint32_t miplevel = 1;
+		printf( "Error: %s\n", error.c_str() );
+		return 1;
+	}
 
-		if (szval.size() && std::isdigit( *szval.begin() ))
-			miplevel = *szval.begin();
+	const double duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+		std::chrono::high_resolution_clock::now() - start).count();
 
-		if (!miplevel)
-			miplevel = 1;
+	printf( "\nExported %d images from %d files into %s in %0.4f milliseconds.\n", (uint32_t)images.size(), (uint32_t)files.size(), out.string().c_str(), duration );
 
-		const auto export_path = basepath.string() + "\\images\\";
+	return 0;
+}
+
+int run( const CArgumentParser& args )
+{
+	const auto& inputs = args.inputs();
+	const uint32_t num_threads = args.get_uint( OptThreads );
 
-		if (!std::filesystem::exists( export_path ))
-			std::filesystem::create_directory( export_path );
+	switch (args.command())
+	{
+		case CmdHelp:
+		{
+			Commands cmd = CmdCount;
+			for (uint32_t i = 0; i < CmdCount && !inputs.empty(); i++)
+			{
+				if (g_CommandList[i].m_name == inputs[0])
+					cmd = (Commands)i;
+			}
+
+			display_help( cmd );
+			return 0;
+		}
+
+		case CmdInfo:
+			return info( collect_inputs( inputs ), num_threads );
+
+		case CmdExport:
+			return export_images( collect_inputs( inputs, { ".wad", ".spr", ".mdl" } ), args.value( OptOut, "images" ), args.get_uint( OptMips, 1 ), num_threads );
+
+		case CmdEdit:
+			return edit( inputs[0], args.values( OptAdd ), args.values( OptDelete ), args.has( OptCompact ) );
+
+		case CmdPack:
+			return pack( collect_inputs( args.values( OptWads ) ), args.value( OptOut ), inputs, num_threads );
+
+		case CmdMerge:
+			return merge( collect_inputs( inputs ), args.value( OptOut ) );
+
+		case CmdServe:
+			return serve( collect_inputs( inputs ), args.value( OptSocket ), args.has( OptCacheSize ) ? (size_t)args.get_uint( OptCacheSize ) * 1024 * 1024 : CWadServer::kDefaultCacheBudget );
+
+		case CmdBench:
+			return run_benchmarks();
+
+		case CmdSearch:
+			return search( collect_inputs( inputs ), args.value( OptMode, "prefix" ), args.value( OptQuery ) );
+
+		case CmdSimilar:
+			return similar( collect_inputs( inputs ), args.value( OptTexture ), args.get_uint( OptDistance, 8 ), num_threads );
+
+		case CmdDuplicates:
+			return similar( collect_inputs( inputs ), "", args.get_uint( OptDistance, 8 ), num_threads );
+
+		case CmdAnalyze:
+			return analyze( collect_inputs( inputs ), args.value( OptOut ), num_threads );
+
+		case CmdVerify:
+			return verify( collect_inputs( inputs ), "", args.get_float( OptTolerance, MAX_MIP_ERROR ), num_threads );
+
+		case CmdRepair:
+			return verify( collect_inputs( inputs ), args.value( OptOut ), args.get_float( OptTolerance, MAX_MIP_ERROR ), num_threads );
+
+		case CmdResolve:
+			return resolve( collect_inputs( args.values( OptWads ) ), collect_inputs( inputs, { ".bsp" } ), num_threads );
+
+		case CmdExtract:
+			return extract( inputs[0], args.value( OptOut ) );
+
+		case CmdConvert:
+			return convert( inputs[0], args.value( OptOut ), args.value( OptCompression ), num_threads );
+
+		case CmdRecolor:
+			return recolor( inputs[0], args.value( OptOut ), args.get_float( OptGamma, 1.f ), args.get_float( OptBrightness, 1.f ), args.get_float( OptHue ), args.value( OptRemap ), num_threads );
+
+		default:
+			return 1;
+	}
+}
+
+int main( int argc, char** argv )
+{
+	CArgumentParser args( argc, argv );
+
+	if (!args.parse())
+	{
+		printf( "Error: %s\n", args.error().c_str() );
+
+		//	Started without arguments, most likely from the explorer.
+		if (argc < 2)
+		{
+			display_help();
+			hang();
+		}
+		else if (args.command() == CmdHelp)
+			printf( "Run \"wadwalk help\" to list the commands.\n" );
+		else
+			printf( "Run \"wadwalk %s --help\" to list its options.\n", g_CommandList[args.command()].m_name.c_str() );
+
+		return 1;
+	}
+
+	if (args.has( OptHelp ))
+	{
+		display_help( args.command() == CmdHelp ? CmdCount : args.command() );
+		return 0;
+	}
+
+	const bool metrics = args.has( OptMetrics );
+	const bool trace = args.has( OptTrace );
+
+	CMetrics::instance().set_mode( (metrics ? MetricsStats : MetricsOff) | (trace ? MetricsTrace : MetricsOff) );
+
+	const int result = run( args );
+
+	if (metrics)
+		CMetrics::instance().print_summary();
+
+	if (trace)
+	{
+		std::string error;
+		if (!CMetrics::instance().write_trace( args.value( OptTrace ), error ))
+		{
+			printf( "Error: %s\n", error.c_str() );
+			return 1;
+		}
 
-		wad.export_images_from_wad( export_path, miplevel );
+		printf( "Trace written to %s\n", args.value( OptTrace ).c_str() );
 	}
 
-	printf( "Success\n" );
-	hang();
-	return 1;
+	return result;
 }
@@ -0,0 +1,130 @@
+#include <algorithm>
+
+#include "map_resolver.h"
+#include "parallel.h"
+#include "bsp.h"
+
+uint32_t MapReport_t::count( ETextureSource source ) const
+{
+	return (uint32_t)std::count_if( textures.begin(), textures.end(), [source]( const ResolvedTexture_t& tex ) { return tex.source == source; } );
+}
+
+bool CMapResolver::add_wad( const std::filesystem::path& path )
+{
+	//	Only the directory is needed.
+	CWadFile wad( path );
+	wad.set_memory_mapped( true );
+
+	if (!wad.open())
+	{
+		m_error = path.string() + ": " + wad.error();
+		return false;
+	}
+
+	add_wad( wad );
+
+	return true;
+}
+
+void CMapResolver::add_wad( const CWadFile& wad )
+{
+	m_index.add_wad( wad, (uint32_t)m_wads.size() );
+	m_wads.push_back( CWadFile::lower_name( wad.path().filename().string() ) );
+}
+
+MapReport_t CMapResolver::resolve( const std::filesystem::path& path ) const
+{
+	MapReport_t report;
+	report.path = path;
+	report.ok = false;
+
+	CBspFile bsp( path );
+	if (!bsp.open())
+	{
+		report.error = bsp.error();
+		return report;
+	}
+
+	//	Search order of the WADs the resolver knows about.
+	std::vector<int32_t> listed;
+	for (const auto& name : bsp.wads())
+	{
+		const auto it = std::find( m_wads.begin(), m_wads.end(), name );
+
+		if (it == m_wads.end())
+			report.missing_wads.push_back( name );
+		else
+			listed.push_back( (int32_t)(it - m_wads.begin()) );
+	}
+
+	for (const auto& tex : bsp.textures())
+	{
+		if (tex.name.empty())
+			continue;
+
+		ResolvedTexture_t resolved = { tex.name, ETextureSource::Missing, -1, 0 };
+
+		if (tex.miptex)
+			resolved.source = ETextureSource::Embedded;
+		else
+		{
+			const auto refs = m_index.find( tex.name );
+
+			for (const int32_t wad_index : listed)
+			{
+				const auto it = std::find_if( refs.begin(), refs.end(), [wad_index]( const TextureRef_t* ref ) { return (int32_t)ref->wad_index == wad_index; } );
+				if (it != refs.end())
+				{
+					resolved.source = ETextureSource::Wad;
+					resolved.wad_index = wad_index;
+					resolved.lump_index = (*it)->lump_index;
+					break;
+				}
+			}
+
+			if (resolved.source == ETextureSource::Missing && !refs.empty())
+			{
+				resolved.source = ETextureSource::UnlistedWad;
+				resolved.wad_index = (int32_t)refs.front()->wad_index;
+				resolved.lump_index = refs.front()->lump_index;
+			}
+		}
+
+		report.textures.push_back( std::move( resolved ) );
+	}
+
+	report.ok = true;
+
+	return report;
+}
+
+std::vector<MapReport_t> CMapResolver::resolve_all( const std::vector<std::filesystem::path>& paths, uint32_t num_threads ) const
+{
+	std::vector<MapReport_t> reports( paths.size() );
+
+	parallel_for( paths.size(), [&]( size_t i )
+	{
+		reports[i] = resolve( paths[i] );
+	}, num_threads );
+
+	return reports;
+}
+
+const char* CMapResolver::str_for_source( ETextureSource source )
+{
+	switch (source)
+	{
+		case ETextureSource::Embedded:
+			return "embedded";
+		case ETextureSource::Wad:
+			return "wad";
+		case ETextureSource::UnlistedWad:
+			return "unlisted wad";
+		case ETextureSource::Missing:
+			return "missing";
+		default:
+			break;
+	}
+
+	return "n/a";
+}
@@ -0,0 +1,84 @@
+#ifndef MAP_RESOLVER_H
+#define MAP_RESOLVER_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "texture_index.h"
+
+enum class ETextureSource : uint32_t
+{
+	//	Inside the BSP file itself.
+	Embedded,
+
+	//	In one of the WAD files the map lists.
+	Wad,
+
+	//	Only in a WAD file the map doesn't list, the engine won't find it.
+	UnlistedWad,
+
+	Missing,
+};
+
+struct ResolvedTexture_t
+{
+	std::string name;
+	ETextureSource source;
+	int32_t wad_index;		// CMapResolver::wads(), -1 for embedded and missing textures
+	uint32_t lump_index;	// CWadFile::lump_index() inside that WAD
+};
+
+struct MapReport_t
+{
+	std::filesystem::path path;
+
+	bool ok;				// False when the map couldn't be read
+	std::string error;
+
+	std::vector<ResolvedTexture_t> textures;
+
+	//	WAD files the map lists that the resolver doesn't know about.
+	std::vector<std::string> missing_wads;
+
+	uint32_t count( ETextureSource source ) const;
+};
+
+//	Tells where every texture of a map comes from. The texture names of all the
+//	WAD files are kept in one CTextureIndex that every lookup shares, so maps
+//	can be resolved in parallel without touching the WAD files again.
+//
+//	The engine only loads the WADs listed in the worldspawn and searches them
+//	in that order, the resolver does the same.
+class CMapResolver
+{
+public:
+	bool add_wad( const std::filesystem::path& path );
+
+	//	Indexes a WAD that is already open, only its directory is used.
+	void add_wad( const CWadFile& wad );
+
+	//	Call once after the WADs are added.
+	void build() { m_index.build(); }
+
+	MapReport_t resolve( const std::filesystem::path& path ) const;
+	std::vector<MapReport_t> resolve_all( const std::vector<std::filesystem::path>& paths, uint32_t num_threads = 0 ) const;
+
+	//	Lower case file names of the added WADs.
+	const std::vector<std::string>& wads() const { return m_wads; }
+	const CTextureIndex& index() const { return m_index; }
+
+	const std::string& error() const { return m_error; }
+
+	static const char* str_for_source( ETextureSource source );
+
+private:
+	std::vector<std::string> m_wads;
+	CTextureIndex m_index;
+
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include <fstream>
+#include <random>
+#include <cstdio>
+#include <cerrno>
+
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#else
+#	include <io.h>
+#	include <fcntl.h>
+#	include <sys/stat.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+	close();
+}
+
+bool CMappedFile::open( const std::filesystem::path& path )
+{
+	close();
+
+#ifndef _WIN32
+	const int fd = ::open( path.c_str(), O_RDONLY );
+	if (fd < 0)
+	{
+		m_error = "Couldn't open input file for reading.";
+		return false;
+	}
+
+	struct stat st;
+	if (fstat( fd, &st ) != 0 || st.st_size <= 0)
+	{
+		::close( fd );
+		m_error = "Invalid filesize.";
+		return false;
+	}
+
+	void* p = mmap( nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+
+	if (p == MAP_FAILED)
+	{
+		m_error = "Couldn't map the file into memory.";
+		return false;
+	}
+
+	m_data = (uint8_t*)p;
+	m_size = (size_t)st.st_size;
+	m_mapped = true;
+#else
+	std::ifstream ifs( path, std::ios_base::in | std::ios_base::binary );
+	if (!ifs.good())
+	{
+		m_error = "Couldn't open input file for reading.";
+		return false;
+	}
+
+	std::error_code ec;
+	const auto filesize = std::filesystem::file_size( path, ec );
+	if (ec || !filesize)
+	{
+		m_error = "Invalid filesize.";
+		return false;
+	}
+
+	m_data = new uint8_t[filesize];
+	m_size = (size_t)filesize;
+
+	ifs.read( (char*)m_data, m_size );
+	if ((size_t)ifs.gcount() != m_size)
+	{
+		close();
+		m_error = "Couldn't read the whole file.";
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+void CMappedFile::close()
+{
+	if (!m_data)
+		return;
+
+#ifndef _WIN32
+	if (m_mapped)
+		munmap( m_data, m_size );
+	else
+		delete[] m_data;
+#else
+	delete[] m_data;
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
+
+bool sync_file( const std::filesystem::path& path )
+{
+#ifndef _WIN32
+	const int fd = ::open( path.c_str(), O_RDWR );
+	if (fd < 0)
+		return false;
+
+	const bool synced = fsync( fd ) == 0;
+	::close( fd );
+#else
+	const int fd = _wopen( path.c_str(), _O_RDWR | _O_BINARY );
+	if (fd < 0)
+		return false;
+
+	const bool synced = _commit( fd ) == 0;
+	_close( fd );
+#endif
+
+	return synced;
+}
+
+bool create_temp_file( const std::filesystem::path& path, std::filesystem::path& tmp_path )
+{
+	std::random_device rd;
+	std::mt19937 rng( rd() );
+
+	//	The file is created exclusively, a name that's taken just gets another try.
+	for (uint32_t attempt = 0; attempt < 64; attempt++)
+	{
+		char suffix[16];
+		snprintf( suffix, sizeof( suffix ), ".%08x.tmp", (uint32_t)rng() );
+
+		tmp_path = path;
+		tmp_path += suffix;
+
+#ifndef _WIN32
+		const int fd = ::open( tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666 );
+		if (fd >= 0)
+		{
+			::close( fd );
+			return true;
+		}
+#else
+		const int fd = _wopen( tmp_path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE );
+		if (fd >= 0)
+		{
+			_close( fd );
+			return true;
+		}
+#endif
+
+		if (errno != EEXIST)
+			break;
+	}
+
+	tmp_path.clear();
+	return false;
+}
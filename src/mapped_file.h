@@ -0,0 +1,48 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <filesystem>
+
+//	Read-only view of a whole file. On POSIX systems the file is memory mapped
+//	privately, so the pages can still be modified in place (e.g. byte swapping
+//	on big endian machines) without touching the file. Elsewhere the file is
+//	read into a heap buffer.
+class CMappedFile
+{
+public:
+	CMappedFile() = default;
+	CMappedFile( const CMappedFile& ) = delete;
+	CMappedFile& operator=( const CMappedFile& ) = delete;
+
+	~CMappedFile();
+
+	bool open( const std::filesystem::path& path );
+	void close();
+
+	uint8_t* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	bool is_open() const { return m_data != nullptr; }
+	const std::string& error() const { return m_error; }
+
+private:
+	uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_mapped = false;
+
+	std::string m_error;
+};
+
+//	Flushes the file's data to the disk, for writes that a later write relies
+//	on to be durable.
+bool sync_file( const std::filesystem::path& path );
+
+//	Creates a new empty file next to path with a name nothing else had, for a
+//	file that's written completely before it's renamed over path.
+bool create_temp_file( const std::filesystem::path& path, std::filesystem::path& tmp_path );
+
+#endif
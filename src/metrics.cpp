@@ -0,0 +1,306 @@
+#include <chrono>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include "metrics.h"
+
+static const auto g_process_start = std::chrono::steady_clock::now();
+
+static thread_local uint64_t t_allocations = 0;
+
+static uint32_t histogram_bucket( uint64_t ns )
+{
+	uint32_t bucket = 0;
+	while (ns > 1 && bucket < METRICS_HISTOGRAM_BUCKETS - 1)
+	{
+		ns >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+uint64_t StageStats_t::percentile_ns( double fraction ) const
+{
+	const uint64_t target = (uint64_t)(fraction * count + 0.5);
+
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram[i];
+
+		if (seen && seen >= target)
+			return std::min<uint64_t>( (2ull << i) - 1, max_ns );
+	}
+
+	return max_ns;
+}
+
+CMetrics& CMetrics::instance()
+{
+	static CMetrics metrics;
+	return metrics;
+}
+
+MetricsStage_t& CMetrics::stage( const char* name )
+{
+	std::lock_guard lock( m_mutex );
+
+	for (auto& stage : m_stages)
+	{
+		if (!strcmp( stage.name, name ))
+			return stage;
+	}
+
+	return m_stages.emplace_back( name, m_mode );
+}
+
+void CMetrics::record( MetricsStage_t& stage, uint64_t start_ns, uint64_t duration_ns, uint64_t bytes, uint64_t allocations )
+{
+	const uint32_t mode = m_mode.load( std::memory_order_relaxed );
+
+	if (mode & MetricsStats)
+	{
+		stage.count.fetch_add( 1, std::memory_order_relaxed );
+		stage.total_ns.fetch_add( duration_ns, std::memory_order_relaxed );
+		stage.bytes.fetch_add( bytes, std::memory_order_relaxed );
+		stage.allocations.fetch_add( allocations, std::memory_order_relaxed );
+		stage.histogram[histogram_bucket( duration_ns )].fetch_add( 1, std::memory_order_relaxed );
+
+		uint64_t min = stage.min_ns.load( std::memory_order_relaxed );
+		while (duration_ns < min && !stage.min_ns.compare_exchange_weak( min, duration_ns, std::memory_order_relaxed ));
+
+		uint64_t max = stage.max_ns.load( std::memory_order_relaxed );
+		while (duration_ns > max && !stage.max_ns.compare_exchange_weak( max, duration_ns, std::memory_order_relaxed ));
+	}
+
+	if (mode & MetricsTrace)
+	{
+		auto& buffer = thread_buffer();
+
+		if (buffer.events.size() < METRICS_MAX_TRACE_EVENTS)
+			buffer.events.push_back( { &stage, start_ns, duration_ns, bytes } );
+		else
+			m_dropped_events.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+std::vector<StageStats_t> CMetrics::snapshot() const
+{
+	std::vector<StageStats_t> out;
+
+	std::lock_guard lock( m_mutex );
+
+	for (const auto& stage : m_stages)
+	{
+		if (!stage.count)
+			continue;
+
+		StageStats_t stats;
+		stats.name = stage.name;
+		stats.count = stage.count;
+		stats.total_ns = stage.total_ns;
+		stats.min_ns = stage.min_ns;
+		stats.max_ns = stage.max_ns;
+		stats.bytes = stage.bytes;
+		stats.allocations = stage.allocations;
+
+		for (uint32_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+			stats.histogram[i] = stage.histogram[i];
+
+		out.push_back( stats );
+	}
+
+	std::sort( out.begin(), out.end(), []( const StageStats_t& a, const StageStats_t& b ) { return a.total_ns > b.total_ns; } );
+
+	return out;
+}
+
+void CMetrics::reset()
+{
+	std::lock_guard lock( m_mutex );
+
+	for (auto& stage : m_stages)
+	{
+		stage.count = 0;
+		stage.total_ns = 0;
+		stage.min_ns = UINT64_MAX;
+		stage.max_ns = 0;
+		stage.bytes = 0;
+		stage.allocations = 0;
+
+		for (auto& bucket : stage.histogram)
+			bucket = 0;
+	}
+
+	for (auto& buffer : m_buffers)
+		buffer->events.clear();
+
+	m_dropped_events = 0;
+}
+
+void CMetrics::print_summary( FILE* out ) const
+{
+	const auto stages = snapshot();
+
+	fprintf( out, "\n" );
+	fprintf( out, " Metrics:\n" );
+	fprintf( out, "\n" );
+	fprintf( out, "Stage                    Calls      Total (ms)  Mean (us)   p50 (us)   p99 (us)   Max (us)   MiB        MiB/s      Allocs\n" );
+
+	for (const auto& stage : stages)
+	{
+		const double mib = stage.bytes / (1024.0 * 1024.0);
+		const double seconds = stage.total_ns / 1e9;
+
+		fprintf( out, "%-24s %-10llu %-11.3f %-11.2f %-10.2f %-10.2f %-10.2f %-10.3f %-10.1f %llu\n",
+			stage.name.c_str(),
+			(unsigned long long)stage.count,
+			stage.total_ns / 1e6,
+			stage.total_ns / 1e3 / stage.count,
+			stage.percentile_ns( 0.5 ) / 1e3,
+			stage.percentile_ns( 0.99 ) / 1e3,
+			stage.max_ns / 1e3,
+			mib,
+			stage.bytes && seconds > 0 ? mib / seconds : 0.0,
+			(unsigned long long)stage.allocations );
+	}
+
+	//	The histograms, one row per stage, buckets from 1 us up.
+	fprintf( out, "\n" );
+	fprintf( out, "Duration histogram, calls per bucket: <2 us, 2-4 us, 4-8 us, ...\n" );
+
+	for (const auto& stage : stages)
+	{
+		fprintf( out, "%-24s", stage.name.c_str() );
+
+		uint64_t below = 0;
+		for (uint32_t i = 0; i <= 10; i++)
+			below += stage.histogram[i];
+
+		uint32_t last = 10;
+		for (uint32_t i = 11; i < METRICS_HISTOGRAM_BUCKETS; i++)
+		{
+			if (stage.histogram[i])
+				last = i;
+		}
+
+		fprintf( out, " %llu", (unsigned long long)below );
+		for (uint32_t i = 11; i <= last; i++)
+			fprintf( out, " %llu", (unsigned long long)stage.histogram[i] );
+
+		fprintf( out, "\n" );
+	}
+
+	if (m_dropped_events)
+		fprintf( out, "\n%llu trace events were dropped\n", (unsigned long long)m_dropped_events );
+
+	fprintf( out, "\n" );
+}
+
+bool CMetrics::write_trace( const std::filesystem::path& path, std::string& error ) const
+{
+	std::ofstream ofs( path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+
+	if (!ofs.good())
+	{
+		error = "Couldn't open " + path.string() + " for writing.";
+		return false;
+	}
+
+	//	Complete events, the timestamps are in microseconds.
+	ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	char line[256];
+	bool first = true;
+
+	std::lock_guard lock( m_mutex );
+
+	for (const auto& buffer : m_buffers)
+	{
+		snprintf( line, sizeof( line ), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			first ? "" : ",\n", buffer->tid, buffer->tid );
+		ofs << line;
+		first = false;
+
+		for (const auto& event : buffer->events)
+		{
+			snprintf( line, sizeof( line ), ",\n{\"name\":\"%s\",\"cat\":\"wad\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%llu}}",
+				event.stage->name, buffer->tid, event.start_ns / 1e3, event.duration_ns / 1e3, (unsigned long long)event.bytes );
+			ofs << line;
+		}
+	}
+
+	ofs << "\n]}\n";
+
+	if (!ofs.good())
+	{
+		error = "Couldn't write " + path.string() + ".";
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t CMetrics::now_ns()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - g_process_start ).count();
+}
+
+void CMetrics::count_allocation()
+{
+	t_allocations++;
+}
+
+uint64_t CMetrics::thread_allocations()
+{
+	return t_allocations;
+}
+
+CMetrics::ThreadBuffer_t& CMetrics::thread_buffer()
+{
+	//	The buffers are owned by m_buffers, so the events outlive the thread.
+	//	When a thread exits its buffer is handed to the next new one, there
+	//	are only as many buffers as threads that ever recorded at once.
+	struct Lease_t
+	{
+		ThreadBuffer_t* buffer = nullptr;
+
+		~Lease_t()
+		{
+			if (buffer)
+				CMetrics::instance().release_buffer( buffer );
+		}
+	};
+
+	static thread_local Lease_t t_lease;
+
+	if (!t_lease.buffer)
+	{
+		std::lock_guard lock( m_mutex );
+
+		if (!m_free_buffers.empty())
+		{
+			t_lease.buffer = m_free_buffers.back();
+			m_free_buffers.pop_back();
+		}
+		else
+		{
+			//	Numbered in the order they're first needed, threads that
+			//	reuse a buffer show up in the trace as the same one.
+			auto& buffer = m_buffers.emplace_back( std::make_unique<ThreadBuffer_t>() );
+			buffer->tid = (uint32_t)m_buffers.size() - 1;
+
+			t_lease.buffer = buffer.get();
+		}
+	}
+
+	return *t_lease.buffer;
+}
+
+void CMetrics::release_buffer( ThreadBuffer_t* buffer )
+{
+	std::lock_guard lock( m_mutex );
+	m_free_buffers.push_back( buffer );
+}
@@ -0,0 +1,201 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+
+//	Durations are put into power of two buckets, bucket n holds [2^n, 2^(n+1)) ns.
+#define METRICS_HISTOGRAM_BUCKETS	40
+
+//	Trace events kept per thread, the rest is dropped and counted.
+#define METRICS_MAX_TRACE_EVENTS	(1 << 20)
+
+enum EMetricsMode : uint32_t
+{
+	MetricsOff = 0,
+
+	//	Per-stage counters and histograms.
+	MetricsStats = 1 << 0,
+
+	//	Every timed scope is also recorded as a Chrome trace event.
+	MetricsTrace = 1 << 1,
+};
+
+//	Counters of a single stage. Updated from any thread without locking.
+struct MetricsStage_t
+{
+	MetricsStage_t( const char* name, const std::atomic<uint32_t>& mode ) :
+		name(name),
+		mode(mode)
+	{}
+
+	const char* name;
+	const std::atomic<uint32_t>& mode;
+
+	std::atomic<uint64_t> count = 0;
+	std::atomic<uint64_t> total_ns = 0;
+	std::atomic<uint64_t> min_ns = UINT64_MAX;
+	std::atomic<uint64_t> max_ns = 0;
+	std::atomic<uint64_t> bytes = 0;
+	std::atomic<uint64_t> allocations = 0;
+
+	std::atomic<uint64_t> histogram[METRICS_HISTOGRAM_BUCKETS] = {};
+};
+
+//	Plain copy of MetricsStage_t.
+struct StageStats_t
+{
+	std::string name;
+
+	uint64_t count;
+	uint64_t total_ns, min_ns, max_ns;
+	uint64_t bytes;
+	uint64_t allocations;
+
+	uint64_t histogram[METRICS_HISTOGRAM_BUCKETS];
+
+	//	Upper bound of the bucket the given fraction of the calls falls into.
+	uint64_t percentile_ns( double fraction ) const;
+};
+
+//	Process wide registry of the instrumented stages. Collection is off until
+//	set_mode() turns it on, until then a timed scope costs a relaxed atomic
+//	load. Building with WAD_NO_METRICS removes the timers altogether.
+//
+//	Heap allocations are only counted when the program routes them through
+//	count_allocation(), see alloc_counter.cpp (WAD_COUNT_ALLOCATIONS).
+class CMetrics
+{
+public:
+	static CMetrics& instance();
+
+	void set_mode( uint32_t mode ) { m_mode = mode; }
+	uint32_t mode() const { return m_mode; }
+
+	//	Returns the stage with the given name, creating it on the first call.
+	//	The reference stays valid for the lifetime of the process.
+	MetricsStage_t& stage( const char* name );
+
+	void record( MetricsStage_t& stage, uint64_t start_ns, uint64_t duration_ns, uint64_t bytes, uint64_t allocations );
+
+	//	Stages that were hit at least once, sorted by the total time.
+	std::vector<StageStats_t> snapshot() const;
+
+	void reset();
+
+	void print_summary( FILE* out = stdout ) const;
+
+	//	Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Call it once the
+	//	instrumented work is done, the per-thread buffers aren't locked.
+	bool write_trace( const std::filesystem::path& path, std::string& error ) const;
+
+	uint64_t dropped_events() const { return m_dropped_events; }
+
+	//	Monotonic nanoseconds since the start of the process.
+	static uint64_t now_ns();
+
+	static void count_allocation();
+	static uint64_t thread_allocations();
+
+private:
+	struct TraceEvent_t
+	{
+		const MetricsStage_t* stage;
+		uint64_t start_ns, duration_ns;
+		uint64_t bytes;
+	};
+
+	struct ThreadBuffer_t
+	{
+		uint32_t tid;
+		std::vector<TraceEvent_t> events;
+	};
+
+	ThreadBuffer_t& thread_buffer();
+	void release_buffer( ThreadBuffer_t* buffer );
+
+private:
+	std::atomic<uint32_t> m_mode = MetricsOff;
+
+	mutable std::mutex m_mutex;
+	std::deque<MetricsStage_t> m_stages;
+	std::vector<std::unique_ptr<ThreadBuffer_t>> m_buffers;
+	std::vector<ThreadBuffer_t*> m_free_buffers;	// Of threads that exited
+
+	std::atomic<uint64_t> m_dropped_events = 0;
+};
+
+#ifndef WAD_NO_METRICS
+
+//	Times the enclosing scope. Bytes processed by the stage can be added
+//	while it runs, they're reported as throughput.
+class CScopedTimer
+{
+public:
+	CScopedTimer( MetricsStage_t& stage ) :
+		m_stage(stage)
+	{
+		if (m_stage.mode.load( std::memory_order_relaxed ) != MetricsOff)
+		{
+			m_active = true;
+			m_allocations = CMetrics::thread_allocations();
+			m_start = CMetrics::now_ns();
+		}
+	}
+
+	~CScopedTimer()
+	{
+		if (m_active)
+		{
+			const uint64_t end = CMetrics::now_ns();
+			CMetrics::instance().record( m_stage, m_start, end - m_start, m_bytes, CMetrics::thread_allocations() - m_allocations );
+		}
+	}
+
+	CScopedTimer( const CScopedTimer& ) = delete;
+	CScopedTimer& operator=( const CScopedTimer& ) = delete;
+
+	void add_bytes( uint64_t bytes ) { m_bytes += bytes; }
+
+private:
+	MetricsStage_t& m_stage;
+
+	bool m_active = false;
+	uint64_t m_start = 0;
+	uint64_t m_bytes = 0;
+	uint64_t m_allocations = 0;
+};
+
+#define METRICS_CONCAT_( a, b )		a##b
+#define METRICS_CONCAT( a, b )		METRICS_CONCAT_( a, b )
+
+//	METRICS_TIMER( timer, "bmp.encode" ); ... timer.add_bytes( n );
+#define METRICS_TIMER( var, name ) \
+	static MetricsStage_t& METRICS_CONCAT( var, _stage ) = CMetrics::instance().stage( name ); \
+	CScopedTimer var( METRICS_CONCAT( var, _stage ) )
+
+#define METRICS_SCOPE( name )		METRICS_TIMER( METRICS_CONCAT( metrics_timer_, __LINE__ ), name )
+
+#else
+
+class CScopedTimer
+{
+public:
+	void add_bytes( uint64_t ) {}
+};
+
+#define METRICS_TIMER( var, name )	[[maybe_unused]] CScopedTimer var
+#define METRICS_SCOPE( name )
+
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+#include <climits>
+
+#include "mipgen.h"
+#include "metrics.h"
+
+CPaletteMatcher::CPaletteMatcher( const std::vector<ColorData_t>& palette, bool skip_transparent ) :
+	m_palette(palette),
+	m_lut(1 << 15, -1)
+{
+	m_num_colors = (uint32_t)palette.size();
+
+	if (skip_transparent && m_num_colors > TRANSPARENT_INDEX)
+		m_num_colors = TRANSPARENT_INDEX;
+}
+
+uint8_t CPaletteMatcher::nearest( uint8_t r, uint8_t g, uint8_t b )
+{
+	const uint32_t key = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+
+	if (m_lut[key] >= 0)
+		return (uint8_t)m_lut[key];
+
+	uint32_t best = 0, best_dist = UINT_MAX;
+	for (uint32_t i = 0; i < m_num_colors; i++)
+	{
+		const int32_t dr = (int32_t)m_palette[i].Red - r;
+		const int32_t dg = (int32_t)m_palette[i].Green - g;
+		const int32_t db = (int32_t)m_palette[i].Blue - b;
+
+		const uint32_t dist = dr * dr + dg * dg + db * db;
+		if (dist < best_dist)
+		{
+			best_dist = dist;
+			best = i;
+
+			if (!dist)
+				break;
+		}
+	}
+
+	m_lut[key] = (int16_t)best;
+	return (uint8_t)best;
+}
+
+bool is_transparent_texture( const TextureData_t& tex )
+{
+	return !tex.name.empty() && tex.name[0] == '{';
+}
+
+bool generate_mip( const TextureData_t& tex, uint32_t mip, CPaletteMatcher& matcher, std::vector<uint8_t>& out )
+{
+	if (mip >= MIPLEVELS || tex.pixel_data[0].size() != tex.width * tex.height || tex.m_palette_data.empty())
+		return false;
+
+	const uint32_t width = CWadFile::mip_width( tex.width, mip );
+	const uint32_t height = CWadFile::mip_height( tex.height, mip );
+	const uint32_t box = 1 << mip;
+
+	const bool transparent = is_transparent_texture( tex );
+	const auto& src = tex.pixel_data[0];
+	const auto& palette = tex.m_palette_data;
+
+	out.resize( width * height );
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint32_t r = 0, g = 0, b = 0, n = 0, holes = 0;
+
+			for (uint32_t by = 0; by < box; by++)
+			{
+				const uint8_t* row = src.data() + (y * box + by) * tex.width + x * box;
+
+				for (uint32_t bx = 0; bx < box; bx++)
+				{
+					const uint8_t index = row[bx];
+
+					if (transparent && index == TRANSPARENT_INDEX)
+					{
+						holes++;
+						continue;
+					}
+
+					if (index >= palette.size())
+						continue;
+
+					r += palette[index].Red;
+					g += palette[index].Green;
+					b += palette[index].Blue;
+					n++;
+				}
+			}
+
+			//	Mostly transparent boxes stay transparent.
+			if (transparent && holes * 2 > box * box)
+				out[y * width + x] = TRANSPARENT_INDEX;
+			else if (n)
+				out[y * width + x] = matcher.nearest( r / n, g / n, b / n );
+			else
+				out[y * width + x] = 0;
+		}
+	}
+
+	return true;
+}
+
+bool generate_mips( TextureData_t& tex )
+{
+	METRICS_TIMER( timer, "texture.mipgen" );
+	timer.add_bytes( tex.pixel_data[0].size() );
+
+	CPaletteMatcher matcher( tex.m_palette_data, is_transparent_texture( tex ) );
+
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+	{
+		if (!generate_mip( tex, m, matcher, tex.pixel_data[m] ))
+			return false;
+	}
+
+	return true;
+}
+
+bool generate_decal_mips( TextureData_t& tex )
+{
+	if (tex.pixel_data[0].size() != tex.width * tex.height)
+		return false;
+
+	METRICS_TIMER( timer, "texture.mipgen" );
+	timer.add_bytes( tex.pixel_data[0].size() );
+
+	const auto& src = tex.pixel_data[0];
+
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+	{
+		const uint32_t width = CWadFile::mip_width( tex.width, m );
+		const uint32_t height = CWadFile::mip_height( tex.height, m );
+		const uint32_t box = 1 << m;
+
+		auto& out = tex.pixel_data[m];
+		out.resize( width * height );
+
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint32_t sum = 0;
+
+				for (uint32_t by = 0; by < box; by++)
+				{
+					const uint8_t* row = src.data() + (y * box + by) * tex.width + x * box;
+
+					for (uint32_t bx = 0; bx < box; bx++)
+						sum += row[bx];
+				}
+
+				out[y * width + x] = (uint8_t)((sum + box * box / 2) / (box * box));
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef MIPGEN_H
+#define MIPGEN_H
+
+#pragma once
+
+#include <vector>
+
+#include "wad.h"
+
+//	Finds the closest palette entry for RGB colors. The colors are quantized
+//	to 15 bits and every looked up color is remembered, so matching a whole
+//	texture only searches the palette a handful of times.
+class CPaletteMatcher
+{
+public:
+	//	With skip_transparent the last palette entry is never matched.
+	CPaletteMatcher( const std::vector<ColorData_t>& palette, bool skip_transparent );
+
+	uint8_t nearest( uint8_t r, uint8_t g, uint8_t b );
+
+private:
+	const std::vector<ColorData_t>& m_palette;
+	uint32_t m_num_colors;
+
+	std::vector<int16_t> m_lut;
+};
+
+//	True for textures whose name starts with '{', these use the last palette
+//	index as a transparent color.
+bool is_transparent_texture( const TextureData_t& tex );
+
+//	Regenerates mips 1..3 out of mip 0. Each pixel of the n'th mip is the
+//	average of the corresponding (2 ^ n) x (2 ^ n) box of mip 0, mapped back
+//	to the nearest palette color.
+bool generate_mips( TextureData_t& tex );
+
+//	Same as above for a single mip level.
+bool generate_mip( const TextureData_t& tex, uint32_t mip, CPaletteMatcher& matcher, std::vector<uint8_t>& out );
+
+//	Regenerates mips 1..3 of a decal (LUMP_TYPE_DECAL). A decal's indices are
+//	the opacity of the color in its last palette entry, so the indices of
+//	each box are averaged instead of their colors.
+bool generate_decal_mips( TextureData_t& tex );
+
+#endif
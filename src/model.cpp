@@ -0,0 +1,132 @@
+#include <cstring>
+
+#include "model.h"
+#include "byteorder.h"
+#include "metrics.h"
+
+bool CModelFile::open()
+{
+	METRICS_SCOPE( "model.read" );
+
+	if (!m_mapping.open( m_path ))
+		return fail( m_mapping.error() );
+
+	m_textures.clear();
+
+	//	Sequence group files (<name>01.mdl, ...) only have animations.
+	if (m_mapping.size() >= 4 && !memcmp( m_mapping.data(), "IDSQ", 4 ))
+		return true;
+
+	ModelHeader_t header;
+	const int32_t numtextures = read_header( m_mapping, header );
+	if (numtextures < 0)
+		return false;
+
+	if (numtextures)
+	{
+		m_texture_path = m_path;
+		return read_textures( m_mapping, header );
+	}
+
+	//	The textures are in <name>T.mdl, if the model has any.
+	auto texture_path = m_path;
+	texture_path.replace_filename( m_path.stem().string() + "T" + m_path.extension().string() );
+
+	std::error_code ec;
+	if (!std::filesystem::is_regular_file( texture_path, ec ))
+		return true;
+
+	if (!m_texture_mapping.open( texture_path ))
+		return fail( m_texture_mapping.error() );
+
+	if (read_header( m_texture_mapping, header ) < 0)
+		return false;
+
+	m_texture_path = texture_path;
+	return read_textures( m_texture_mapping, header );
+}
+
+int32_t CModelFile::read_header( const CMappedFile& mapping, ModelHeader_t& header )
+{
+	if (mapping.size() < sizeof( ModelHeader_t ))
+	{
+		fail( "The file is too small to be a studio model." );
+		return -1;
+	}
+
+	memcpy( &header, mapping.data(), sizeof( header ) );
+
+	if (memcmp( header.ident, "IDST", sizeof( header.ident ) ))
+	{
+		fail( "Invalid studio model id." );
+		return -1;
+	}
+
+	header.version = LittleLong( header.version );
+	header.numtextures = LittleLong( header.numtextures );
+	header.textureindex = LittleLong( header.textureindex );
+	header.texturedataindex = LittleLong( header.texturedataindex );
+
+	if (header.version != MODEL_VERSION)
+	{
+		fail( "Unsupported studio model version " + std::to_string( header.version ) + ", only GoldSrc models (10) are supported." );
+		return -1;
+	}
+
+	if (header.numtextures < 0 || header.textureindex < 0 || (uint64_t)header.textureindex + (uint64_t)header.numtextures * sizeof( ModelTextureHeader_t ) > mapping.size())
+	{
+		fail( "The texture directory is out of the range of the studio model." );
+		return -1;
+	}
+
+	return header.numtextures;
+}
+
+bool CModelFile::read_textures( const CMappedFile& mapping, const ModelHeader_t& header )
+{
+	METRICS_TIMER( timer, "model.textures" );
+
+	const size_t filesize = mapping.size();
+	const uint8_t* base = mapping.data();
+
+	for (int32_t i = 0; i < header.numtextures; i++)
+	{
+		ModelTextureHeader_t texture;
+		memcpy( &texture, base + header.textureindex + i * sizeof( ModelTextureHeader_t ), sizeof( texture ) );
+
+		texture.flags = LittleLong( texture.flags );
+		texture.width = LittleLong( texture.width );
+		texture.height = LittleLong( texture.height );
+		texture.index = LittleLong( texture.index );
+
+		const std::string name( texture.name, strnlen( texture.name, sizeof( texture.name ) ) );
+
+		if (texture.width <= 0 || texture.height <= 0 || texture.index < 0)
+			return fail( "Texture #" + std::to_string( i ) + " (" + name + ") has invalid dimensions." );
+
+		const uint64_t size = (uint64_t)texture.width * texture.height;
+		if ((uint64_t)texture.index + size + MODEL_PALETTE_SIZE > filesize)
+			return fail( "Texture #" + std::to_string( i ) + " (" + name + ") is out of the range of the studio model." );
+
+		ModelTexture_t out;
+		out.image.name = name;
+		out.image.width = texture.width;
+		out.image.height = texture.height;
+		out.image.pixels = base + texture.index;
+		out.image.palette = reinterpret_cast<const ColorData_t*>(base + texture.index + size);
+		out.image.num_colors = 256;
+		out.flags = texture.flags;
+
+		m_textures.push_back( std::move( out ) );
+
+		timer.add_bytes( size + MODEL_PALETTE_SIZE );
+	}
+
+	return true;
+}
+
+bool CModelFile::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
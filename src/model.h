@@ -0,0 +1,112 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "indexed_image.h"
+#include "mapped_file.h"
+
+//	GoldSrc studio models are version 10.
+#define MODEL_VERSION		10
+
+//	Texture flags, only the ones that change how the pixels are read.
+#define MODEL_NF_MASKED		0x0040	// TRANSPARENT_INDEX is see-through
+
+//	Size of the palette after the pixels of every texture, always 256 colors.
+#define MODEL_PALETTE_SIZE	(256 * 3)
+
+//	Only the part of studiohdr_t up to the textures, the offsets of the rest
+//	are of no interest here.
+struct ModelHeader_t
+{
+	char	ident[4];	// IDST
+	int32_t	version;
+	char	name[64];
+	int32_t	length;
+
+	float	eyeposition[3];
+	float	min[3], max[3];
+	float	bbmin[3], bbmax[3];
+
+	int32_t	flags;
+
+	int32_t	numbones, boneindex;
+	int32_t	numbonecontrollers, bonecontrollerindex;
+	int32_t	numhitboxes, hitboxindex;
+	int32_t	numseq, seqindex;
+	int32_t	numseqgroups, seqgroupindex;
+
+	int32_t	numtextures, textureindex;
+	int32_t	texturedataindex;
+};
+
+//	Followed by nothing, index points to width * height palette indices and
+//	a MODEL_PALETTE_SIZE byte palette.
+struct ModelTextureHeader_t
+{
+	char	name[64];
+	int32_t	flags;
+	int32_t	width, height;
+	int32_t	index;
+};
+
+static_assert( sizeof( ModelHeader_t ) == 192, "ModelHeader_t has to be 192 bytes long" );
+static_assert( sizeof( ModelTextureHeader_t ) == 80, "ModelTextureHeader_t has to be 80 bytes long" );
+
+struct ModelTexture_t
+{
+	//	Points into the mapped file, named after the texture.
+	IndexedImageView_t image;
+
+	int32_t flags;
+};
+
+//	Reads the textures (skins) of a GoldSrc studio model. Models compiled with
+//	$externaltextures keep them in a separate <name>T.mdl next to the model,
+//	which is picked up automatically. Sequence group files open fine and have
+//	no textures. The files are memory mapped and the textures are views into them.
+class CModelFile
+{
+public:
+	CModelFile( const std::filesystem::path& path ) :
+		m_path(path)
+	{}
+
+	CModelFile( const CModelFile& ) = delete;
+	CModelFile& operator=( const CModelFile& ) = delete;
+
+	bool open();
+
+	const std::filesystem::path& path() const { return m_path; }
+	const std::vector<ModelTexture_t>& textures() const { return m_textures; }
+
+	//	The file the textures were read from, the model itself or its T.mdl.
+	const std::filesystem::path& texture_path() const { return m_texture_path; }
+
+	const std::string& error() const { return m_error; }
+
+private:
+	//	Returns the number of textures in the header, -1 when it's invalid.
+	int32_t read_header( const CMappedFile& mapping, ModelHeader_t& header );
+	bool read_textures( const CMappedFile& mapping, const ModelHeader_t& header );
+
+	bool fail( const std::string& msg );
+
+private:
+	std::filesystem::path m_path;
+	std::filesystem::path m_texture_path;
+
+	CMappedFile m_mapping;
+	CMappedFile m_texture_mapping;
+
+	std::vector<ModelTexture_t> m_textures;
+
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,422 @@
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+#include "palette_kernels.h"
+#include "mipgen.h"
+#include "metrics.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define KERNELS_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	endif
+#endif
+
+//	Lets the compiler emit the instructions for a single function, so the rest
+//	of the program doesn't require the instruction set.
+#if defined(__GNUC__) || defined(__clang__)
+#	define KERNEL_TARGET( x ) __attribute__((target( x )))
+#else
+#	define KERNEL_TARGET( x )
+#endif
+
+const char* str_for_kernel( EKernel kernel )
+{
+	switch (kernel)
+	{
+		case EKernel::Scalar:
+			return "scalar";
+		case EKernel::SSSE3:
+			return "ssse3";
+		case EKernel::AVX2:
+			return "avx2";
+		default:
+			break;
+	}
+
+	return "n/a";
+}
+
+bool is_kernel_supported( EKernel kernel )
+{
+	switch (kernel)
+	{
+		case EKernel::Scalar:
+			return true;
+
+#ifdef KERNELS_X86
+#	if defined(__GNUC__) || defined(__clang__)
+		case EKernel::SSSE3:
+			return __builtin_cpu_supports( "ssse3" );
+		case EKernel::AVX2:
+			return __builtin_cpu_supports( "avx2" );
+#	elif defined(_MSC_VER)
+		case EKernel::SSSE3:
+		{
+			int info[4];
+			__cpuid( info, 1 );
+			return (info[2] & (1 << 9)) != 0;
+		}
+		case EKernel::AVX2:
+		{
+			int info[4];
+			__cpuid( info, 1 );
+
+			//	The OS has to save the YMM registers too.
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (!osxsave || (_xgetbv( 0 ) & 6) != 6)
+				return false;
+
+			__cpuidex( info, 7, 0 );
+			return (info[1] & (1 << 5)) != 0;
+		}
+#	endif
+#endif
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+EKernel best_kernel()
+{
+	static const EKernel best = []()
+	{
+		if (is_kernel_supported( EKernel::AVX2 ))
+			return EKernel::AVX2;
+
+		if (is_kernel_supported( EKernel::SSSE3 ))
+			return EKernel::SSSE3;
+
+		return EKernel::Scalar;
+	}();
+
+	return best;
+}
+
+//	A kernel the CPU can't run is replaced by the scalar one, it would fault
+//	on the first instruction otherwise.
+static EKernel usable_kernel( EKernel kernel )
+{
+	static const auto supported = []()
+	{
+		std::array<bool, (size_t)EKernel::KernelCount> out;
+		for (size_t k = 0; k < out.size(); k++)
+			out[k] = is_kernel_supported( (EKernel)k );
+
+		return out;
+	}();
+
+	return (size_t)kernel < supported.size() && supported[(size_t)kernel] ? kernel : EKernel::Scalar;
+}
+
+//
+//	Scalar reference kernels
+//
+
+static void palette_rgb_scalar( const uint8_t* rgb, uint32_t begin, uint32_t num_colors, bool bgr, uint8_t alpha, uint8_t* out )
+{
+	for (uint32_t i = begin; i < num_colors; i++)
+	{
+		out[i * 4 + 0] = rgb[i * 3 + (bgr ? 2 : 0)];
+		out[i * 4 + 1] = rgb[i * 3 + 1];
+		out[i * 4 + 2] = rgb[i * 3 + (bgr ? 0 : 2)];
+		out[i * 4 + 3] = alpha;
+	}
+}
+
+static void expand_rgba_scalar( const uint8_t* indices, size_t begin, size_t count, const uint8_t* rgba_palette, uint8_t* out )
+{
+	for (size_t i = begin; i < count; i++)
+		memcpy( out + i * 4, rgba_palette + indices[i] * 4, 4 );
+}
+
+static void expand_rgb_scalar( const uint8_t* indices, size_t begin, size_t count, const uint8_t* rgba_palette, uint8_t* out )
+{
+	for (size_t i = begin; i < count; i++)
+	{
+		const uint8_t* color = rgba_palette + indices[i] * 4;
+
+		out[i * 3 + 0] = color[0];
+		out[i * 3 + 1] = color[1];
+		out[i * 3 + 2] = color[2];
+	}
+}
+
+//
+//	SSE2/SSSE3 kernels
+//
+
+#ifdef KERNELS_X86
+
+//	Spreads 4 packed RGB triplets into 4 dwords, the 4th byte is zeroed.
+KERNEL_TARGET( "ssse3" )
+static uint32_t palette_rgb_ssse3( const uint8_t* rgb, uint32_t num_colors, bool bgr, uint8_t alpha, uint8_t* out )
+{
+	const __m128i spread_rgb = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+	const __m128i spread_bgr = _mm_setr_epi8( 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 );
+	const __m128i mask = bgr ? spread_bgr : spread_rgb;
+	const __m128i alpha_bits = _mm_set1_epi32( (int32_t)((uint32_t)alpha << 24) );
+
+	//	Each load reads 16 bytes but uses only 12, so stop early enough not
+	//	to read past the end of the palette.
+	uint32_t i = 0;
+	for (; i + 6 <= num_colors; i += 4)
+	{
+		const __m128i src = _mm_loadu_si128( (const __m128i*)(rgb + i * 3) );
+		const __m128i dst = _mm_or_si128( _mm_shuffle_epi8( src, mask ), alpha_bits );
+
+		_mm_storeu_si128( (__m128i*)(out + i * 4), dst );
+	}
+
+	return i;
+}
+
+//	Four palette lookups, done as scalar loads and packed into one register.
+//	A 1 KiB palette is far too big for a pshufb table, and there's no gather
+//	before AVX2.
+KERNEL_TARGET( "sse2" )
+static inline __m128i load_rgba4( const uint8_t* indices, const uint32_t* palette )
+{
+	return _mm_setr_epi32( palette[indices[0]], palette[indices[1]], palette[indices[2]], palette[indices[3]] );
+}
+
+//	Only needs SSE2, the lookups are scalar and the gain is in writing 16
+//	pixels as four full vector stores.
+KERNEL_TARGET( "sse2" )
+static size_t expand_rgba_sse2( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out )
+{
+	const uint32_t* palette = reinterpret_cast<const uint32_t*>(rgba_palette);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm_storeu_si128( (__m128i*)(out + i * 4 + 0), load_rgba4( indices + i + 0, palette ) );
+		_mm_storeu_si128( (__m128i*)(out + i * 4 + 16), load_rgba4( indices + i + 4, palette ) );
+		_mm_storeu_si128( (__m128i*)(out + i * 4 + 32), load_rgba4( indices + i + 8, palette ) );
+		_mm_storeu_si128( (__m128i*)(out + i * 4 + 48), load_rgba4( indices + i + 12, palette ) );
+	}
+
+	return i;
+}
+
+//	Packs 4 RGBA pixels into 12 bytes of RGB at the bottom of the register.
+KERNEL_TARGET( "ssse3" )
+static inline __m128i pack_rgb4( __m128i rgba )
+{
+	const __m128i mask = _mm_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+	return _mm_shuffle_epi8( rgba, mask );
+}
+
+//	Stores 16 pixels worth of RGB (48 bytes) out of four 12 byte groups.
+KERNEL_TARGET( "ssse3" )
+static inline void store_rgb16( uint8_t* out, __m128i a, __m128i b, __m128i c, __m128i d )
+{
+	_mm_storeu_si128( (__m128i*)(out + 0), _mm_or_si128( a, _mm_slli_si128( b, 12 ) ) );
+	_mm_storeu_si128( (__m128i*)(out + 16), _mm_or_si128( _mm_srli_si128( b, 4 ), _mm_slli_si128( c, 8 ) ) );
+	_mm_storeu_si128( (__m128i*)(out + 32), _mm_or_si128( _mm_srli_si128( c, 8 ), _mm_slli_si128( d, 4 ) ) );
+}
+
+KERNEL_TARGET( "ssse3" )
+static size_t expand_rgb_ssse3( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out )
+{
+	const uint32_t* palette = reinterpret_cast<const uint32_t*>(rgba_palette);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i a = pack_rgb4( load_rgba4( indices + i + 0, palette ) );
+		const __m128i b = pack_rgb4( load_rgba4( indices + i + 4, palette ) );
+		const __m128i c = pack_rgb4( load_rgba4( indices + i + 8, palette ) );
+		const __m128i d = pack_rgb4( load_rgba4( indices + i + 12, palette ) );
+
+		store_rgb16( out + i * 3, a, b, c, d );
+	}
+
+	return i;
+}
+
+//
+//	AVX2 kernels
+//
+
+KERNEL_TARGET( "avx2" )
+static inline __m256i gather_rgba8( const uint8_t* indices, const uint8_t* rgba_palette )
+{
+	const __m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)indices ) );
+	return _mm256_i32gather_epi32( (const int*)rgba_palette, idx, 4 );
+}
+
+KERNEL_TARGET( "avx2" )
+static size_t expand_rgba_avx2( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out )
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm256_storeu_si256( (__m256i*)(out + i * 4 + 0), gather_rgba8( indices + i + 0, rgba_palette ) );
+		_mm256_storeu_si256( (__m256i*)(out + i * 4 + 32), gather_rgba8( indices + i + 8, rgba_palette ) );
+	}
+
+	return i;
+}
+
+KERNEL_TARGET( "avx2" )
+static size_t expand_rgb_avx2( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out )
+{
+	//	Same packing as pack_rgb4, in both lanes.
+	const __m256i mask = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i lo = _mm256_shuffle_epi8( gather_rgba8( indices + i + 0, rgba_palette ), mask );
+		const __m256i hi = _mm256_shuffle_epi8( gather_rgba8( indices + i + 8, rgba_palette ), mask );
+
+		store_rgb16( out + i * 3,
+					 _mm256_castsi256_si128( lo ), _mm256_extracti128_si256( lo, 1 ),
+					 _mm256_castsi256_si128( hi ), _mm256_extracti128_si256( hi, 1 ) );
+	}
+
+	return i;
+}
+
+#endif
+
+//
+//	Dispatch
+//
+
+static void finish_palette( uint32_t num_colors, uint8_t* out )
+{
+	for (uint32_t i = num_colors; i < 256; i++)
+	{
+		out[i * 4 + 0] = 0;
+		out[i * 4 + 1] = 0;
+		out[i * 4 + 2] = 0;
+		out[i * 4 + 3] = 0xFF;
+	}
+}
+
+void palette_rgb_to_rgba( const uint8_t* rgb, uint32_t num_colors, bool transparent, uint8_t* rgba, EKernel kernel )
+{
+	METRICS_TIMER( timer, "palette.build" );
+	timer.add_bytes( RGBA_PALETTE_SIZE );
+
+	num_colors = std::min( num_colors, 256u );
+
+	kernel = usable_kernel( kernel );
+	uint32_t done = 0;
+
+#ifdef KERNELS_X86
+	//	AVX2 doesn't have anything to add for 256 entries.
+	if (kernel != EKernel::Scalar)
+		done = palette_rgb_ssse3( rgb, num_colors, false, 0xFF, rgba );
+#endif
+
+	palette_rgb_scalar( rgb, done, num_colors, false, 0xFF, rgba );
+	finish_palette( num_colors, rgba );
+
+	if (transparent)
+		memset( rgba + TRANSPARENT_INDEX * 4, 0, 4 );
+}
+
+void palette_rgb_to_bgrx( const uint8_t* rgb, uint32_t num_colors, uint8_t* bgrx, EKernel kernel )
+{
+	METRICS_TIMER( timer, "palette.build" );
+	timer.add_bytes( RGBA_PALETTE_SIZE );
+
+	num_colors = std::min( num_colors, 256u );
+
+	kernel = usable_kernel( kernel );
+	uint32_t done = 0;
+
+#ifdef KERNELS_X86
+	if (kernel != EKernel::Scalar)
+		done = palette_rgb_ssse3( rgb, num_colors, true, 0, bgrx );
+#endif
+
+	palette_rgb_scalar( rgb, done, num_colors, true, 0, bgrx );
+
+	//	Unused entries are black with the reserved byte zeroed.
+	if (num_colors < 256)
+		memset( bgrx + num_colors * 4, 0, (256 - num_colors) * 4 );
+}
+
+void expand_indexed_rgba( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out, EKernel kernel )
+{
+	METRICS_TIMER( timer, "palette.expand" );
+	timer.add_bytes( count * 4 );
+
+	kernel = usable_kernel( kernel );
+	size_t done = 0;
+
+#ifdef KERNELS_X86
+	if (kernel == EKernel::AVX2)
+		done = expand_rgba_avx2( indices, count, rgba_palette, out );
+	else if (kernel == EKernel::SSSE3)
+		done = expand_rgba_sse2( indices, count, rgba_palette, out );
+#endif
+
+	expand_rgba_scalar( indices, done, count, rgba_palette, out );
+}
+
+void expand_indexed_rgb( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out, EKernel kernel )
+{
+	METRICS_TIMER( timer, "palette.expand" );
+	timer.add_bytes( count * 3 );
+
+	kernel = usable_kernel( kernel );
+	size_t done = 0;
+
+#ifdef KERNELS_X86
+	if (kernel == EKernel::AVX2)
+		done = expand_rgb_avx2( indices, count, rgba_palette, out );
+	else if (kernel == EKernel::SSSE3)
+		done = expand_rgb_ssse3( indices, count, rgba_palette, out );
+#endif
+
+	expand_rgb_scalar( indices, done, count, rgba_palette, out );
+}
+
+static bool texture_palette( const TextureData_t& tex, uint32_t mip, uint8_t* rgba_palette )
+{
+	if (mip >= MIPLEVELS || tex.pixel_data[mip].empty())
+		return false;
+
+	palette_rgb_to_rgba( (const uint8_t*)tex.m_palette_data.data(), (uint32_t)tex.m_palette_data.size(), is_transparent_texture( tex ), rgba_palette );
+	return true;
+}
+
+bool texture_to_rgba( const TextureData_t& tex, uint32_t mip, std::vector<uint8_t>& out )
+{
+	alignas(32) uint8_t palette[RGBA_PALETTE_SIZE];
+	if (!texture_palette( tex, mip, palette ))
+		return false;
+
+	const auto& pixels = tex.pixel_data[mip];
+
+	out.resize( pixels.size() * 4 );
+	expand_indexed_rgba( pixels.data(), pixels.size(), palette, out.data() );
+
+	return true;
+}
+
+bool texture_to_rgb( const TextureData_t& tex, uint32_t mip, std::vector<uint8_t>& out )
+{
+	alignas(32) uint8_t palette[RGBA_PALETTE_SIZE];
+	if (!texture_palette( tex, mip, palette ))
+		return false;
+
+	const auto& pixels = tex.pixel_data[mip];
+
+	out.resize( pixels.size() * 3 );
+	expand_indexed_rgb( pixels.data(), pixels.size(), palette, out.data() );
+
+	return true;
+}
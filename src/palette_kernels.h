@@ -0,0 +1,55 @@
+#ifndef PALETTE_KERNELS_H
+#define PALETTE_KERNELS_H
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "wad.h"
+
+//	Size of a full RGBA palette in bytes.
+#define RGBA_PALETTE_SIZE	(256 * 4)
+
+//	Implementations of the kernels. The scalar one is the reference, the
+//	others have to produce exactly the same output.
+enum class EKernel : uint32_t
+{
+	Scalar,
+	SSSE3,		// pshufb palette spreading and RGB packing, the RGBA expansion only uses SSE2
+	AVX2,		// Gathered palette lookups
+
+	KernelCount
+};
+
+const char* str_for_kernel( EKernel kernel );
+
+//	Whether the CPU can run the kernel.
+bool is_kernel_supported( EKernel kernel );
+
+//	Best kernel the CPU supports, used by the functions without an explicit kernel.
+//	An explicit kernel the CPU doesn't support runs as the scalar one.
+EKernel best_kernel();
+
+//	Expands a packed RGB palette into 256 RGBA entries. Missing entries are
+//	black. With transparent set, the last entry becomes fully transparent
+//	black, which is how the engine treats textures whose name starts with '{'.
+void palette_rgb_to_rgba( const uint8_t* rgb, uint32_t num_colors, bool transparent, uint8_t* rgba, EKernel kernel = best_kernel() );
+
+//	Expands a packed RGB palette into 256 BMP RGBQuad_t entries (B, G, R, 0).
+void palette_rgb_to_bgrx( const uint8_t* rgb, uint32_t num_colors, uint8_t* bgrx, EKernel kernel = best_kernel() );
+
+//	Looks up every index in the RGBA palette, writing count * 4 bytes.
+void expand_indexed_rgba( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out, EKernel kernel = best_kernel() );
+
+//	Looks up every index in the RGBA palette, writing count * 3 bytes (alpha is dropped).
+void expand_indexed_rgb( const uint8_t* indices, size_t count, const uint8_t* rgba_palette, uint8_t* out, EKernel kernel = best_kernel() );
+
+//	Converts a mip of the texture into RGBA, applying the '{' transparency rule.
+bool texture_to_rgba( const TextureData_t& tex, uint32_t mip, std::vector<uint8_t>& out );
+
+//	Converts a mip of the texture into RGB.
+bool texture_to_rgb( const TextureData_t& tex, uint32_t mip, std::vector<uint8_t>& out );
+
+#endif
@@ -0,0 +1,299 @@
+#include <cmath>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include "palette_transform.h"
+#include "wad_writer.h"
+#include "wad_compression.h"
+#include "parallel.h"
+#include "metrics.h"
+
+static uint8_t clamp_color( float value )
+{
+	return (uint8_t)std::clamp( std::lround( value ), 0l, 255l );
+}
+
+//	Reads a decimal palette index, skipping the blanks in front of it.
+static bool read_index( const char*& p, uint32_t& out )
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	if (*p < '0' || *p > '9')
+		return false;
+
+	out = 0;
+	while (*p >= '0' && *p <= '9' && out <= 255)
+		out = out * 10 + (*p++ - '0');
+
+	return out <= 255;
+}
+
+CPaletteTransform::CPaletteTransform( float gamma, float brightness, float hue )
+{
+	m_identity_colors = gamma == 1.f && brightness == 1.f && std::fmod( hue, 360.f ) == 0.f;
+
+	for (uint32_t i = 0; i < 256; i++)
+		m_lut[i] = clamp_color( std::pow( i / 255.f, 1.f / gamma ) * brightness * 255.f );
+
+	//	Rotation around the (1, 1, 1) axis, grays stay gray.
+	const float angle = hue * 3.14159265f / 180.f;
+	const float c = std::cos( angle );
+	const float s = std::sin( angle ) * std::sqrt( 1.f / 3.f );
+	const float d = c + (1.f - c) / 3.f;
+	const float o = (1.f - c) / 3.f;
+
+	m_rotate_hue = std::fmod( hue, 360.f ) != 0.f;
+
+	const float matrix[3][3] =
+	{
+		{ d, o - s, o + s },
+		{ o + s, d, o - s },
+		{ o - s, o + s, d },
+	};
+
+	memcpy( m_hue, matrix, sizeof( m_hue ) );
+
+	for (uint32_t i = 0; i < 256; i++)
+		m_remap[i] = (uint8_t)i;
+}
+
+void CPaletteTransform::set_remap( const std::array<uint8_t, 256>& remap )
+{
+	m_remap = remap;
+	m_has_remap = true;
+}
+
+bool CPaletteTransform::load_remap( const std::filesystem::path& path )
+{
+	std::ifstream file( path );
+	if (!file)
+		return fail( "Couldn't open " + path.string() + " for reading." );
+
+	auto remap = m_remap;
+
+	std::string line;
+	for (uint32_t number = 1; std::getline( file, line ); number++)
+	{
+		const size_t begin = line.find_first_not_of( " \t\r" );
+		if (begin == line.npos || line.compare( begin, 2, "//" ) == 0)
+			continue;
+
+		const char* p = line.c_str() + begin;
+
+		uint32_t first, last, to;
+		bool valid = read_index( p, first );
+
+		last = first;
+		if (valid && *p == '-')
+			valid = read_index( ++p, last ) && last >= first;
+
+		valid = valid && read_index( p, to ) && to + (last - first) <= 255 && strspn( p, " \t\r" ) == strlen( p );
+
+		if (!valid)
+			return fail( path.string() + ":" + std::to_string( number ) + ": Expected \"<from> <to>\" or \"<first>-<last> <to>\" with indices from 0 to 255." );
+
+		for (uint32_t i = first; i <= last; i++)
+			remap[i] = (uint8_t)(to + i - first);
+	}
+
+	set_remap( remap );
+
+	return true;
+}
+
+bool CPaletteTransform::is_identity() const
+{
+	if (!m_identity_colors)
+		return false;
+
+	for (uint32_t i = 0; m_has_remap && i < 256; i++)
+	{
+		if (m_remap[i] != i)
+			return false;
+	}
+
+	return true;
+}
+
+void CPaletteTransform::apply( ColorData_t* palette, uint32_t num_colors ) const
+{
+	if (m_identity_colors)
+		return;
+
+	for (uint32_t i = 0; i < num_colors; i++)
+	{
+		auto& color = palette[i];
+
+		if (m_rotate_hue)
+		{
+			const float rgb[3] = { (float)color.Red, (float)color.Green, (float)color.Blue };
+
+			color.Red = clamp_color( m_hue[0][0] * rgb[0] + m_hue[0][1] * rgb[1] + m_hue[0][2] * rgb[2] );
+			color.Green = clamp_color( m_hue[1][0] * rgb[0] + m_hue[1][1] * rgb[1] + m_hue[1][2] * rgb[2] );
+			color.Blue = clamp_color( m_hue[2][0] * rgb[0] + m_hue[2][1] * rgb[1] + m_hue[2][2] * rgb[2] );
+		}
+
+		color.Red = m_lut[color.Red];
+		color.Green = m_lut[color.Green];
+		color.Blue = m_lut[color.Blue];
+	}
+}
+
+bool CPaletteTransform::apply_miptex( uint8_t* miptex_base, uint32_t size, bool decal ) const
+{
+	if (size < sizeof( MipTexture_t ))
+		return false;
+
+	METRICS_TIMER( timer, "palette.transform" );
+	timer.add_bytes( size );
+
+	MipTexture_t miptex;
+	memcpy( &miptex, miptex_base, sizeof( miptex ) );
+	SwapMipTexture( miptex );
+
+	if (!CWadFile::is_texture_valid( &miptex ))
+		return false;
+
+	const bool transparent = miptex.name[0] == '{';
+
+	//	Same checks as CWadFile::decode_miptex(), before anything is touched.
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+	{
+		if ((uint64_t)miptex.offsets[m] + (uint64_t)CWadFile::mip_width( miptex.width, m ) * CWadFile::mip_height( miptex.height, m ) > size)
+			return false;
+	}
+
+	const uint32_t last = MIPLEVELS - 1;
+	const uint64_t palette_ofs = (uint64_t)miptex.offsets[last] + (uint64_t)CWadFile::mip_width( miptex.width, last ) * CWadFile::mip_height( miptex.height, last );
+
+	if (palette_ofs + sizeof( uint16_t ) > size)
+		return false;
+
+	uint16_t colors;
+	memcpy( &colors, miptex_base + palette_ofs, sizeof( colors ) );
+	colors = LittleShort( colors );
+
+	if (palette_ofs + sizeof( uint16_t ) + colors * 3ull > size)
+		return false;
+
+	if (m_has_remap && !decal)
+	{
+		auto remap = m_remap;
+
+		//	Nothing moves onto or off the transparent index, that would
+		//	punch new holes into the texture or fill the old ones.
+		for (uint32_t i = 0; transparent && i < 256; i++)
+		{
+			if (i == TRANSPARENT_INDEX || remap[i] == TRANSPARENT_INDEX)
+				remap[i] = (uint8_t)i;
+		}
+
+		for (uint32_t m = 0; m < MIPLEVELS; m++)
+		{
+			uint8_t* pixels = miptex_base + miptex.offsets[m];
+			const uint32_t count = CWadFile::mip_width( miptex.width, m ) * CWadFile::mip_height( miptex.height, m );
+
+			for (uint32_t i = 0; i < count; i++)
+				pixels[i] = remap[pixels[i]];
+		}
+	}
+
+	//	ColorData_t has the same layout as the RGB triplets on disk.
+	const auto palette = reinterpret_cast<ColorData_t*>(miptex_base + palette_ofs + sizeof( uint16_t ));
+	apply( palette, transparent ? std::min<uint32_t>( colors, TRANSPARENT_INDEX ) : colors );
+
+	return true;
+}
+
+bool CPaletteTransform::transform_wad( const CWadFile& wad, const std::filesystem::path& out )
+{
+	std::error_code ec;
+	if (std::filesystem::equivalent( wad.path(), out, ec ))
+		return fail( "The transformed WAD has to be written to a different file." );
+
+	struct Transformed_t
+	{
+		std::vector<uint8_t> data;
+		char compression;
+		uint32_t size;
+
+		bool ok = false;
+		std::string error;
+	};
+
+	const auto& lumps = wad.lumps();
+
+	std::vector<Transformed_t> transformed( lumps.size() );
+
+	parallel_for_weighted( lumps.size(), [&]( size_t i ) { return (uint64_t)lumps[i]->size; }, [&]( size_t i )
+	{
+		//	The rest is copied straight out of the source below.
+		if (!CWadFile::is_texture_lump( lumps[i] ))
+			return;
+
+		auto& lump = transformed[i];
+
+		std::vector<uint8_t> raw;
+		if (!wad.read_lump( lumps[i], raw, lump.error ))
+			return;
+
+		if (!apply_miptex( raw.data(), (uint32_t)raw.size(), lumps[i]->type == LUMP_TYPE_DECAL ))
+		{
+			lump.error = "The texture data is corrupted.";
+			return;
+		}
+
+		lump.size = (uint32_t)raw.size();
+
+		//	Stored the same way as the source lump.
+		if (lumps[i]->compression != LUMP_COMPRESSION_NONE && compress_lump( raw.data(), lump.size, lumps[i]->compression, lump.data ))
+			lump.compression = lumps[i]->compression;
+		else
+		{
+			lump.data = std::move( raw );
+			lump.compression = LUMP_COMPRESSION_NONE;
+		}
+
+		lump.ok = true;
+	}, m_num_threads );
+
+	CWadWriter writer( wad.wad_id() );
+	m_num_transformed = 0;
+	m_warnings.clear();
+
+	for (size_t i = 0; i < lumps.size(); i++)
+	{
+		const auto lumpptr = lumps[i];
+		bool added;
+
+		//	A texture that can't be decoded doesn't cost the rest of the WAD,
+		//	it's copied the way it is.
+		if (CWadFile::is_texture_lump( lumpptr ) && !transformed[i].ok)
+			m_warnings.push_back( "Lump #" + std::to_string( i ) + " (" + CWadFile::lump_name( lumpptr ) + ") was copied unchanged: " + transformed[i].error );
+
+		if (CWadFile::is_texture_lump( lumpptr ) && transformed[i].ok)
+		{
+			const auto& lump = transformed[i];
+			added = writer.add_lump_ref( CWadFile::lump_name( lumpptr ), lumpptr->type, lump.data.data(), (uint32_t)lump.data.size(), lump.compression, lump.size );
+			m_num_transformed++;
+		}
+		else
+			added = writer.add_lump_ref( CWadFile::lump_name( lumpptr ), lumpptr->type, wad.lump_data( lumpptr ), lumpptr->disksize, lumpptr->compression, lumpptr->size );
+
+		if (!added)
+			return fail( writer.error() );
+	}
+
+	if (!writer.write( out ))
+		return fail( writer.error() );
+
+	return true;
+}
+
+bool CPaletteTransform::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
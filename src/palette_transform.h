@@ -0,0 +1,85 @@
+#ifndef PALETTE_TRANSFORM_H
+#define PALETTE_TRANSFORM_H
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "wad.h"
+
+//	Color corrects every texture of a WAD file by touching only its palette.
+//	Gamma and brightness go through a single 256-entry table per channel, the
+//	hue is rotated around the gray axis, so a whole palette costs 256 lookups
+//	no matter how big the texture is. Optionally the pixel indices are remapped
+//	through a 256-entry table as well, e.g. to move a texture onto another
+//	color ramp of its palette.
+//
+//	Index 255 of '{' textures is left alone, both its color and the pixels
+//	using it, so the holes stay where they are. Decals only get their palette
+//	transformed, their indices are alpha levels.
+class CPaletteTransform
+{
+public:
+	//	A gamma above 1 brightens the dark colors, the brightness multiplies
+	//	the colors afterwards, the hue is in degrees.
+	CPaletteTransform( float gamma = 1.f, float brightness = 1.f, float hue = 0.f );
+
+	void set_remap( const std::array<uint8_t, 256>& remap );
+
+	//	One "<from> <to>" or "<first>-<last> <to>" pair per line, a range is
+	//	moved to start at <to>. Indices that aren't listed stay the same, blank
+	//	lines and lines starting with // are skipped.
+	bool load_remap( const std::filesystem::path& path );
+
+	bool has_remap() const { return m_has_remap; }
+
+	//	Whether the palettes or the pixels change at all.
+	bool is_identity() const;
+
+	//	Transforms the colors in place.
+	void apply( ColorData_t* palette, uint32_t num_colors ) const;
+
+	//	Transforms a MipTexture_t (header, mips, color count and palette) in
+	//	place. Returns false when the miptex is invalid.
+	bool apply_miptex( uint8_t* miptex, uint32_t size, bool decal ) const;
+
+	//	Writes a copy of the WAD with every texture and decal transformed,
+	//	the other lumps are copied byte for byte. Compressed lumps stay
+	//	compressed. Lumps are transformed in parallel, see set_num_threads().
+	//	A texture that can't be decoded is copied unchanged and listed in
+	//	warnings(). The output can't be the input file.
+	bool transform_wad( const CWadFile& wad, const std::filesystem::path& out );
+
+	void set_num_threads( uint32_t num_threads ) { m_num_threads = num_threads; }
+
+	uint32_t num_transformed() const { return m_num_transformed; }
+	const std::vector<std::string>& warnings() const { return m_warnings; }
+	const std::string& error() const { return m_error; }
+
+private:
+	bool fail( const std::string& msg );
+
+private:
+	bool m_identity_colors;
+
+	//	Gamma and brightness, the same for every channel.
+	uint8_t m_lut[256];
+
+	bool m_rotate_hue;
+	float m_hue[3][3];
+
+	bool m_has_remap = false;
+	std::array<uint8_t, 256> m_remap;
+
+	uint32_t m_num_threads = 0;
+	uint32_t m_num_transformed = 0;
+
+	std::vector<std::string> m_warnings;
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "parallel.h"
+
+//	Chunks per thread. More chunks balance better, fewer have less overhead.
+static constexpr uint64_t kChunksPerThread = 8;
+
+uint32_t default_thread_count()
+{
+	return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+void parallel_for_weighted( size_t count, const std::function<uint64_t( size_t )>& weight, const std::function<void( size_t )>& body, uint32_t num_threads )
+{
+	if (!count)
+		return;
+
+	if (!num_threads)
+		num_threads = default_thread_count();
+
+	num_threads = (uint32_t)std::min<size_t>( num_threads, count );
+
+	if (num_threads == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+			body( i );
+
+		return;
+	}
+
+	struct Chunk_t
+	{
+		size_t begin, end;
+	};
+
+	struct Queue_t
+	{
+		std::mutex mutex;
+		std::deque<Chunk_t> chunks;
+	};
+
+	//	Split the items into contiguous chunks of about the same weight. An
+	//	item heavier than the target ends up in a chunk of its own.
+	std::vector<uint64_t> weights( count );
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < count; i++)
+		total += (weights[i] = std::max<uint64_t>( 1, weight( i ) ));
+
+	const uint64_t target = std::max<uint64_t>( 1, total / (num_threads * kChunksPerThread) );
+
+	std::vector<Chunk_t> chunks;
+
+	size_t begin = 0;
+	uint64_t acc = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		acc += weights[i];
+
+		if (acc >= target)
+		{
+			chunks.push_back( { begin, i + 1 } );
+			begin = i + 1;
+			acc = 0;
+		}
+	}
+
+	if (begin < count)
+		chunks.push_back( { begin, count } );
+
+	//	Deal the chunks out round robin, so every queue gets a similar mix.
+	std::vector<Queue_t> queues( num_threads );
+	for (size_t i = 0; i < chunks.size(); i++)
+		queues[i % num_threads].chunks.push_back( chunks[i] );
+
+	auto worker = [&]( uint32_t self )
+	{
+		while (true)
+		{
+			Chunk_t chunk;
+			bool found = false;
+
+			//	Own queue first, from the front.
+			{
+				auto& queue = queues[self];
+				std::lock_guard<std::mutex> lock( queue.mutex );
+
+				if (!queue.chunks.empty())
+				{
+					chunk = queue.chunks.front();
+					queue.chunks.pop_front();
+					found = true;
+				}
+			}
+
+			//	Then steal from the back of the others.
+			for (uint32_t k = 1; !found && k < num_threads; k++)
+			{
+				auto& queue = queues[(self + k) % num_threads];
+				std::lock_guard<std::mutex> lock( queue.mutex );
+
+				if (!queue.chunks.empty())
+				{
+					chunk = queue.chunks.back();
+					queue.chunks.pop_back();
+					found = true;
+				}
+			}
+
+			//	No new work is ever added, so empty queues mean we're done.
+			if (!found)
+				return;
+
+			for (size_t i = chunk.begin; i < chunk.end; i++)
+				body( i );
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve( num_threads - 1 );
+
+	for (uint32_t t = 1; t < num_threads; t++)
+		threads.emplace_back( worker, t );
+
+	worker( 0 );
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void parallel_for( size_t count, const std::function<void( size_t )>& body, uint32_t num_threads )
+{
+	parallel_for_weighted( count, []( size_t ) { return 1ull; }, body, num_threads );
+}
@@ -0,0 +1,25 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+//	Number of threads to use when the caller doesn't care, at least 1.
+uint32_t default_thread_count();
+
+//	Runs body( i ) for every i in [0, count) on up to num_threads threads, the
+//	calling thread included. Neighbouring items are grouped into chunks of
+//	roughly equal total weight, so a few huge items and lots of tiny ones
+//	spread evenly. The chunks are dealt out to per-thread queues and threads
+//	that run out of work steal chunks from the back of the other queues.
+//
+//	Passing 0 threads uses default_thread_count().
+void parallel_for_weighted( size_t count, const std::function<uint64_t( size_t )>& weight, const std::function<void( size_t )>& body, uint32_t num_threads = 0 );
+
+//	Same as above with every item weighing the same.
+void parallel_for( size_t count, const std::function<void( size_t )>& body, uint32_t num_threads = 0 );
+
+#endif
@@ -0,0 +1,238 @@
+#include <cmath>
+#include <algorithm>
+
+#include "perceptual_hash.h"
+#include "palette_kernels.h"
+#include "parallel.h"
+
+//	Size the mip is resampled to before the DCT.
+static constexpr uint32_t kSampleSize = 32;
+
+//	Size of the block of low frequencies that make up the hash.
+static constexpr uint32_t kHashSize = 8;
+
+static_assert( kHashSize * kHashSize == 64, "The hash has to be 64 bits" );
+
+//	cos( (2x + 1) * u * pi / 2N ) for the frequencies 0..kHashSize - 1.
+static const auto& dct_table()
+{
+	static const auto table = []()
+	{
+		std::vector<float> t( kHashSize * kSampleSize );
+
+		for (uint32_t u = 0; u < kHashSize; u++)
+		{
+			for (uint32_t x = 0; x < kSampleSize; x++)
+				t[u * kSampleSize + x] = (float)std::cos( (2.0 * x + 1.0) * u * 3.14159265358979323846 / (2.0 * kSampleSize) );
+		}
+
+		return t;
+	}();
+
+	return table;
+}
+
+bool perceptual_hash( const TextureData_t& tex, uint64_t& hash )
+{
+	//	Mip 3 is plenty for the low frequencies and it's the cheapest to expand.
+	int32_t mip = MIPLEVELS - 1;
+	while (mip >= 0 && tex.pixel_data[mip].empty())
+		mip--;
+
+	if (mip < 0)
+		return false;
+
+	const uint32_t width = CWadFile::mip_width( tex.width, mip );
+	const uint32_t height = CWadFile::mip_height( tex.height, mip );
+
+	std::vector<uint8_t> rgba;
+	if (!width || !height || tex.pixel_data[mip].size() < (size_t)width * height || !texture_to_rgba( tex, mip, rgba ))
+		return false;
+
+	std::vector<float> luma( (size_t)width * height );
+	for (size_t i = 0; i < luma.size(); i++)
+	{
+		const uint8_t* p = &rgba[i * 4];
+		luma[i] = (0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]) * (p[3] / 255.f);
+	}
+
+	//	Bilinear resample to kSampleSize x kSampleSize, pixel centers aligned.
+	float sample[kSampleSize][kSampleSize];
+
+	for (uint32_t y = 0; y < kSampleSize; y++)
+	{
+		const float sy = std::clamp( (y + 0.5f) * height / kSampleSize - 0.5f, 0.f, (float)(height - 1) );
+		const uint32_t y0 = (uint32_t)sy, y1 = std::min( y0 + 1, height - 1 );
+		const float fy = sy - y0;
+
+		for (uint32_t x = 0; x < kSampleSize; x++)
+		{
+			const float sx = std::clamp( (x + 0.5f) * width / kSampleSize - 0.5f, 0.f, (float)(width - 1) );
+			const uint32_t x0 = (uint32_t)sx, x1 = std::min( x0 + 1, width - 1 );
+			const float fx = sx - x0;
+
+			const float top = luma[y0 * width + x0] * (1 - fx) + luma[y0 * width + x1] * fx;
+			const float bottom = luma[y1 * width + x0] * (1 - fx) + luma[y1 * width + x1] * fx;
+
+			sample[y][x] = top * (1 - fy) + bottom * fy;
+		}
+	}
+
+	//	Separable DCT, only the lowest kHashSize frequencies are needed.
+	const auto& cos_table = dct_table();
+
+	float rows[kHashSize][kSampleSize];
+	for (uint32_t u = 0; u < kHashSize; u++)
+	{
+		const float* c = &cos_table[u * kSampleSize];
+
+		for (uint32_t y = 0; y < kSampleSize; y++)
+		{
+			float sum = 0;
+			for (uint32_t x = 0; x < kSampleSize; x++)
+				sum += sample[y][x] * c[x];
+
+			rows[u][y] = sum;
+		}
+	}
+
+	float coefs[kHashSize * kHashSize];
+	for (uint32_t v = 0; v < kHashSize; v++)
+	{
+		const float* c = &cos_table[v * kSampleSize];
+
+		for (uint32_t u = 0; u < kHashSize; u++)
+		{
+			float sum = 0;
+			for (uint32_t y = 0; y < kSampleSize; y++)
+				sum += rows[u][y] * c[y];
+
+			coefs[v * kHashSize + u] = sum;
+		}
+	}
+
+	//	Frequencies that are missing from the image come out as rounding noise,
+	//	flush them to zero so they hash the same way every time.
+	float largest = 0;
+	for (uint32_t i = 1; i < std::size( coefs ); i++)
+		largest = std::max( largest, std::fabs( coefs[i] ) );
+
+	for (auto& coef : coefs)
+	{
+		if (std::fabs( coef ) <= largest * 1e-3f)
+			coef = 0;
+	}
+
+	//	The DC term is just the average brightness, it's left out of the median.
+	float sorted[kHashSize * kHashSize - 1];
+	std::copy( std::begin( coefs ) + 1, std::end( coefs ), sorted );
+	std::nth_element( std::begin( sorted ), std::begin( sorted ) + std::size( sorted ) / 2, std::end( sorted ) );
+
+	const float median = sorted[std::size( sorted ) / 2];
+
+	hash = 0;
+	for (uint32_t i = 1; i < std::size( coefs ); i++)
+	{
+		if (coefs[i] > median)
+			hash |= 1ull << i;
+	}
+
+	return true;
+}
+
+void hash_wad_textures( const CWadFile& wad, uint32_t wad_index, std::vector<TextureHash_t>& out, uint32_t num_threads )
+{
+	std::vector<const LumpInfo_t*> lumps;
+	for (const auto lumpptr : wad.lumps())
+	{
+		if (CWadFile::is_texture_lump( lumpptr ))
+			lumps.push_back( lumpptr );
+	}
+
+	std::vector<TextureHash_t> hashes( lumps.size() );
+	std::vector<uint8_t> valid( lumps.size(), 0 );
+
+	parallel_for_weighted( lumps.size(), [&]( size_t i ) { return (uint64_t)lumps[i]->disksize; }, [&]( size_t i )
+	{
+		TextureData_t tex;
+		if (!wad.decode_texture( lumps[i], tex ) || !perceptual_hash( tex, hashes[i].hash ))
+			return;
+
+		hashes[i].name = CWadFile::lump_name( lumps[i] );
+		hashes[i].wad_index = wad_index;
+		hashes[i].lump_index = wad.lump_index( lumps[i] );
+		valid[i] = 1;
+	}, num_threads );
+
+	for (size_t i = 0; i < hashes.size(); i++)
+	{
+		if (valid[i])
+			out.push_back( std::move( hashes[i] ) );
+	}
+}
+
+void CHashIndex::add( uint64_t hash, uint32_t id )
+{
+	const uint32_t index = (uint32_t)m_nodes.size();
+	m_nodes.push_back( { hash, id, kNone, kNone, 0 } );
+
+	if (!index)
+		return;
+
+	uint32_t node = 0;
+
+	for (;;)
+	{
+		const uint32_t distance = hash_distance( m_nodes[node].hash, hash );
+
+		uint32_t child = m_nodes[node].first_child;
+		while (child != kNone && m_nodes[child].distance != distance)
+			child = m_nodes[child].next_sibling;
+
+		if (child == kNone)
+		{
+			m_nodes[index].distance = distance;
+			m_nodes[index].next_sibling = m_nodes[node].first_child;
+			m_nodes[node].first_child = index;
+			return;
+		}
+
+		node = child;
+	}
+}
+
+std::vector<CHashIndex::Match_t> CHashIndex::find( uint64_t hash, uint32_t max_distance ) const
+{
+	std::vector<Match_t> matches;
+
+	if (m_nodes.empty())
+		return matches;
+
+	std::vector<uint32_t> stack = { 0 };
+
+	while (!stack.empty())
+	{
+		const auto& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		const uint32_t distance = hash_distance( node.hash, hash );
+		if (distance <= max_distance)
+			matches.push_back( { node.id, distance } );
+
+		const uint32_t low = distance > max_distance ? distance - max_distance : 0;
+		const uint32_t high = distance + max_distance;
+
+		for (uint32_t child = node.first_child; child != kNone; child = m_nodes[child].next_sibling)
+		{
+			if (m_nodes[child].distance >= low && m_nodes[child].distance <= high)
+				stack.push_back( child );
+		}
+	}
+
+	std::sort( matches.begin(), matches.end(), []( const Match_t& a, const Match_t& b )
+	{
+		return a.distance != b.distance ? a.distance < b.distance : a.id < b.id;
+	} );
+
+	return matches;
+}
@@ -0,0 +1,81 @@
+#ifndef PERCEPTUAL_HASH_H
+#define PERCEPTUAL_HASH_H
+
+#pragma once
+
+#include <bit>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "wad.h"
+
+//	64-bit DCT hash of a texture. Mip 3 (or the smallest mip there is) is
+//	expanded to RGBA, converted to luminance and resampled to 32x32. Every bit
+//	tells whether one of the 8x8 lowest frequencies of the DCT is above their
+//	median, the bit of the DC term is always 0. Transparent pixels of '{'
+//	textures count as black.
+//
+//	Re-quantized, slightly edited or recolored copies of a texture land within
+//	a few bits of each other.
+bool perceptual_hash( const TextureData_t& tex, uint64_t& hash );
+
+inline uint32_t hash_distance( uint64_t a, uint64_t b )
+{
+	return (uint32_t)std::popcount( a ^ b );
+}
+
+struct TextureHash_t
+{
+	std::string name;
+	uint32_t wad_index;		// Chosen by whoever hashes the WAD
+	uint32_t lump_index;	// CWadFile::lump_index()
+	uint64_t hash;
+};
+
+//	Decodes and hashes every texture of an opened WAD file in parallel, the
+//	hashes are appended to out in directory order. Textures that fail to
+//	decode are skipped.
+void hash_wad_textures( const CWadFile& wad, uint32_t wad_index, std::vector<TextureHash_t>& out, uint32_t num_threads = 0 );
+
+//	BK-tree over 64-bit hashes with the Hamming distance as the metric. Every
+//	child of a node sits at a known distance from it, so by the triangle
+//	inequality a query within distance k only has to descend into children
+//	at distance [d - k, d + k], which makes small radius searches over
+//	hundreds of thousands of hashes touch only a small part of the tree.
+class CHashIndex
+{
+public:
+	struct Match_t
+	{
+		uint32_t id;
+		uint32_t distance;
+	};
+
+	void add( uint64_t hash, uint32_t id );
+
+	//	Every hash within max_distance, closest first.
+	std::vector<Match_t> find( uint64_t hash, uint32_t max_distance ) const;
+
+	void clear() { m_nodes.clear(); }
+	size_t size() const { return m_nodes.size(); }
+
+private:
+	struct Node_t
+	{
+		uint64_t hash;
+		uint32_t id;
+
+		//	Children are kept as a linked list, a node has 65 possible
+		//	distances but usually only a handful of children.
+		uint32_t first_child;
+		uint32_t next_sibling;
+		uint32_t distance;		// To the parent
+	};
+
+	static constexpr uint32_t kNone = UINT32_MAX;
+
+	std::vector<Node_t> m_nodes;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <cstring>
+
+#include "sprite.h"
+#include "byteorder.h"
+#include "metrics.h"
+
+static int32_t read_long( const uint8_t* p )
+{
+	int32_t value;
+	memcpy( &value, p, sizeof( value ) );
+	return LittleLong( value );
+}
+
+bool CSpriteFile::open()
+{
+	METRICS_TIMER( timer, "sprite.read" );
+
+	if (!m_mapping.open( m_path ))
+		return fail( m_mapping.error() );
+
+	const size_t filesize = m_mapping.size();
+	const uint8_t* base = m_mapping.data();
+
+	timer.add_bytes( filesize );
+
+	if (filesize < sizeof( SpriteHeader_t ) + sizeof( uint16_t ))
+		return fail( "The file is too small to be a sprite." );
+
+	memcpy( &m_header, base, sizeof( m_header ) );
+
+	if (memcmp( m_header.ident, "IDSP", sizeof( m_header.ident ) ))
+		return fail( "Invalid sprite id." );
+
+	m_header.version = LittleLong( m_header.version );
+	m_header.type = LittleLong( m_header.type );
+	m_header.tex_format = LittleLong( m_header.tex_format );
+	m_header.width = LittleLong( m_header.width );
+	m_header.height = LittleLong( m_header.height );
+	m_header.numframes = LittleLong( m_header.numframes );
+	m_header.synctype = LittleLong( m_header.synctype );
+
+	if (m_header.version != SPRITE_VERSION)
+		return fail( "Unsupported sprite version " + std::to_string( m_header.version ) + ", only GoldSrc sprites (2) are supported." );
+
+	if (m_header.numframes < 0)
+		return fail( "The sprite has an invalid frame count." );
+
+	size_t pos = sizeof( SpriteHeader_t );
+
+	//	A word with the number of colors, then the RGB palette.
+	uint16_t colors;
+	memcpy( &colors, base + pos, sizeof( colors ) );
+	colors = LittleShort( colors );
+	pos += sizeof( uint16_t );
+
+	if (colors > 256 || pos + colors * sizeof( ColorData_t ) > filesize)
+		return fail( "The sprite has an invalid palette." );
+
+	m_palette = reinterpret_cast<const ColorData_t*>(base + pos);
+	m_num_colors = colors;
+	pos += colors * sizeof( ColorData_t );
+
+	m_frames.clear();
+
+	for (int32_t i = 0; i < m_header.numframes; i++)
+	{
+		if (pos + sizeof( int32_t ) > filesize)
+			return fail( "Frame #" + std::to_string( i ) + " is out of the range of the sprite." );
+
+		const int32_t type = read_long( base + pos );
+		pos += sizeof( int32_t );
+
+		if (type == SPRITE_FRAME_SINGLE)
+		{
+			if (!read_frame( pos ))
+				return false;
+
+			continue;
+		}
+
+		if (type != SPRITE_FRAME_GROUP)
+			return fail( "Frame #" + std::to_string( i ) + " has an invalid type." );
+
+		//	The number of frames and their intervals, then the frames without
+		//	a type of their own.
+		if (pos + sizeof( int32_t ) > filesize)
+			return fail( "Frame group #" + std::to_string( i ) + " is out of the range of the sprite." );
+
+		const int32_t count = read_long( base + pos );
+		pos += sizeof( int32_t );
+
+		if (count < 0 || pos + (uint64_t)count * sizeof( float ) > filesize)
+			return fail( "Frame group #" + std::to_string( i ) + " has an invalid frame count." );
+
+		pos += count * sizeof( float );
+
+		for (int32_t j = 0; j < count; j++)
+		{
+			if (!read_frame( pos ))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool CSpriteFile::read_frame( size_t& pos )
+{
+	const size_t filesize = m_mapping.size();
+	const uint8_t* base = m_mapping.data();
+
+	const std::string index = std::to_string( m_frames.size() );
+
+	if (pos + sizeof( SpriteFrameHeader_t ) > filesize)
+		return fail( "Frame #" + index + " is out of the range of the sprite." );
+
+	SpriteFrameHeader_t header;
+	memcpy( &header, base + pos, sizeof( header ) );
+	pos += sizeof( header );
+
+	header.origin[0] = LittleLong( header.origin[0] );
+	header.origin[1] = LittleLong( header.origin[1] );
+	header.width = LittleLong( header.width );
+	header.height = LittleLong( header.height );
+
+	if (header.width <= 0 || header.height <= 0)
+		return fail( "Frame #" + index + " has invalid dimensions." );
+
+	const uint64_t size = (uint64_t)header.width * header.height;
+	if (pos + size > filesize)
+		return fail( "Frame #" + index + " is out of the range of the sprite." );
+
+	SpriteFrame_t frame;
+	frame.image.name = m_path.stem().string() + "_" + index;
+	frame.image.width = header.width;
+	frame.image.height = header.height;
+	frame.image.pixels = base + pos;
+	frame.image.palette = m_palette;
+	frame.image.num_colors = m_num_colors;
+	frame.origin_x = header.origin[0];
+	frame.origin_y = header.origin[1];
+
+	m_frames.push_back( std::move( frame ) );
+
+	pos += size;
+
+	return true;
+}
+
+std::string CSpriteFile::str_for_tex_format( int32_t tex_format )
+{
+	switch (tex_format)
+	{
+		case SPRITE_NORMAL: return "normal";
+		case SPRITE_ADDITIVE: return "additive";
+		case SPRITE_INDEXALPHA: return "indexalpha";
+		case SPRITE_ALPHATEST: return "alphatest";
+	}
+
+	return "unknown";
+}
+
+bool CSpriteFile::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
@@ -0,0 +1,100 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "indexed_image.h"
+#include "mapped_file.h"
+
+//	GoldSrc sprites are version 2, Quake's version 1 has no palette of its own.
+#define SPRITE_VERSION		2
+
+#define SPRITE_FRAME_SINGLE	0
+#define SPRITE_FRAME_GROUP	1
+
+//	Texture formats, tells the engine how the palette is used.
+#define SPRITE_NORMAL		0
+#define SPRITE_ADDITIVE		1
+#define SPRITE_INDEXALPHA	2	// The last color tints, the indices are the alpha
+#define SPRITE_ALPHATEST	3	// TRANSPARENT_INDEX is see-through
+
+struct SpriteHeader_t
+{
+	char	ident[4];	// IDSP
+	int32_t	version;
+	int32_t	type;		// Orientation, parallel, oriented, ...
+	int32_t	tex_format;
+	float	radius;
+	int32_t	width, height;	// Largest frame
+	int32_t	numframes;
+	float	beamlength;
+	int32_t	synctype;
+};
+
+//	Followed by width * height palette indices.
+struct SpriteFrameHeader_t
+{
+	int32_t origin[2];
+	int32_t width, height;
+};
+
+static_assert( sizeof( SpriteHeader_t ) == 40, "SpriteHeader_t has to be 40 bytes long" );
+static_assert( sizeof( SpriteFrameHeader_t ) == 16, "SpriteFrameHeader_t has to be 16 bytes long" );
+
+struct SpriteFrame_t
+{
+	//	Points into the mapped file. Named after the sprite and the position
+	//	of the frame, frames of groups are numbered the same as single ones.
+	IndexedImageView_t image;
+
+	int32_t origin_x, origin_y;
+};
+
+//	Reads the frames of a GoldSrc sprite. The file is memory mapped and the
+//	frames are views into it, the palette is shared by all of them.
+class CSpriteFile
+{
+public:
+	CSpriteFile( const std::filesystem::path& path ) :
+		m_path(path)
+	{}
+
+	CSpriteFile( const CSpriteFile& ) = delete;
+	CSpriteFile& operator=( const CSpriteFile& ) = delete;
+
+	bool open();
+
+	const std::filesystem::path& path() const { return m_path; }
+	const SpriteHeader_t& header() const { return m_header; }
+	const std::vector<SpriteFrame_t>& frames() const { return m_frames; }
+
+	const std::string& error() const { return m_error; }
+
+	static std::string str_for_tex_format( int32_t tex_format );
+
+private:
+	//	Reads a frame header and its pixels at pos, moving pos past them.
+	bool read_frame( size_t& pos );
+
+	bool fail( const std::string& msg );
+
+private:
+	std::filesystem::path m_path;
+	CMappedFile m_mapping;
+
+	SpriteHeader_t m_header = {};
+
+	const ColorData_t* m_palette = nullptr;
+	uint32_t m_num_colors = 0;
+
+	std::vector<SpriteFrame_t> m_frames;
+
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,342 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <algorithm>
+
+#include "texture_analysis.h"
+#include "mipgen.h"
+#include "parallel.h"
+
+//	Sums of a box of mip 0 pixels, the same ones generate_mip averages.
+struct BoxSum_t
+{
+	uint32_t r, g, b;
+	uint32_t n;			// Opaque pixels with a valid index
+	uint32_t holes;		// Transparent pixels
+};
+
+static bool is_power_of_two( uint32_t v )
+{
+	return v && !(v & (v - 1));
+}
+
+//	Sums 2x2 boxes of the finer level into the coarser one.
+static void downsample_sums( const std::vector<BoxSum_t>& src, uint32_t src_width, uint32_t width, uint32_t height, std::vector<BoxSum_t>& out )
+{
+	out.assign( (size_t)width * height, {} );
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			auto& dst = out[y * width + x];
+
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				const auto& s = src[(y * 2 + (i >> 1)) * src_width + x * 2 + (i & 1)];
+
+				dst.r += s.r;
+				dst.g += s.g;
+				dst.b += s.b;
+				dst.n += s.n;
+				dst.holes += s.holes;
+			}
+		}
+	}
+}
+
+bool analyze_texture( const TextureData_t& tex, TextureStats_t& stats )
+{
+	const uint32_t width = tex.width, height = tex.height;
+	const auto& src = tex.pixel_data[0];
+
+	if (!width || !height || src.size() < (size_t)width * height)
+		return false;
+
+	stats.name = tex.name;
+	stats.width = width;
+	stats.height = height;
+	stats.power_of_two = is_power_of_two( width ) && is_power_of_two( height );
+	stats.multiple_of_16 = !(width % 16) && !(height % 16);
+	stats.palette_colors = (uint32_t)tex.m_palette_data.size();
+	stats.transparent = is_transparent_texture( tex );
+
+	const auto& palette = tex.m_palette_data;
+	const uint32_t num_colors = std::min<uint32_t>( stats.palette_colors, 256 );
+	const bool transparent = stats.transparent;
+
+	auto accumulate = [&]( BoxSum_t& s, uint8_t index )
+	{
+		if (transparent && index == TRANSPARENT_INDEX)
+			s.holes++;
+		else if (index < num_colors)
+		{
+			s.r += palette[index].Red;
+			s.g += palette[index].Green;
+			s.b += palette[index].Blue;
+			s.n++;
+		}
+	};
+
+	//	The fused pass: histogram and 2x2 box sums, two rows at a time.
+	uint32_t hist[4][256] = {};
+
+	const uint32_t w1 = CWadFile::mip_width( width, 1 ), h1 = CWadFile::mip_height( height, 1 );
+	std::vector<BoxSum_t> sums[MIPLEVELS];
+	sums[1].assign( (size_t)w1 * h1, {} );
+
+	for (uint32_t y = 0; y < h1; y++)
+	{
+		const uint8_t* row0 = src.data() + (size_t)y * 2 * width;
+		const uint8_t* row1 = row0 + width;
+		BoxSum_t* box = sums[1].data() + (size_t)y * w1;
+
+		for (uint32_t x = 0; x < w1; x++)
+		{
+			const uint8_t a = row0[x * 2], b = row0[x * 2 + 1];
+			const uint8_t c = row1[x * 2], d = row1[x * 2 + 1];
+
+			hist[0][a]++;
+			hist[1][b]++;
+			hist[2][c]++;
+			hist[3][d]++;
+
+			accumulate( box[x], a );
+			accumulate( box[x], b );
+			accumulate( box[x], c );
+			accumulate( box[x], d );
+		}
+
+		//	Odd widths leave a column out of the mips.
+		if (width & 1)
+		{
+			hist[0][row0[width - 1]]++;
+			hist[1][row1[width - 1]]++;
+		}
+	}
+
+	if (height & 1)
+	{
+		const uint8_t* row = src.data() + (size_t)(height - 1) * width;
+		for (uint32_t x = 0; x < width; x++)
+			hist[x & 3][row[x]]++;
+	}
+
+	//	Histogram statistics.
+	uint64_t r = 0, g = 0, b = 0, opaque = 0;
+	uint32_t best = 0;
+
+	stats.colors_used = 0;
+
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		const uint32_t count = hist[0][i] + hist[1][i] + hist[2][i] + hist[3][i];
+		hist[0][i] = count;
+
+		if (!count)
+			continue;
+
+		stats.colors_used++;
+
+		if (count > hist[0][best])
+			best = i;
+
+		if ((transparent && i == TRANSPARENT_INDEX) || i >= num_colors)
+			continue;
+
+		r += (uint64_t)palette[i].Red * count;
+		g += (uint64_t)palette[i].Green * count;
+		b += (uint64_t)palette[i].Blue * count;
+		opaque += count;
+	}
+
+	stats.average = {};
+	if (opaque)
+		stats.average = { (uint8_t)(r / opaque), (uint8_t)(g / opaque), (uint8_t)(b / opaque) };
+
+	stats.dominant_index = (uint8_t)best;
+	stats.dominant = best < num_colors ? palette[best] : ColorData_t{};
+	stats.dominant_share = (float)hist[0][best] / ((float)width * height);
+	stats.index255_pixels = hist[0][255];
+
+	//	Mips, compared against the box sums.
+	stats.mip_error[0] = 0;
+	stats.mip_transparency_mismatches[0] = 0;
+
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+	{
+		const uint32_t w = CWadFile::mip_width( width, m ), h = CWadFile::mip_height( height, m );
+
+		if (m > 1)
+			downsample_sums( sums[m - 1], CWadFile::mip_width( width, m - 1 ), w, h, sums[m] );
+
+		stats.mip_error[m] = 0;
+		stats.mip_transparency_mismatches[m] = 0;
+
+		if (!w || !h)
+			continue;
+
+		const auto& mip = tex.pixel_data[m];
+		if (mip.size() < (size_t)w * h)
+		{
+			stats.mip_error[m] = 255.f;
+			continue;
+		}
+
+		const uint32_t box_pixels = 1 << (m * 2);
+
+		uint64_t error = 0, compared = 0;
+
+		for (uint32_t i = 0; i < w * h; i++)
+		{
+			const auto& s = sums[m][i];
+			const uint8_t index = mip[i];
+
+			const bool want_hole = transparent && s.holes * 2 > box_pixels;
+			const bool is_hole = transparent && index == TRANSPARENT_INDEX;
+
+			if (want_hole != is_hole)
+			{
+				stats.mip_transparency_mismatches[m]++;
+				continue;
+			}
+
+			if (is_hole || !s.n)
+				continue;
+
+			const ColorData_t color = index < num_colors ? palette[index] : ColorData_t{};
+
+			error += std::abs( (int32_t)(s.r / s.n) - color.Red );
+			error += std::abs( (int32_t)(s.g / s.n) - color.Green );
+			error += std::abs( (int32_t)(s.b / s.n) - color.Blue );
+			compared++;
+		}
+
+		if (compared)
+			stats.mip_error[m] = (float)error / (compared * 3);
+	}
+
+	stats.mips_consistent = mips_within_tolerance( stats, MAX_MIP_ERROR );
+
+	return true;
+}
+
+bool mips_within_tolerance( const TextureStats_t& stats, float tolerance )
+{
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+	{
+		const uint32_t pixels = CWadFile::mip_width( stats.width, m ) * CWadFile::mip_height( stats.height, m );
+
+		if (stats.mip_error[m] > tolerance || stats.mip_transparency_mismatches[m] * 100 > pixels)
+			return false;
+	}
+
+	return true;
+}
+
+void analyze_wad_textures( const std::vector<const CWadFile*>& wads, std::vector<TextureStats_t>& out, uint32_t num_threads )
+{
+	struct Job_t
+	{
+		uint32_t wad_index;
+		const LumpInfo_t* lump;
+	};
+
+	//	One flat list, so a few big WADs don't leave the other threads idle.
+	std::vector<Job_t> jobs;
+	for (uint32_t i = 0; i < (uint32_t)wads.size(); i++)
+	{
+		for (const auto lumpptr : wads[i]->lumps())
+		{
+			if (CWadFile::is_texture_lump( lumpptr ))
+				jobs.push_back( { i, lumpptr } );
+		}
+	}
+
+	std::vector<TextureStats_t> stats( jobs.size() );
+	std::vector<uint8_t> valid( jobs.size(), 0 );
+
+	parallel_for_weighted( jobs.size(), [&]( size_t i ) { return (uint64_t)jobs[i].lump->disksize; }, [&]( size_t i )
+	{
+		const auto& wad = *wads[jobs[i].wad_index];
+
+		TextureData_t tex;
+		if (!wad.decode_texture( jobs[i].lump, tex ) || !analyze_texture( tex, stats[i] ))
+			return;
+
+		stats[i].wad_index = jobs[i].wad_index;
+		stats[i].lump_index = wad.lump_index( jobs[i].lump );
+		valid[i] = 1;
+	}, num_threads );
+
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		if (valid[i])
+			out.push_back( std::move( stats[i] ) );
+	}
+}
+
+std::string json_escape( std::string_view str )
+{
+	std::string out;
+	out.reserve( str.size() );
+
+	for (const char ch : str)
+	{
+		const uint8_t c = (uint8_t)ch;
+
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += ch;
+		}
+		else if (c < 0x20 || c >= 0x7F)
+		{
+			//	Names are raw bytes, anything outside of ASCII is kept as its code.
+			char buf[8];
+			snprintf( buf, sizeof( buf ), "\\u%04x", c );
+			out += buf;
+		}
+		else
+			out += ch;
+	}
+
+	return out;
+}
+
+static void append( std::string& out, const char* format, ... )
+{
+	char buf[256];
+
+	va_list args;
+	va_start( args, format );
+	vsnprintf( buf, sizeof( buf ), format, args );
+	va_end( args );
+
+	out += buf;
+}
+
+std::string stats_to_json( const TextureStats_t& stats )
+{
+	const char* bools[] = { "false", "true" };
+
+	std::string out = "{\"name\":\"" + json_escape( stats.name ) + "\"";
+
+	append( out, ",\"lump\":%u,\"width\":%u,\"height\":%u,\"power_of_two\":%s,\"multiple_of_16\":%s",
+			stats.lump_index, stats.width, stats.height, bools[stats.power_of_two], bools[stats.multiple_of_16] );
+
+	append( out, ",\"palette_colors\":%u,\"colors_used\":%u,\"average\":[%u,%u,%u]",
+			stats.palette_colors, stats.colors_used, stats.average.Red, stats.average.Green, stats.average.Blue );
+
+	append( out, ",\"dominant\":{\"index\":%u,\"color\":[%u,%u,%u],\"share\":%.4f}",
+			stats.dominant_index, stats.dominant.Red, stats.dominant.Green, stats.dominant.Blue, stats.dominant_share );
+
+	append( out, ",\"transparent\":%s,\"index255_pixels\":%u", bools[stats.transparent], stats.index255_pixels );
+
+	append( out, ",\"mip_error\":[%.2f,%.2f,%.2f,%.2f],\"mip_transparency_mismatches\":[%u,%u,%u,%u],\"mips_consistent\":%s}",
+			stats.mip_error[0], stats.mip_error[1], stats.mip_error[2], stats.mip_error[3],
+			stats.mip_transparency_mismatches[0], stats.mip_transparency_mismatches[1], stats.mip_transparency_mismatches[2], stats.mip_transparency_mismatches[3],
+			bools[stats.mips_consistent] );
+
+	return out;
+}
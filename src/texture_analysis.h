@@ -0,0 +1,70 @@
+#ifndef TEXTURE_ANALYSIS_H
+#define TEXTURE_ANALYSIS_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "wad.h"
+
+//	Mean per channel difference between a stored mip and the box filtered
+//	mip 0 above which the mip is reported as inconsistent. Palette matching
+//	alone can be off by about this much on coarse palettes.
+#define MAX_MIP_ERROR	24.f
+
+struct TextureStats_t
+{
+	std::string name;
+	uint32_t wad_index;		// Chosen by the caller
+	uint32_t lump_index;	// CWadFile::lump_index()
+
+	uint32_t width, height;
+	bool power_of_two;
+	bool multiple_of_16;	// Required for every mip to have whole pixels
+
+	//	Mip 0 only.
+	uint32_t palette_colors;
+	uint32_t colors_used;
+	ColorData_t average;
+	ColorData_t dominant;
+	uint8_t dominant_index;
+	float dominant_share;	// 0..1
+
+	//	Transparency is only meaningful for '{' textures, but the pixels using
+	//	index 255 are counted either way.
+	bool transparent;
+	uint32_t index255_pixels;
+
+	//	Mean per channel difference of mips 1..3 from the box filtered mip 0,
+	//	and the pixels where the two disagree on being transparent. Mip 0
+	//	is always 0.
+	float mip_error[MIPLEVELS];
+	uint32_t mip_transparency_mismatches[MIPLEVELS];
+	bool mips_consistent;
+};
+
+//	Computes every statistic in a single pass over mip 0. The histogram is
+//	counted into four interleaved tables so consecutive pixels of the same
+//	color don't wait on each other, and the same pass accumulates the 2x2
+//	box sums that mips 2 and 3 are then built from.
+bool analyze_texture( const TextureData_t& tex, TextureStats_t& stats );
+
+//	Decodes and analyzes every texture of every WAD in parallel. The WADs
+//	have to be opened. Stats come out ordered by WAD and then by directory
+//	order, textures that fail to decode are skipped. wad_index is the
+//	position in wads.
+void analyze_wad_textures( const std::vector<const CWadFile*>& wads, std::vector<TextureStats_t>& out, uint32_t num_threads = 0 );
+
+//	True when every mip is within tolerance of the box filtered mip 0 and no
+//	more than 1% of its pixels disagree on transparency.
+bool mips_within_tolerance( const TextureStats_t& stats, float tolerance );
+
+//	Single line JSON object, without the path of the WAD.
+std::string stats_to_json( const TextureStats_t& stats );
+
+//	Escapes a string for use inside JSON quotes.
+std::string json_escape( std::string_view str );
+
+#endif
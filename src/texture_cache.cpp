@@ -0,0 +1,53 @@
+#include "texture_cache.h"
+
+CTextureCache::TexturePtr CTextureCache::get_texture( const CWadFile& wad, const LumpInfo_t* lump )
+{
+	const TextureKey_t key = { wad.serial(), wad.lump_index( lump ), 0, 0 };
+
+	if (auto tex = m_decoded.get( key ))
+		return tex;
+
+	auto tex = std::make_shared<TextureData_t>();
+	if (!wad.decode_texture( lump, *tex ))
+		return nullptr;
+
+	const size_t bytes = texture_bytes( *tex );
+	return m_decoded.put( key, std::move( tex ), bytes );
+}
+
+CTextureCache::BlobPtr CTextureCache::get_encoded( const CWadFile& wad, const LumpInfo_t* lump, uint32_t mip, uint32_t format, const Encoder_t& encoder )
+{
+	const TextureKey_t key = { wad.serial(), wad.lump_index( lump ), (uint8_t)mip, (uint8_t)format };
+
+	if (auto blob = m_encoded.get( key ))
+		return blob;
+
+	const auto tex = get_texture( wad, lump );
+	if (!tex)
+		return nullptr;
+
+	auto blob = std::make_shared<std::vector<uint8_t>>();
+	if (!encoder( *tex, *blob ))
+		return nullptr;
+
+	const size_t bytes = blob->capacity() + sizeof( *blob );
+	return m_encoded.put( key, std::move( blob ), bytes );
+}
+
+void CTextureCache::clear()
+{
+	m_decoded.clear();
+	m_encoded.clear();
+}
+
+size_t CTextureCache::texture_bytes( const TextureData_t& tex )
+{
+	size_t bytes = sizeof( tex ) + tex.name.capacity();
+
+	for (const auto& mip : tex.pixel_data)
+		bytes += mip.capacity();
+
+	bytes += tex.m_palette_data.capacity() * sizeof( ColorData_t );
+
+	return bytes;
+}
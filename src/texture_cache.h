@@ -0,0 +1,74 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "wad.h"
+#include "lru_cache.h"
+
+//	Identifies a texture lump, or one encoded mip of it, across all of the
+//	WAD files that are open in the process.
+struct TextureKey_t
+{
+	uint64_t wad;		// CWadFile::serial()
+	uint32_t lump;		// CWadFile::lump_index()
+
+	uint8_t	 mip;
+	uint8_t	 format;
+
+	bool operator==( const TextureKey_t& other ) const
+	{
+		return wad == other.wad && lump == other.lump && mip == other.mip && format == other.format;
+	}
+};
+
+struct TextureKeyHash_t
+{
+	size_t operator()( const TextureKey_t& key ) const
+	{
+		return (size_t)(key.wad * 0x9E3779B97F4A7C15ull) ^ ((size_t)key.lump << 16) ^ ((size_t)key.mip << 8) ^ key.format;
+	}
+};
+
+//	Memory bounded cache of decoded textures and of encoded outputs (BMP files
+//	and such) made out of them. Both halves have their own byte budget. This is
+//	meant to be used together with CWadFile::open(), instead of keeping every
+//	texture decoded through CWadFile::process().
+class CTextureCache
+{
+public:
+	using TexturePtr = std::shared_ptr<const TextureData_t>;
+	using BlobPtr = std::shared_ptr<const std::vector<uint8_t>>;
+	using Encoder_t = std::function<bool( const TextureData_t& tex, std::vector<uint8_t>& out )>;
+
+	CTextureCache( size_t decoded_budget, size_t encoded_budget, uint32_t num_shards = 16 ) :
+		m_decoded(decoded_budget, num_shards),
+		m_encoded(encoded_budget, num_shards)
+	{}
+
+	//	Returns the decoded texture, decoding it on a miss. Returns nullptr when
+	//	the lump can't be decoded.
+	TexturePtr get_texture( const CWadFile& wad, const LumpInfo_t* lump );
+
+	//	Returns the encoded output for the mip and format, encoding it with the
+	//	encoder on a miss. The format is an arbitrary id chosen by the caller.
+	BlobPtr get_encoded( const CWadFile& wad, const LumpInfo_t* lump, uint32_t mip, uint32_t format, const Encoder_t& encoder );
+
+	CacheStats_t decoded_stats() const { return m_decoded.stats(); }
+	CacheStats_t encoded_stats() const { return m_encoded.stats(); }
+
+	void clear();
+
+	//	Approximate memory used by a decoded texture.
+	static size_t texture_bytes( const TextureData_t& tex );
+
+private:
+	CShardedLruCache<TextureKey_t, TextureData_t, TextureKeyHash_t> m_decoded;
+	CShardedLruCache<TextureKey_t, std::vector<uint8_t>, TextureKeyHash_t> m_encoded;
+};
+
+#endif
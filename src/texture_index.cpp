@@ -0,0 +1,204 @@
+#include <algorithm>
+
+#include "texture_index.h"
+
+void CTextureIndex::add_wad( const CWadFile& wad, uint32_t wad_index )
+{
+	for (const auto lumpptr : wad.lumps())
+	{
+		if (CWadFile::is_texture_lump( lumpptr ))
+			add( CWadFile::lump_name( lumpptr ), wad_index, wad.lump_index( lumpptr ) );
+	}
+}
+
+void CTextureIndex::add( std::string_view name, uint32_t wad_index, uint32_t lump_index )
+{
+	m_entries.push_back( { CWadFile::lower_name( name ), wad_index, lump_index } );
+	m_built = false;
+}
+
+void CTextureIndex::build()
+{
+	//	Keep the WAD order for equal names, it decides which one the engine uses.
+	std::stable_sort( m_entries.begin(), m_entries.end(), []( const TextureRef_t& a, const TextureRef_t& b )
+	{
+		return a.name < b.name;
+	} );
+
+	m_suffixes.clear();
+	m_families.clear();
+
+	for (uint32_t i = 0; i < (uint32_t)m_entries.size(); i++)
+	{
+		const auto& name = m_entries[i].name;
+
+		for (uint32_t offset = 0; offset < (uint32_t)name.size(); offset++)
+			m_suffixes.push_back( { i, offset } );
+
+		if (!family( i ).empty())
+			m_families.push_back( i );
+	}
+
+	std::sort( m_suffixes.begin(), m_suffixes.end(), [this]( const Suffix_t& a, const Suffix_t& b )
+	{
+		return suffix( a ) < suffix( b );
+	} );
+
+	//	Stable, so the frames of a family stay sorted by name.
+	std::stable_sort( m_families.begin(), m_families.end(), [this]( uint32_t a, uint32_t b )
+	{
+		return family( a ) < family( b );
+	} );
+
+	m_built = true;
+}
+
+void CTextureIndex::clear()
+{
+	m_entries.clear();
+	m_suffixes.clear();
+	m_families.clear();
+	m_built = false;
+}
+
+std::vector<const TextureRef_t*> CTextureIndex::search( std::string_view query, ESearchMode mode, size_t limit ) const
+{
+	std::vector<const TextureRef_t*> results;
+
+	if (!m_built)
+		return results;
+
+	const auto lower = CWadFile::lower_name( query );
+
+	std::vector<uint32_t> matches;
+
+	switch (mode)
+	{
+		case ESearchMode::Prefix:
+			search_prefix( lower, matches );
+			break;
+		case ESearchMode::Substring:
+			search_substring( lower, matches );
+			break;
+		case ESearchMode::Family:
+			search_family( lower, matches );
+			break;
+		default:
+			return results;
+	}
+
+	if (limit && matches.size() > limit)
+		matches.resize( limit );
+
+	results.reserve( matches.size() );
+	for (const auto i : matches)
+		results.push_back( &m_entries[i] );
+
+	return results;
+}
+
+std::vector<const TextureRef_t*> CTextureIndex::find( std::string_view name ) const
+{
+	std::vector<const TextureRef_t*> results;
+
+	if (!m_built)
+		return results;
+
+	const auto lower = CWadFile::lower_name( name );
+
+	auto range = std::equal_range( m_entries.begin(), m_entries.end(), TextureRef_t{ lower, 0, 0 }, []( const TextureRef_t& a, const TextureRef_t& b )
+	{
+		return a.name < b.name;
+	} );
+
+	for (auto it = range.first; it != range.second; ++it)
+		results.push_back( &*it );
+
+	return results;
+}
+
+void CTextureIndex::search_prefix( std::string_view query, std::vector<uint32_t>& out ) const
+{
+	const auto begin = std::lower_bound( m_entries.begin(), m_entries.end(), query, []( const TextureRef_t& entry, std::string_view q )
+	{
+		return entry.name < q;
+	} );
+
+	for (auto it = begin; it != m_entries.end() && it->name.compare( 0, query.size(), query ) == 0; ++it)
+		out.push_back( (uint32_t)(it - m_entries.begin()) );
+}
+
+void CTextureIndex::search_substring( std::string_view query, std::vector<uint32_t>& out ) const
+{
+	if (query.empty())
+	{
+		for (uint32_t i = 0; i < (uint32_t)m_entries.size(); i++)
+			out.push_back( i );
+
+		return;
+	}
+
+	//	Every suffix starting with the query is an occurrence of it.
+	auto it = std::lower_bound( m_suffixes.begin(), m_suffixes.end(), query, [this]( const Suffix_t& s, std::string_view q )
+	{
+		return suffix( s ) < q;
+	} );
+
+	for (; it != m_suffixes.end() && suffix( *it ).substr( 0, query.size() ) == query; ++it)
+		out.push_back( it->entry );
+
+	//	A name can contain the query more than once.
+	std::sort( out.begin(), out.end() );
+	out.erase( std::unique( out.begin(), out.end() ), out.end() );
+}
+
+void CTextureIndex::search_family( std::string_view query, std::vector<uint32_t>& out ) const
+{
+	auto name = family_name( query );
+	if (name.empty())
+		name = query;
+
+	auto it = std::lower_bound( m_families.begin(), m_families.end(), name, [this]( uint32_t entry, std::string_view q )
+	{
+		return family( entry ) < q;
+	} );
+
+	for (; it != m_families.end() && family( *it ) == name; ++it)
+		out.push_back( *it );
+}
+
+std::string_view CTextureIndex::family_name( std::string_view name, char* frame )
+{
+	if (name.size() < 3)
+		return {};
+
+	const char c = (char)tolower( (uint8_t)name[1] );
+
+	const bool animated = name[0] == '+' && ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'j'));
+	const bool tiled = name[0] == '-' && (c >= '0' && c <= '9');
+
+	if (!animated && !tiled)
+		return {};
+
+	if (frame)
+		*frame = c;
+
+	return name.substr( 2 );
+}
+
+const char* CTextureIndex::str_for_mode( ESearchMode mode )
+{
+	switch (mode)
+	{
+		case ESearchMode::Prefix:
+			return "prefix";
+		case ESearchMode::Substring:
+			return "substring";
+		case ESearchMode::Family:
+			return "family";
+		default:
+			break;
+	}
+
+	return "n/a";
+}
@@ -0,0 +1,88 @@
+#ifndef TEXTURE_INDEX_H
+#define TEXTURE_INDEX_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+
+#include "wad.h"
+
+enum class ESearchMode : uint32_t
+{
+	//	Names starting with the query.
+	Prefix,
+
+	//	Names containing the query anywhere.
+	Substring,
+
+	//	Every frame of an animated (+0..+9, +a..+j) or random tiled (-0..-9)
+	//	texture. The query can be the base name or the name of any frame.
+	Family,
+
+	SearchModeCount
+};
+
+struct TextureRef_t
+{
+	std::string name;		// Lower case
+	uint32_t wad_index;		// Chosen by whoever adds the WAD
+	uint32_t lump_index;	// CWadFile::lump_index()
+};
+
+//	Name index over the texture lumps of any number of WAD files. The names are
+//	kept sorted together with a suffix array over them, so every kind of query
+//	is a binary search. Searches are case insensitive.
+//
+//	Add the textures first, then call build() once before searching.
+class CTextureIndex
+{
+public:
+	void add_wad( const CWadFile& wad, uint32_t wad_index );
+	void add( std::string_view name, uint32_t wad_index, uint32_t lump_index );
+
+	void build();
+
+	//	Results are sorted by name. A limit of 0 returns every match.
+	std::vector<const TextureRef_t*> search( std::string_view query, ESearchMode mode, size_t limit = 0 ) const;
+
+	//	Every texture with exactly this name, in the order the WADs were added.
+	std::vector<const TextureRef_t*> find( std::string_view name ) const;
+
+	void clear();
+
+	const std::vector<TextureRef_t>& entries() const { return m_entries; }
+	bool is_built() const { return m_built; }
+
+	//	Name of the family without the frame prefix, empty when the name isn't
+	//	part of one. The frame ('0'-'9', 'a'-'j') is returned through frame.
+	static std::string_view family_name( std::string_view name, char* frame = nullptr );
+
+	static const char* str_for_mode( ESearchMode mode );
+
+private:
+	struct Suffix_t
+	{
+		uint32_t entry;
+		uint32_t offset;
+	};
+
+	//	Indices into the entries instead of views, so the index can be copied.
+	std::string_view suffix( const Suffix_t& s ) const { return std::string_view( m_entries[s.entry].name ).substr( s.offset ); }
+	std::string_view family( uint32_t entry ) const { return family_name( m_entries[entry].name ); }
+
+	void search_prefix( std::string_view query, std::vector<uint32_t>& out ) const;
+	void search_substring( std::string_view query, std::vector<uint32_t>& out ) const;
+	void search_family( std::string_view query, std::vector<uint32_t>& out ) const;
+
+private:
+	std::vector<TextureRef_t> m_entries;
+	std::vector<Suffix_t> m_suffixes;
+	std::vector<uint32_t> m_families;		// Entries that are part of a family
+
+	bool m_built = false;
+};
+
+#endif
@@ -1,162 +1,312 @@
 #include <iostream>
 #include <fstream>
-#include <windows.h>
+#include <cstdarg>
+#include <cstring>
 
 #include "wad.h"
 #include "bmp.h"
+#include "parallel.h"
+#include "wad_compression.h"
+#include "metrics.h"
 
 #define ADDR "0x%08X"
 
+CWadFile::~CWadFile()
+{
+	deallocate_buf();
+}
+
 bool CWadFile::process()
 {
-	printf( "WAD file process begin\n" );
-	printf( "--------------------------------------\n" );
+	log( "WAD file process begin\n" );
+	log( "--------------------------------------\n" );
 
 	m_start_timestamp = std::chrono::high_resolution_clock::now();
 
-	const uint32_t filesize = std::filesystem::file_size( m_path );
-
-	if (!(m_buffer = get_buffer_ptr( filesize )))
+	if (!open() || !decode_all())
 	{
-		printf( "Error: Couldn't get buffer pointer.\n" );
+		log( "--------------------------------------\n" );
 		return false;
 	}
 
+	log( " ... OK\n" );
+	log( "Finished!\n" );
+
+	double duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+		std::chrono::high_resolution_clock::now() - m_start_timestamp).count();
+
+	if (duration > 1000)
+		log( "Took %0.4f seconds to process!\nWOAH that's a big WAD file!\n", duration / 1000.0 );
+	else
+		log( "Took %0.4f milliseconds to process!\n", duration );
+
+	log( "--------------------------------------\n" );
+
+	return true;
+}
+
+bool CWadFile::open()
+{
+	if (m_buffer)
+		return !m_failed;
+
+	std::error_code ec;
+	const auto filesize = std::filesystem::file_size( m_path, ec );
+
+	if (ec)
+		return fail( "Couldn't get the size of the file. (%s)\n", ec.message().c_str() );
+
+	if (filesize < sizeof( WadHeader_t ) || filesize > UINT32_MAX)
+		return fail( "Invalid filesize. (%llu bytes)\n", (unsigned long long)filesize );
+
+	m_filesize = (uint32_t)filesize;
+
+	if (m_memory_mapped)
+	{
+		METRICS_TIMER( timer, "wad.map" );
+
+		if (!m_mapping.open( m_path ))
+			return fail( "%s\n", m_mapping.error().c_str() );
+
+		m_buffer = m_mapping.data();
+		m_filesize = (uint32_t)m_mapping.size();
+		timer.add_bytes( m_filesize );
+
+		log( "Mapped file with size %d\n", m_filesize );
+	}
+	else if (!(m_buffer = get_buffer_ptr( m_filesize )))
+		return fail( "Couldn't get buffer pointer.\n" );
+
+	//	The buffer is ours, so the header and the directory are converted to
+	//	the host byte order in place.
 	m_wadheader = reinterpret_cast<WadHeader_t*>(m_buffer);
+	SwapWadHeader( *m_wadheader );
 
 	//	Create a null-terminated wad ID.
 	m_wad_id.reserve( 4 );
 	for (uint32_t i = 0; i < 4; i++)
 		m_wad_id.push_back( m_wadheader->identification[i] );
-	
+
 	if (!check_wad_id( m_wad_id ))
-	{
-		printf( "Error: Invalid WAD id. (%s)\n", m_wad_id.c_str() );
-		return false;
-	}
+		return fail( "Invalid WAD id. (%s)\n", m_wad_id.c_str() );
 
-	m_wad_id.push_back( '\0' );
+	//	The lump directory has to fit into the file entirely.
+	const uint64_t infotable_end = (uint64_t)m_wadheader->infotableofs + (uint64_t)m_wadheader->numlumps * sizeof( LumpInfo_t );
+	if (infotable_end > m_filesize)
+		return fail( "The lump directory is out of the range of the WAD file.\n" );
 
 	//	Base address of the lump information located inside the wadfile.
 	m_lumps_base = m_buffer + m_wadheader->infotableofs;
 
-	printf( "Base of lumps located at " ADDR "\n", (uint32_t)m_lumps_base );
+	log( "Base of lumps located at " ADDR "\n", m_wadheader->infotableofs );
+
+	METRICS_TIMER( timer, "wad.lump_walk" );
+	timer.add_bytes( (uint64_t)m_wadheader->numlumps * sizeof( LumpInfo_t ) );
 
 	for (uint32_t i = 0; i < m_wadheader->numlumps; i++)
 	{
-		printf( "\rProcessing lump #%d", i );
+		log( "\rProcessing lump #%d", i );
 
 		const auto lumpptr = reinterpret_cast<LumpInfo_t*>(m_lumps_base + i * sizeof( LumpInfo_t ));
-
-		if ((uint8_t*)lumpptr > m_buffer + filesize)
-		{
-			printf( "\nError: The lump data pointer is out of the range of the WAD file.\n" );
-			m_failed = true;
-			break;
-		}
+		SwapLumpInfo( *lumpptr );
 
 		//	Something went wrong. Some wad files are fucked up, and we have to check for
 		//	them stupidly like this.
 		if (!is_lump_valid( lumpptr ))
-		{
-			printf( "\nError: This WAD file constains corrupted information.\n" );
-			m_failed = true;
-			break;
-		}
+			return fail( "\nThis WAD file constains corrupted information.\n" );
 
 		if (!check_lump_size( lumpptr ))
-		{
-			printf( "\nError: Lump #%d don't fit into max size. (%d bytes) %d bytes exceeded.\n", i, MAXLUMP, lumpptr->size - MAXLUMP );
-			m_failed = true;
-			break;
-		}
+			return fail( "\nLump #%d don't fit into max size. (%d bytes) %d bytes exceeded.\n", i, MAXLUMP, lumpptr->size - MAXLUMP );
+
+		if ((uint64_t)lumpptr->filepos + (uint64_t)lumpptr->disksize > m_filesize)
+			return fail( "\nThe lump data pointer is out of the range of the WAD file.\n" );
 
 		m_lumps.emplace_back( lumpptr );
+	}
+
+	return true;
+}
 
-		const auto miptexptr = reinterpret_cast<MipTexture_t*>(m_buffer + lumpptr->filepos);
+bool CWadFile::decode_all()
+{
+	if (!m_buffer || m_failed)
+		return false;
 
-		if ((uint8_t*)miptexptr > m_buffer + filesize)
-		{
-			printf( "\nError: The texture data pointer is out of the range of the WAD file.\n" );
-			m_failed = true;
-			break;
-		}
+	METRICS_SCOPE( "wad.decode_all" );
 
-		if (!is_texture_valid( miptexptr ))
+	//	Directory positions of the texture lumps.
+	std::vector<uint32_t> texture_lumps;
+	for (uint32_t i = 0; i < m_lumps.size(); i++)
+	{
+		if (is_texture_lump( m_lumps[i] ))
+			texture_lumps.push_back( i );
+	}
+
+	m_texturedata.clear();
+	m_texturedata.resize( texture_lumps.size() );
+	m_warnings.clear();
+
+	//	Every thread writes only its own slots.
+	std::vector<uint8_t> decoded( texture_lumps.size(), 0 );
+	std::vector<std::string> errors( texture_lumps.size() );
+
+	parallel_for_weighted( texture_lumps.size(),
+		[&]( size_t i )
 		{
-			printf( "\nError: This WAD file constains corrupted information.\n" );
-			m_failed = true;
-			break;
-		}
+			return (uint64_t)m_lumps[texture_lumps[i]]->disksize;
+		},
+		[&]( size_t i )
+		{
+			decoded[i] = decode_texture( m_lumps[texture_lumps[i]], m_texturedata[i], errors[i] );
+		},
+		m_num_threads );
 
-		TextureData_t tex;
-		tex.name = miptexptr->name;
-		tex.width = miptexptr->width;
-		tex.height = miptexptr->height;
+	//	A broken lump only costs its own texture, the rest of the file is
+	//	still usable.
+	std::deque<TextureData_t> textures;
 
-		for (uint32_t m = 0; m < MIPLEVELS; m++)
+	for (size_t i = 0; i < texture_lumps.size(); i++)
+	{
+		if (decoded[i])
 		{
-			//	Each mip is smaller by a half. That means that the n'th mip will be
-			//	1 / (2 ^ n) pixels in size from the biggest mip.
-			const float scale = 1.f / (1 << m);
+			textures.push_back( std::move( m_texturedata[i] ) );
+			continue;
+		}
 
-			uint32_t width = tex.width * scale;
-			uint32_t height = tex.height * scale;
+		m_warnings.push_back( "Lump #" + std::to_string( texture_lumps[i] ) + " (" + lump_name( m_lumps[texture_lumps[i]] ) + ") was skipped: " + errors[i] );
+		log( "\nWarning: %s\n", m_warnings.back().c_str() );
+	}
 
-			tex.pixel_data[m].resize( width * height );
+	m_texturedata = std::move( textures );
 
-			uint8_t* pixeldata_base = (uint8_t*)miptexptr + miptexptr->offsets[m];
+	return true;
+}
 
-			//	Copy the pixel data row by row
-			for (uint32_t h = 0; h < height; h++)
-				memcpy( tex.pixel_data[m].data() + h * width, pixeldata_base + h * width, width );
-		}
+bool CWadFile::decode_texture( const LumpInfo_t* lump, TextureData_t& out ) const
+{
+	std::string error;
+	return decode_texture( lump, out, error );
+}
 
-		const uint32_t last_mip_pixel_data_size = tex.pixel_data[MIPLEVELS - 1].size();
-		uint8_t* palette_base = (uint8_t*)miptexptr + miptexptr->offsets[MIPLEVELS - 1] + last_mip_pixel_data_size;
-		
-		//	There's a word after the pixel data specifying how many colors 
-		//	are inside the palette.
-		uint16_t* palette_colors = (uint16_t*)palette_base;
-		tex.m_palette_colors = *palette_colors;
+bool CWadFile::decode_texture( const LumpInfo_t* lump, TextureData_t& out, std::string& error ) const
+{
+	if (!m_buffer || !lump)
+	{
+		error = "The WAD file isn't open.";
+		return false;
+	}
 
-		//	The palette data is right after that word.
-		const uint32_t word_padding = sizeof(uint16_t);
-		uint8_t* pcolordata = palette_base + word_padding;
+	const uint8_t* miptex = m_buffer + lump->filepos;
 
-		tex.m_palette_data.resize( tex.m_palette_colors );
+	//	Every lump is compressed on its own, so only this one is inflated.
+	//	Stored lumps are decoded right out of the file.
+	std::vector<uint8_t> inflated;
+	if (lump->compression != LUMP_COMPRESSION_NONE || lump->disksize != lump->size)
+	{
+		if (!read_lump( lump, inflated, error ))
+			return false;
 
-		//	The palette is located after the pixel data of last mip, and after a 2-byte word.
-		for (uint32_t entry = 0; entry < tex.m_palette_colors; entry++)
-		{
-			tex.m_palette_data[entry].Red = *pcolordata++;
-			tex.m_palette_data[entry].Green = *pcolordata++;
-			tex.m_palette_data[entry].Blue = *pcolordata++;
-		}
+		miptex = inflated.data();
+	}
 
-		m_texturedata.push_back( tex );
+	if (!decode_miptex( miptex, lump->size, out ))
+	{
+		error = "The texture data is corrupted.";
+		return false;
 	}
 
-	if (m_failed)
+	return true;
+}
+
+bool CWadFile::read_lump( const LumpInfo_t* lump, std::vector<uint8_t>& out ) const
+{
+	std::string error;
+	return read_lump( lump, out, error );
+}
+
+bool CWadFile::read_lump( const LumpInfo_t* lump, std::vector<uint8_t>& out, std::string& error ) const
+{
+	if (!m_buffer || !lump)
 	{
-		printf( "--------------------------------------\n" );
+		error = "The WAD file isn't open.";
 		return false;
 	}
 
-	printf(" ... OK\n");
-	printf( "Finished!\n" );
+	return decompress_lump( m_buffer + lump->filepos, lump->disksize, lump->size, lump->compression, out, error );
+}
 
-	double duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
-		std::chrono::high_resolution_clock::now() - m_start_timestamp).count();
+IndexedImageView_t TextureData_t::mip_image( uint32_t mip ) const
+{
+	return {
+		name,
+		CWadFile::mip_width( width, mip ), CWadFile::mip_height( height, mip ),
+		pixel_data[mip].data(),
+		m_palette_data.data(), (uint32_t)m_palette_data.size()
+	};
+}
 
-	if (duration > 1000)
-		printf( "Took %0.4f seconds to process!\nWOAH that's a big WAD file!\n", duration / 1000.0 );
-	else
-		printf( "Took %0.4f milliseconds to process!\n", duration );
+bool CWadFile::decode_miptex( const uint8_t* miptex_base, uint32_t miptex_size, TextureData_t& out )
+{
+	if (miptex_size < sizeof( MipTexture_t ))
+		return false;
+
+	METRICS_TIMER( timer, "texture.mip_copy" );
 
-	//deallocate_buf();
+	//	The miptex can lay anywhere inside the buffer, so copy it out instead
+	//	of accessing it unaligned.
+	MipTexture_t miptex;
+	memcpy( &miptex, miptex_base, sizeof( miptex ) );
+	SwapMipTexture( miptex );
+
+	if (!is_texture_valid( &miptex ))
+		return false;
+
+	out.name.assign( miptex.name, strnlen( miptex.name, sizeof( miptex.name ) ) );
+	out.width = miptex.width;
+	out.height = miptex.height;
+
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+	{
+		//	Each mip is smaller by a half. That means that the n'th mip will be
+		//	1 / (2 ^ n) pixels in size from the biggest mip.
+		const uint32_t width = mip_width( out.width, m );
+		const uint32_t height = mip_height( out.height, m );
+
+		if ((uint64_t)miptex.offsets[m] + (uint64_t)width * height > miptex_size)
+			return false;
+
+		//	The rows are stored right after each other, so the whole mip is
+		//	copied at once.
+		const uint8_t* pixeldata_base = miptex_base + miptex.offsets[m];
+		out.pixel_data[m].assign( pixeldata_base, pixeldata_base + width * height );
+	}
 
-	printf( "--------------------------------------\n" );
+	const uint32_t last_mip_pixel_data_size = out.pixel_data[MIPLEVELS - 1].size();
+	const uint64_t palette_ofs = (uint64_t)miptex.offsets[MIPLEVELS - 1] + last_mip_pixel_data_size;
+
+	if (palette_ofs + sizeof( uint16_t ) > miptex_size)
+		return false;
+
+	const uint8_t* palette_base = miptex_base + palette_ofs;
+
+	//	There's a word after the pixel data specifying how many colors
+	//	are inside the palette.
+	memcpy( &out.m_palette_colors, palette_base, sizeof( uint16_t ) );
+	out.m_palette_colors = LittleShort( out.m_palette_colors );
+
+	//	The palette data is right after that word.
+	const uint32_t word_padding = sizeof( uint16_t );
+	const uint8_t* pcolordata = palette_base + word_padding;
+
+	if (palette_ofs + word_padding + out.m_palette_colors * 3ull > miptex_size)
+		return false;
+
+	//	The palette is located after the pixel data of last mip, and after a 2-byte word.
+	//	ColorData_t has the same layout as the RGB triplets on disk.
+	const auto pcolors = reinterpret_cast<const ColorData_t*>(pcolordata);
+	out.m_palette_data.assign( pcolors, pcolors + out.m_palette_colors );
+
+	timer.add_bytes( palette_ofs + word_padding + out.m_palette_colors * 3ull - miptex.offsets[0] );
 
 	return true;
 }
@@ -188,7 +338,7 @@ void CWadFile::dump_wad_lumps()
 	printf( " Lump information:\n" );
 	printf( "\n" );
 
-	printf( "Base of lumps located at " ADDR "\n", (uint32_t)m_lumps_base );
+	printf( "Base of lumps located at " ADDR "\n", m_wadheader->infotableofs );
 	printf( "\n" );
 	printf( "ID   Offset to data   Disk size (KiB)  Uncompressed size (KiB)   Type       Compression   Name\n" );
 
@@ -196,13 +346,11 @@ void CWadFile::dump_wad_lumps()
 
 	for (const auto lumpptr : m_lumps)
 	{
-		const char compression_str[2] = { lumpptr->compression, '\0' };
-
-		printf( "%-4d " ADDR "       %-7.3f          %-7.3f                   %-7s    %3s           ",
+		printf( "%-4d " ADDR "       %-7.3f          %-7.3f                   %-7s    %-7s       ",
 				++n,
 				lumpptr->filepos,
 				lumpptr->disksize / 1024.f, lumpptr->size / 1024.f,
-				str_for_lump_type( lumpptr->type ).c_str(), lumpptr->compression ? compression_str : "n/a" );
+				str_for_lump_type( lumpptr->type ).c_str(), str_for_compression( lumpptr->compression ) );
 
 		lump_disk_size_sum += lumpptr->disksize;
 
@@ -239,100 +387,135 @@ void CWadFile::dump_wad_texture_data()
 	printf( "\n" );
 }
 
-bool CWadFile::export_images_from_wad(const std::filesystem::path& to, uint32_t miplevel)
+void CWadFile::add_image_files( const std::filesystem::path& to, uint32_t miplevel, std::vector<ImageFile_t>& files ) const
 {
-	if (miplevel > MIPLEVELS)
+	static const char* const suffixes[MIPLEVELS] = { "", "_medium", "_small", "_smallest" };
+
+	for (const auto& tex : m_texturedata)
 	{
-		printf("Error: Invalid mip level specified (%d).Maximum is %d", miplevel, MIPLEVELS );
-		return false;
+		for (uint32_t m = 0; m < miplevel && m < MIPLEVELS; m++)
+			files.push_back( { to / (tex.name + suffixes[m] + ".bmp"), tex.mip_image( m ) } );
 	}
+}
+
+bool CWadFile::export_images_from_wad(const std::filesystem::path& to, uint32_t miplevel)
+{
+	if (miplevel > MIPLEVELS)
+		return fail( "Invalid mip level specified (%d).Maximum is %d\n", miplevel, MIPLEVELS );
 
 	auto start_timestamp = std::chrono::high_resolution_clock::now();
 
-	uint32_t n = 0;
-	float percentage = 0;
-	for (auto& tex : m_texturedata)
-	{
-		for (uint32_t m = 0; m < miplevel; m++)
-		{
-			std::string filename = to.string() + tex.name;
-
-			switch (m)
-			{
-				case 0: break;
-				case 1: filename += "_medium"; break;
-				case 2: filename += "_small"; break;
-				case 3: filename += "_smallest"; break;
-			}
-
-			filename += ".bmp";
-
-			uint8_t* pixel_data = tex.pixel_data[m].data();
-			uint8_t* palette_data = (uint8_t*)tex.m_palette_data.data();
-
-			const float scale = 1.f / (1 << m);
-
-			uint32_t width = tex.width * scale;
-			uint32_t height = tex.height * scale;
-
-			if (CBitMap::Write(
-				filename.c_str(), 
-				width, height, 
-				pixel_data, 
-				palette_data
-			) != EBMPResult::Success)
-			{
-				printf("Error: Couldn't export texture #%d:\n", n);
-				printf("%s\n", filename.c_str() );
-				return false;
-			}
-
-			percentage = float(float(n + m) / float(m_texturedata.size() * miplevel)) * 100.f;
-
-			if (n == m_texturedata.size() - 1)
-				percentage = 100.f;
-
-			const auto path = std::filesystem::path( filename ).filename();
-			printf("\r                                                                               ");
-			printf("\rExporting texture... (%0.1f%%) %s", percentage, path.string().c_str());
-		}
-		n++;
-	}
+	METRICS_SCOPE( "wad.export" );
+
+	std::vector<ImageFile_t> files;
+	add_image_files( to, miplevel, files );
+
+	log( "Exporting %d images...\n", (uint32_t)files.size() );
+
+	std::string error;
+	if (!write_bmp_images( files, error, m_num_threads ))
+		return fail( "Couldn't export texture:\n%s\n", error.c_str() );
 
 	double duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
-		std::chrono::high_resolution_clock::now() - m_start_timestamp).count();
+		std::chrono::high_resolution_clock::now() - start_timestamp).count();
 
-	printf( "\n" );
-	printf( "\n" );
+	log( "\n" );
 
 	if (duration > 1000)
-		printf( "Took %0.4f seconds to export %d images!\n", duration / 1000.0, n );
+		log( "Took %0.4f seconds to export %d images!\n", duration / 1000.0, (uint32_t)files.size() );
 	else
-		printf( "Took %0.4f milliseconds to export %d images!\n", duration, n );
+		log( "Took %0.4f milliseconds to export %d images!\n", duration, (uint32_t)files.size() );
 
-	printf( "\nDONE!\n" );
+	log( "\nDONE!\n" );
 
 	return true;
 }
 
+const LumpInfo_t* CWadFile::find_lump( std::string_view name ) const
+{
+	for (const auto lumpptr : m_lumps)
+	{
+		if (names_equal( std::string_view( lumpptr->name, strnlen( lumpptr->name, sizeof( lumpptr->name ) ) ), name ))
+			return lumpptr;
+	}
+
+	return nullptr;
+}
+
+const TextureData_t* CWadFile::find_texture( std::string_view name ) const
+{
+	for (const auto& tex : m_texturedata)
+	{
+		if (names_equal( tex.name, name ))
+			return &tex;
+	}
+
+	return nullptr;
+}
+
+const uint8_t* CWadFile::lump_data( const LumpInfo_t* lump ) const
+{
+	if (!m_buffer || !lump)
+		return nullptr;
+
+	return m_buffer + lump->filepos;
+}
+
+uint32_t CWadFile::lump_index( const LumpInfo_t* lump ) const
+{
+	return (uint32_t)(reinterpret_cast<const uint8_t*>(lump) - m_lumps_base) / sizeof( LumpInfo_t );
+}
+
+bool CWadFile::names_equal( std::string_view a, std::string_view b )
+{
+	if (a.size() != b.size())
+		return false;
+
+	//	The engine treats texture names case-insensitively.
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (tolower( (uint8_t)a[i] ) != tolower( (uint8_t)b[i] ))
+			return false;
+	}
+
+	return true;
+}
+
+//	Key for lookups that have to agree with names_equal().
+std::string CWadFile::lower_name( std::string_view name )
+{
+	std::string out( name );
+
+	for (auto& c : out)
+		c = (char)tolower( (uint8_t)c );
+
+	return out;
+}
+
 bool CWadFile::check_wad_id( const std::string& id )
 {
 	return id == "WAD3" || id == "WAD2";
 }
 
-bool CWadFile::is_lump_valid( LumpInfo_t* lump )
+bool CWadFile::is_lump_valid( const LumpInfo_t* lump )
 {
-	if (!lump->filepos || !lump->disksize || !lump->size)
+	if (!lump->filepos || lump->disksize <= 0 || lump->size <= 0)
 		return false;
 
 	return true;
 }
 
-bool CWadFile::check_lump_size( LumpInfo_t* lump )
+bool CWadFile::check_lump_size( const LumpInfo_t* lump )
 {
 	return lump->size < MAXLUMP;
 }
 
+bool CWadFile::is_texture_lump( const LumpInfo_t* lump )
+{
+	//	Both of these are stored as a MipTexture_t.
+	return lump->type == LUMP_TYPE_TEXTURE || lump->type == LUMP_TYPE_DECAL;
+}
+
 std::string CWadFile::str_for_lump_type( char type )
 {
 	switch (type)
@@ -350,7 +533,12 @@ std::string CWadFile::str_for_lump_type( char type )
 	return "n/a";
 }
 
-bool CWadFile::is_texture_valid( MipTexture_t* miptex )
+std::string CWadFile::lump_name( const LumpInfo_t* lump )
+{
+	return std::string( lump->name, strnlen( lump->name, sizeof( lump->name ) ) );
+}
+
+bool CWadFile::is_texture_valid( const MipTexture_t* miptex )
 {
 	if (!miptex->width || !miptex->height || !miptex->offsets[0])
 		return false;
@@ -365,7 +553,12 @@ uint8_t* CWadFile::allocate_buf( uint32_t size )
 
 void CWadFile::deallocate_buf()
 {
-	if (m_buffer)
+	if (m_mapping.is_open())
+	{
+		m_mapping.close();
+		m_buffer = nullptr;
+	}
+	else if (m_buffer)
 	{
 		delete[] m_buffer;
 		m_buffer = nullptr;
@@ -378,28 +571,74 @@ uint8_t* CWadFile::get_buffer_ptr( uint32_t filesize )
 
 	if (!ifs.good())
 	{
-		printf( "Error: Couldn't open input file for reading.\n" );
+		fail( "Couldn't open input file for reading.\n" );
 		return nullptr;
 	}
 
 	if (!filesize)
 	{
-		printf( "Error: Invalid filesize.\n" );
+		fail( "Invalid filesize.\n" );
 		return nullptr;
 	}
 
+	METRICS_TIMER( timer, "wad.read" );
+
 	uint8_t* buf = nullptr;
 	if (!(buf = allocate_buf( filesize )))
 	{
-		printf( "Error: Couldn't allocate buffer.\n" );
+		fail( "Couldn't allocate buffer.\n" );
 		return nullptr;
 	}
 
 	ifs.read( (char*)buf, filesize );
 
-	printf( "Allocated buffer at 0x%08X with size %d\n", (uint32_t)buf, filesize );
+	if ((uint32_t)ifs.gcount() != filesize)
+	{
+		delete[] buf;
+		fail( "Couldn't read the whole file.\n" );
+		return nullptr;
+	}
+
+	timer.add_bytes( filesize );
+
+	log( "Allocated buffer with size %d\n", filesize );
 
 	ifs.close();
 
 	return buf;
 }
+
+void CWadFile::log( const char* fmt, ... ) const
+{
+	if (!m_verbose)
+		return;
+
+	va_list args;
+	va_start( args, fmt );
+	vprintf( fmt, args );
+	va_end( args );
+}
+
+bool CWadFile::fail( const char* fmt, ... )
+{
+	char msg[512];
+
+	va_list args;
+	va_start( args, fmt );
+	vsnprintf( msg, sizeof( msg ), fmt, args );
+	va_end( args );
+
+	//	Messages can start with a new line to break out of a progress line.
+	const bool newline = msg[0] == '\n';
+
+	m_error = newline ? msg + 1 : msg;
+	while (!m_error.empty() && m_error.back() == '\n')
+		m_error.pop_back();
+
+	m_failed = true;
+
+	if (m_verbose)
+		printf( "%sError: %s\n", newline ? "\n" : "", m_error.c_str() );
+
+	return false;
+}
@@ -5,10 +5,18 @@
 
 #include <deque>
 #include <chrono>
+#include <atomic>
 #include <climits>
 #include <array>
+#include <vector>
+#include <string>
+#include <string_view>
 #include <filesystem>
 
+#include "byteorder.h"
+#include "mapped_file.h"
+#include "indexed_image.h"
+
 //	Windows.h stupidity.
 #ifdef max
 #	undef max
@@ -25,8 +33,8 @@
 #define LUMP_TYPE_FONT		'F' // 0x46
 #define LUMP_TYPE_CACHE		'@' // 0x40
 
-//	Wad file is made out of lumps. Each lump contains the 
-//	file position offset where the specific information 
+//	Wad file is made out of lumps. Each lump contains the
+//	file position offset where the specific information
 //	belonging to the lump is located.
 struct LumpInfo_t
 {
@@ -49,15 +57,9 @@ struct MipTexture_t
 	uint32_t width, height;
 
 	//	Contains relative offset from the base of this
-	//	structure. The pixel data for the first mip 
+	//	structure. The pixel data for the first mip
 	//	should lay on -> baseofmip + sizeof(MipTexture_t).
-	uint32_t offsets[MIPLEVELS]; 
-};
-
-//	Palette contains of 256-color data
-struct ColorData_t
-{
-	uint8_t Red, Green, Blue;
+	uint32_t offsets[MIPLEVELS];
 };
 
 //	Texture data we can obtain from the MipTexture_t
@@ -71,16 +73,19 @@ struct TextureData_t
 
 	//	After the pixel data for last mip is a word which specifies how many colors
 	//	there are inside the palette and right after that there's the palette data.
-	//	
+	//
 	//	The palette consists of three 1-byte color data - RGB.
-	//	There are usually 256 colors in each entry, because the byte is 8-bits in length, 
+	//	There are usually 256 colors in each entry, because the byte is 8-bits in length,
 	//	that means one byte can hold max up to 256 values:
 	//	[0 - 256) values -> 2 ^ sizeof(byte) == 256
 	uint16_t m_palette_colors;
 	std::vector<ColorData_t> m_palette_data;
+
+	//	The mip as an indexed image, valid as long as the texture is.
+	IndexedImageView_t mip_image( uint32_t mip ) const;
 };
 
-//	This is the information about the wad file that is 
+//	This is the information about the wad file that is
 //	in the beggining of the buffer.
 struct WadHeader_t
 {
@@ -90,58 +95,200 @@ struct WadHeader_t
 	uint32_t infotableofs;
 };
 
+//	The structures above are read straight out of the file buffer, so their
+//	layout has to match the on-disk layout exactly.
+static_assert( sizeof( LumpInfo_t ) == 32, "LumpInfo_t has to be 32 bytes long" );
+static_assert( sizeof( MipTexture_t ) == 40, "MipTexture_t has to be 40 bytes long" );
+static_assert( sizeof( WadHeader_t ) == 12, "WadHeader_t has to be 12 bytes long" );
+
+//	Converts the on-disk structures between little endian and the host byte
+//	order. The conversion is symmetric, so it's used for both reading and writing.
+inline void SwapWadHeader( WadHeader_t& header )
+{
+	if constexpr (std::endian::native == std::endian::little)
+		return;
+
+	header.numlumps = LittleLong( header.numlumps );
+	header.infotableofs = LittleLong( header.infotableofs );
+}
+
+inline void SwapLumpInfo( LumpInfo_t& lump )
+{
+	if constexpr (std::endian::native == std::endian::little)
+		return;
+
+	lump.filepos = LittleLong( lump.filepos );
+	lump.disksize = LittleLong( lump.disksize );
+	lump.size = LittleLong( lump.size );
+}
+
+inline void SwapMipTexture( MipTexture_t& miptex )
+{
+	if constexpr (std::endian::native == std::endian::little)
+		return;
+
+	miptex.width = LittleLong( miptex.width );
+	miptex.height = LittleLong( miptex.height );
+
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+		miptex.offsets[m] = LittleLong( miptex.offsets[m] );
+}
+
+//	Reader for WAD2/WAD3 files.
+//
+//	The reader is quiet by default so it can be embedded into long-running
+//	processes. The command line tool turns on the verbose mode, which prints
+//	out the progress and the errors as they happen. The last error is always
+//	available through error().
 class CWadFile
 {
 public:
 	CWadFile( const std::filesystem::path& path ) :
-		m_path(path)
+		m_path(path),
+		m_serial(s_next_serial++)
 	{}
 
 	CWadFile() = delete;
+	CWadFile( const CWadFile& ) = delete;
+	CWadFile& operator=( const CWadFile& ) = delete;
 
+	~CWadFile();
+
+	//	Reads the WAD file and decodes all of the textures inside it.
 	bool process();
 
+	//	Reads the WAD file and its lump directory without decoding anything.
+	bool open();
+
+	//	Decodes all of the texture lumps into the texture data list, in the
+	//	order of the lump directory. The lumps are independent of each other,
+	//	so they're decoded on multiple threads, see set_num_threads(). A lump
+	//	that can't be decoded is skipped and listed in warnings().
+	bool decode_all();
+
+	//	Decodes a single texture lump. The lump has to come from this file.
+	bool decode_texture( const LumpInfo_t* lump, TextureData_t& out ) const;
+	bool decode_texture( const LumpInfo_t* lump, TextureData_t& out, std::string& error ) const;
+
 	//	Dumping
 	void dump_wad_full();
 	void dump_wad_header();
 	void dump_wad_lumps();
 	void dump_wad_texture_data();
 
+	//	Writes the first miplevel mips of every decoded texture as BMP images,
+	//	on the threads set with set_num_threads().
 	bool export_images_from_wad( const std::filesystem::path& to, uint32_t miplevel );
 
+	//	The images export_images_from_wad() writes, for batching them up with
+	//	other files. They point into the texture data of this file.
+	void add_image_files( const std::filesystem::path& to, uint32_t miplevel, std::vector<ImageFile_t>& files ) const;
+
+	//	Lookup
+	const LumpInfo_t* find_lump( std::string_view name ) const;
+	const TextureData_t* find_texture( std::string_view name ) const;
+
+	//	Raw bytes of the lump inside the file, disksize bytes long.
+	const uint8_t* lump_data( const LumpInfo_t* lump ) const;
+
+	//	Uncompressed bytes of the lump, size bytes long.
+	bool read_lump( const LumpInfo_t* lump, std::vector<uint8_t>& out ) const;
+	bool read_lump( const LumpInfo_t* lump, std::vector<uint8_t>& out, std::string& error ) const;
+
+	//	Position of the lump inside the lump directory.
+	uint32_t lump_index( const LumpInfo_t* lump ) const;
+
+	//	Accessors
+	const std::filesystem::path& path() const { return m_path; }
+	uint64_t serial() const { return m_serial; }
+	const std::string& wad_id() const { return m_wad_id; }
+	const WadHeader_t* header() const { return m_wadheader; }
+	const std::deque<const LumpInfo_t*>& lumps() const { return m_lumps; }
+	const std::deque<TextureData_t>& textures() const { return m_texturedata; }
+	uint32_t file_size() const { return m_filesize; }
+
+	bool is_open() const { return m_buffer != nullptr && !m_failed; }
+	bool failed() const { return m_failed; }
+	const std::string& error() const { return m_error; }
+
+	//	The textures decode_all() skipped and why.
+	const std::vector<std::string>& warnings() const { return m_warnings; }
+
+	void set_verbose( bool verbose ) { m_verbose = verbose; }
+	bool verbose() const { return m_verbose; }
+
+	//	Threads used by decode_all() and export_images_from_wad(), 0 means one per core.
+	void set_num_threads( uint32_t num_threads ) { m_num_threads = num_threads; }
+	uint32_t num_threads() const { return m_num_threads; }
+
+	//	Maps the file into memory instead of reading it into a heap buffer.
+	//	Has to be set before the file is opened.
+	void set_memory_mapped( bool mapped ) { m_memory_mapped = mapped; }
+
 	//	WAD id check
 	static bool check_wad_id( const std::string& id );
 
 	//	Lumps
-	static bool is_lump_valid( LumpInfo_t* lump );
-	static bool check_lump_size( LumpInfo_t* lump );
+	static bool is_lump_valid( const LumpInfo_t* lump );
+	static bool check_lump_size( const LumpInfo_t* lump );
+	static bool is_texture_lump( const LumpInfo_t* lump );
 	static std::string str_for_lump_type( char type );
+	static std::string lump_name( const LumpInfo_t* lump );
+	static bool names_equal( std::string_view a, std::string_view b );
+	static std::string lower_name( std::string_view name );
 
 	//	Texture data
-	bool is_texture_valid( MipTexture_t* miptex );
+	static bool is_texture_valid( const MipTexture_t* miptex );
+
+	//	Decodes a miptex structure that is miptex_size bytes long. This doesn't
+	//	depend on the WAD container, so it can be used on any embedded miptex.
+	static bool decode_miptex( const uint8_t* miptex_base, uint32_t miptex_size, TextureData_t& out );
+
+	//	Size of the n'th mip in pixels.
+	static uint32_t mip_width( uint32_t width, uint32_t mip ) { return width >> mip; }
+	static uint32_t mip_height( uint32_t height, uint32_t mip ) { return height >> mip; }
 
 private:
 	uint8_t* allocate_buf( uint32_t size );
 	void deallocate_buf();
 	uint8_t* get_buffer_ptr( uint32_t filesize );
 
-public:
+	void log( const char* fmt, ... ) const;
+	bool fail( const char* fmt, ... );
+
+private:
 	std::filesystem::path m_path;
-	uint8_t* m_buffer;
+
+	//	Unique for every instance during the lifetime of the process, so
+	//	caches can tell the files apart even if one is freed and another one
+	//	ends up at the same address.
+	uint64_t m_serial;
+	static inline std::atomic<uint64_t> s_next_serial = 1;
+
+	uint8_t* m_buffer = nullptr;
+	uint32_t m_filesize = 0;
+
+	CMappedFile m_mapping;
+	bool m_memory_mapped = false;
 
 	std::string m_wad_id; // A null-terminated wad id
-	WadHeader_t* m_wadheader;
+	WadHeader_t* m_wadheader = nullptr;
 
-	uint8_t* m_lumps_base;
-	std::deque<LumpInfo_t*> m_lumps;
+	uint8_t* m_lumps_base = nullptr;
+	std::deque<const LumpInfo_t*> m_lumps;
 
-	std::deque<MipTexture_t*> m_miptextures;
 	std::deque<TextureData_t> m_texturedata;
 
 	std::chrono::high_resolution_clock::time_point m_start_timestamp;
 
+	std::string m_error;
+	std::vector<std::string> m_warnings;
+	bool m_verbose = false;
+
+	uint32_t m_num_threads = 1;
+
 	//	This is set to true if some error occured and process has to stop.
 	bool m_failed = false;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,194 @@
+#include <atomic>
+
+#include "wad_compression.h"
+#include "wad_writer.h"
+#include "parallel.h"
+#include "metrics.h"
+
+#ifdef WAD_HAVE_ZLIB
+#	include <zlib.h>
+#endif
+
+const char* str_for_compression( char compression )
+{
+	switch (compression)
+	{
+		case LUMP_COMPRESSION_NONE:
+			return "n/a";
+		case LUMP_COMPRESSION_LZSS:
+			return "lzss";
+		case LUMP_COMPRESSION_DEFLATE:
+			return "deflate";
+		default:
+			break;
+	}
+
+	return "unknown";
+}
+
+bool is_compression_supported( char compression )
+{
+	switch (compression)
+	{
+		case LUMP_COMPRESSION_NONE:
+			return true;
+
+#ifdef WAD_HAVE_ZLIB
+		case LUMP_COMPRESSION_DEFLATE:
+			return true;
+#endif
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+bool compress_lump( const uint8_t* data, uint32_t size, char compression, std::vector<uint8_t>& out )
+{
+	METRICS_TIMER( timer, "lump.compress" );
+	timer.add_bytes( size );
+
+#ifdef WAD_HAVE_ZLIB
+	if (compression == LUMP_COMPRESSION_DEFLATE)
+	{
+		uLongf out_size = compressBound( size );
+		out.resize( out_size );
+
+		if (compress2( out.data(), &out_size, data, size, Z_BEST_COMPRESSION ) != Z_OK || out_size >= size)
+			return false;
+
+		out.resize( out_size );
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+bool decompress_lump( const uint8_t* data, uint32_t disksize, uint32_t size, char compression, std::vector<uint8_t>& out, std::string& error )
+{
+	METRICS_TIMER( timer, "lump.decompress" );
+	timer.add_bytes( size );
+
+	const bool known = compression == LUMP_COMPRESSION_NONE || compression == LUMP_COMPRESSION_LZSS || compression == LUMP_COMPRESSION_DEFLATE;
+
+	if (compression == LUMP_COMPRESSION_NONE || (!known && disksize == size))
+	{
+		if (disksize != size)
+		{
+			error = "The lump is stored with " + std::to_string( disksize ) + " bytes instead of " + std::to_string( size ) + ".";
+			return false;
+		}
+
+		out.assign( data, data + size );
+		return true;
+	}
+
+	if (compression == LUMP_COMPRESSION_DEFLATE)
+	{
+#ifdef WAD_HAVE_ZLIB
+		out.resize( size );
+
+		uLongf out_size = size;
+		if (uncompress( out.data(), &out_size, data, disksize ) != Z_OK || out_size != size)
+		{
+			error = "The deflate stream is corrupted.";
+			return false;
+		}
+
+		return true;
+#else
+		error = "The lump is deflate compressed, this build doesn't support it because it was built without zlib.";
+		return false;
+#endif
+	}
+
+	if (known)
+		error = std::string( "Unsupported compression: " ) + str_for_compression( compression ) + ".";
+	else
+		error = "Unknown compression type " + std::to_string( (uint8_t)compression ) + ".";
+
+	return false;
+}
+
+bool convert_wad( const CWadFile& wad, const std::filesystem::path& out, char compression, std::string& error, uint32_t num_threads )
+{
+	if (!is_compression_supported( compression ))
+	{
+		error = std::string( "This build doesn't support " ) + str_for_compression( compression ) + " compression.";
+		return false;
+	}
+
+	std::error_code ec;
+	if (std::filesystem::equivalent( wad.path(), out, ec ))
+	{
+		error = "The converted WAD has to be written to a different file.";
+		return false;
+	}
+
+	struct Converted_t
+	{
+		std::vector<uint8_t> data;
+		char compression;
+		uint32_t size;
+
+		std::string error;
+	};
+
+	const auto& lumps = wad.lumps();
+
+	std::vector<Converted_t> converted( lumps.size() );
+	std::atomic<uint32_t> first_failed = UINT32_MAX;
+
+	parallel_for_weighted( lumps.size(), [&]( size_t i ) { return (uint64_t)lumps[i]->size; }, [&]( size_t i )
+	{
+		auto& lump = converted[i];
+
+		std::vector<uint8_t> raw;
+		if (!wad.read_lump( lumps[i], raw, lump.error ))
+		{
+			uint32_t failed = first_failed;
+			while (i < failed && !first_failed.compare_exchange_weak( failed, (uint32_t)i ));
+			return;
+		}
+
+		lump.size = (uint32_t)raw.size();
+
+		if (compression != LUMP_COMPRESSION_NONE && compress_lump( raw.data(), lump.size, compression, lump.data ))
+			lump.compression = compression;
+		else
+		{
+			lump.data = std::move( raw );
+			lump.compression = LUMP_COMPRESSION_NONE;
+		}
+	}, num_threads );
+
+	if (first_failed != UINT32_MAX)
+	{
+		error = "Couldn't decompress lump #" + std::to_string( first_failed ) + " (" + CWadFile::lump_name( lumps[first_failed] ) + "): " + converted[first_failed].error;
+		return false;
+	}
+
+	CWadWriter writer( wad.wad_id() );
+
+	for (size_t i = 0; i < lumps.size(); i++)
+	{
+		const auto& lump = converted[i];
+
+		if (!writer.add_lump_ref( CWadFile::lump_name( lumps[i] ), lumps[i]->type, lump.data.data(), (uint32_t)lump.data.size(), lump.compression, lump.size ))
+		{
+			error = writer.error();
+			return false;
+		}
+	}
+
+	if (!writer.write( out ))
+	{
+		error = writer.error();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef WAD_COMPRESSION_H
+#define WAD_COMPRESSION_H
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <filesystem>
+
+#include "wad.h"
+
+//	Values of LumpInfo_t::compression. Standard WAD files only ever use
+//	LUMP_COMPRESSION_NONE, LZSS is what the original tools reserved the field
+//	for and isn't supported. Deflate is our own extension: every lump is a
+//	separate zlib stream, so lumps can still be found through the directory
+//	and decompressed independently of each other.
+#define LUMP_COMPRESSION_NONE		0
+#define LUMP_COMPRESSION_LZSS		1
+#define LUMP_COMPRESSION_DEFLATE	2
+
+const char* str_for_compression( char compression );
+
+//	Whether this build can decompress (and compress) lumps of the kind.
+bool is_compression_supported( char compression );
+
+//	Compresses the lump. Returns false when the compressed data wouldn't be
+//	smaller, in which case the lump should be stored as it is.
+bool compress_lump( const uint8_t* data, uint32_t size, char compression, std::vector<uint8_t>& out );
+
+//	Decompresses disksize bytes into exactly size bytes, error says why that
+//	didn't work. A lump with an unknown compression type that isn't smaller
+//	than its size is taken as stored, some tools leave garbage in the field.
+bool decompress_lump( const uint8_t* data, uint32_t disksize, uint32_t size, char compression, std::vector<uint8_t>& out, std::string& error );
+
+//	Writes a copy of the WAD with every lump stored with the given compression.
+//	Lumps that don't get smaller are stored uncompressed, converting with
+//	LUMP_COMPRESSION_NONE turns the WAD back into a standard one. The lumps
+//	are (de)compressed in parallel.
+bool convert_wad( const CWadFile& wad, const std::filesystem::path& out, char compression, std::string& error, uint32_t num_threads = 0 );
+
+#endif
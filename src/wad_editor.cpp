@@ -0,0 +1,362 @@
+#include <fstream>
+#include <cstring>
+
+#include "wad_editor.h"
+#include "wad_writer.h"
+#include "mapped_file.h"
+#include "metrics.h"
+
+//	Lumps are kept aligned to 4 bytes.
+static constexpr uint64_t align4( uint64_t pos )
+{
+	return (pos + 3) & ~3ull;
+}
+
+bool CWadEditor::open()
+{
+	m_lumps.clear();
+	m_dirty = false;
+
+	std::ifstream ifs( m_path, std::ios_base::in | std::ios_base::binary );
+	if (!ifs.good())
+		return fail( "Couldn't open input file for reading." );
+
+	std::error_code ec;
+	m_filesize = std::filesystem::file_size( m_path, ec );
+	if (ec)
+		return fail( "Couldn't get the size of the file." );
+
+	WadHeader_t header;
+	if (!ifs.read( (char*)&header, sizeof( header ) ))
+		return fail( "Couldn't read the WAD header." );
+
+	SwapWadHeader( header );
+
+	m_wad_id.assign( header.identification, sizeof( header.identification ) );
+	if (!CWadFile::check_wad_id( m_wad_id ))
+		return fail( "Invalid WAD id. (" + m_wad_id + ")" );
+
+	if ((uint64_t)header.infotableofs + (uint64_t)header.numlumps * sizeof( LumpInfo_t ) > m_filesize)
+		return fail( "The lump directory is out of the range of the WAD file." );
+
+	std::vector<LumpInfo_t> directory( header.numlumps );
+
+	ifs.seekg( header.infotableofs );
+	if (!ifs.read( (char*)directory.data(), directory.size() * sizeof( LumpInfo_t ) ))
+		return fail( "Couldn't read the lump directory." );
+
+	m_lumps.reserve( directory.size() );
+
+	for (auto& info : directory)
+	{
+		SwapLumpInfo( info );
+
+		if (!CWadFile::is_lump_valid( &info ) || (uint64_t)info.filepos + info.disksize > m_filesize)
+			return fail( "This WAD file constains corrupted information." );
+
+		m_lumps.push_back( { info, {} } );
+	}
+
+	return true;
+}
+
+bool CWadEditor::add_lump( const std::string& name, char type, const uint8_t* data, uint32_t size )
+{
+	if (name.empty() || name.size() >= sizeof( LumpInfo_t::name ))
+		return fail( "Invalid lump name: " + name );
+
+	if (!data || !size)
+		return fail( "Empty lump: " + name );
+
+	if (find_lump( name ) >= 0)
+		return fail( "Lump already exists: " + name );
+
+	EditorLump_t lump = {};
+	lump.info.disksize = size;
+	lump.info.size = size;
+	lump.info.type = type;
+	strncpy( lump.info.name, name.c_str(), sizeof( lump.info.name ) - 1 );
+	lump.pending.assign( data, data + size );
+
+	m_lumps.push_back( std::move( lump ) );
+	m_dirty = true;
+
+	return true;
+}
+
+bool CWadEditor::replace_lump( const std::string& name, char type, const uint8_t* data, uint32_t size )
+{
+	const int32_t index = find_lump( name );
+	if (index < 0)
+		return fail( "No such lump: " + name );
+
+	if (!data || !size)
+		return fail( "Empty lump: " + name );
+
+	//	The directory entry stays where it was, only the data moves.
+	auto& lump = m_lumps[index];
+	lump.info.filepos = 0;
+	lump.info.disksize = size;
+	lump.info.size = size;
+	lump.info.type = type;
+	lump.info.compression = 0;
+	lump.pending.assign( data, data + size );
+
+	m_dirty = true;
+
+	return true;
+}
+
+bool CWadEditor::delete_lump( const std::string& name )
+{
+	const int32_t index = find_lump( name );
+	if (index < 0)
+		return fail( "No such lump: " + name );
+
+	m_lumps.erase( m_lumps.begin() + index );
+	m_dirty = true;
+
+	return true;
+}
+
+bool CWadEditor::put_texture( const TextureData_t& tex )
+{
+	std::vector<uint8_t> miptex;
+	if (!CWadWriter::encode_miptex( tex, miptex ))
+		return fail( "Couldn't encode texture " + tex.name );
+
+	if (find_lump( tex.name ) >= 0)
+		return replace_lump( tex.name, LUMP_TYPE_TEXTURE, miptex.data(), (uint32_t)miptex.size() );
+
+	return add_lump( tex.name, LUMP_TYPE_TEXTURE, miptex.data(), (uint32_t)miptex.size() );
+}
+
+bool CWadEditor::commit()
+{
+	if (!m_dirty)
+		return true;
+
+	METRICS_TIMER( timer, "editor.commit" );
+
+	//	New data goes after everything that's in the file already, so nothing
+	//	the current directory points to gets overwritten. The new directory is
+	//	laid out before anything is written, a WAD that would get too big
+	//	fails with the file untouched.
+	const uint64_t start = align4( m_filesize );
+	uint64_t pos = start;
+
+	std::vector<LumpInfo_t> directory;
+	directory.reserve( m_lumps.size() );
+
+	for (const auto& lump : m_lumps)
+	{
+		directory.push_back( lump.info );
+
+		if (lump.pending.empty())
+			continue;
+
+		directory.back().filepos = (uint32_t)pos;
+		pos += align4( lump.pending.size() );
+	}
+
+	const uint64_t infotableofs = pos;
+	const uint64_t filesize = infotableofs + directory.size() * sizeof( LumpInfo_t );
+
+	if (filesize > UINT32_MAX)
+		return fail( "The WAD file would be too big." );
+
+	std::fstream fs( m_path, std::ios_base::in | std::ios_base::out | std::ios_base::binary );
+	if (!fs.good())
+		return fail( "Couldn't open the file for writing." );
+
+	static const uint8_t padding[4] = {};
+
+	fs.seekp( m_filesize );
+	fs.write( (const char*)padding, start - m_filesize );
+
+	for (const auto& lump : m_lumps)
+	{
+		if (lump.pending.empty())
+			continue;
+
+		fs.write( (const char*)lump.pending.data(), lump.pending.size() );
+		fs.write( (const char*)padding, align4( lump.pending.size() ) - lump.pending.size() );
+	}
+
+	write_directory( fs, directory );
+	fs.flush();
+
+	//	The data has to be on the disk before the header points to it.
+	if (!fs.good() || !sync_file( m_path ))
+		return fail( "Couldn't write the lump data." );
+
+	//	The header goes last, until then the file still describes the old contents.
+	fs.seekp( 0 );
+	write_header( fs, m_wad_id, (uint32_t)directory.size(), (uint32_t)infotableofs );
+	fs.flush();
+
+	if (!fs.good() || !sync_file( m_path ))
+		return fail( "Couldn't write the WAD header." );
+
+	//	Only now the lumps are where the new directory says.
+	for (size_t i = 0; i < m_lumps.size(); i++)
+	{
+		m_lumps[i].info.filepos = directory[i].filepos;
+		m_lumps[i].pending.clear();
+		m_lumps[i].pending.shrink_to_fit();
+	}
+
+	timer.add_bytes( filesize - m_filesize );
+
+	m_filesize = filesize;
+	m_dirty = false;
+
+	return true;
+}
+
+bool CWadEditor::compact()
+{
+	if (!commit())
+		return false;
+
+	METRICS_SCOPE( "editor.compact" );
+
+	//	A name nothing else has, so no other file gets overwritten or
+	//	renamed over the WAD.
+	std::filesystem::path tmp_path;
+	if (!create_temp_file( m_path, tmp_path ))
+		return fail( "Couldn't create a temporary file for compacting." );
+
+	std::vector<LumpInfo_t> directory;
+	directory.reserve( m_lumps.size() );
+
+	uint64_t pos = sizeof( WadHeader_t );
+
+	if (!write_compacted( tmp_path, directory, pos ))
+	{
+		std::error_code ec;
+		std::filesystem::remove( tmp_path, ec );
+		return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename( tmp_path, m_path, ec );
+
+	if (ec)
+	{
+		fail( "Couldn't replace the file: " + ec.message() );
+		std::filesystem::remove( tmp_path, ec );
+		return false;
+	}
+
+	for (size_t i = 0; i < m_lumps.size(); i++)
+		m_lumps[i].info.filepos = directory[i].filepos;
+
+	m_filesize = pos + directory.size() * sizeof( LumpInfo_t );
+
+	return true;
+}
+
+//	The caller removes the file when this fails, the streams are closed by then.
+bool CWadEditor::write_compacted( const std::filesystem::path& tmp_path, std::vector<LumpInfo_t>& directory, uint64_t& pos )
+{
+	std::ifstream ifs( m_path, std::ios_base::in | std::ios_base::binary );
+	std::ofstream ofs( tmp_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+
+	if (!ifs.good() || !ofs.good())
+		return fail( "Couldn't open the files for compacting." );
+
+	//	Placeholder, the real header is written once the directory is known.
+	write_header( ofs, m_wad_id, 0, 0 );
+
+	std::vector<uint8_t> buf;
+	static const uint8_t padding[4] = {};
+
+	for (const auto& lump : m_lumps)
+	{
+		buf.resize( lump.info.disksize );
+
+		ifs.seekg( lump.info.filepos );
+		if (!ifs.read( (char*)buf.data(), buf.size() ))
+			return fail( "Couldn't read lump " + CWadFile::lump_name( &lump.info ) );
+
+		ofs.write( (const char*)buf.data(), buf.size() );
+		ofs.write( (const char*)padding, align4( buf.size() ) - buf.size() );
+
+		directory.push_back( lump.info );
+		directory.back().filepos = (uint32_t)pos;
+		pos += align4( buf.size() );
+	}
+
+	write_directory( ofs, directory );
+
+	ofs.seekp( 0 );
+	write_header( ofs, m_wad_id, (uint32_t)directory.size(), (uint32_t)pos );
+	ofs.flush();
+
+	//	The new file has to be on the disk before it replaces the old one.
+	if (!ofs.good() || !sync_file( tmp_path ))
+		return fail( "Couldn't write the compacted file." );
+
+	return true;
+}
+
+int32_t CWadEditor::find_lump( const std::string& name ) const
+{
+	for (size_t i = 0; i < m_lumps.size(); i++)
+	{
+		if (CWadFile::names_equal( CWadFile::lump_name( &m_lumps[i].info ), name ))
+			return (int32_t)i;
+	}
+
+	return -1;
+}
+
+uint64_t CWadEditor::dead_bytes() const
+{
+	uint64_t live = sizeof( WadHeader_t ) + m_lumps.size() * sizeof( LumpInfo_t );
+
+	for (const auto& lump : m_lumps)
+	{
+		if (lump.pending.empty())
+			live += lump.info.disksize;
+	}
+
+	return m_filesize > live ? m_filesize - live : 0;
+}
+
+std::vector<LumpInfo_t> CWadEditor::lumps() const
+{
+	std::vector<LumpInfo_t> out;
+	out.reserve( m_lumps.size() );
+
+	for (const auto& lump : m_lumps)
+		out.push_back( lump.info );
+
+	return out;
+}
+
+void CWadEditor::write_directory( std::ostream& os, std::vector<LumpInfo_t> directory )
+{
+	for (auto& info : directory)
+		SwapLumpInfo( info );
+
+	os.write( (const char*)directory.data(), directory.size() * sizeof( LumpInfo_t ) );
+}
+
+void CWadEditor::write_header( std::ostream& os, const std::string& wad_id, uint32_t numlumps, uint32_t infotableofs )
+{
+	WadHeader_t header;
+	memcpy( header.identification, wad_id.data(), sizeof( header.identification ) );
+	header.numlumps = numlumps;
+	header.infotableofs = infotableofs;
+	SwapWadHeader( header );
+
+	os.write( (const char*)&header, sizeof( header ) );
+}
+
+bool CWadEditor::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
@@ -0,0 +1,88 @@
+#ifndef WAD_EDITOR_H
+#define WAD_EDITOR_H
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <filesystem>
+
+#include "wad.h"
+
+//	Edits a WAD file in place. Only the header and the lump directory are read.
+//	Added and replaced lumps are appended to the end of the file, followed by a
+//	new lump directory, and the header is rewritten last. An edit costs as much
+//	I/O as the lumps that changed plus the directory. The new data is synced to
+//	the disk before the header points to it, so a crash or a failed write
+//	leaves the old contents intact.
+//
+//	The space of replaced and deleted lumps (and of the old directories) stays
+//	in the file until compact() is called.
+class CWadEditor
+{
+public:
+	CWadEditor( const std::filesystem::path& path ) :
+		m_path(path)
+	{}
+
+	CWadEditor() = delete;
+
+	bool open();
+
+	//	The changes are kept in memory until commit() is called.
+	bool add_lump( const std::string& name, char type, const uint8_t* data, uint32_t size );
+	bool replace_lump( const std::string& name, char type, const uint8_t* data, uint32_t size );
+	bool delete_lump( const std::string& name );
+
+	//	Adds the texture or replaces the one with the same name.
+	bool put_texture( const TextureData_t& tex );
+
+	//	On failure the file still has its old contents and the changes stay
+	//	pending, so the commit can be retried.
+	bool commit();
+
+	//	Rewrites the file with the live lumps only, reclaiming the dead space.
+	//	Pending changes are committed first.
+	bool compact();
+
+	int32_t find_lump( const std::string& name ) const;
+
+	bool has_changes() const { return m_dirty; }
+	uint64_t file_size() const { return m_filesize; }
+
+	//	Bytes inside the file that don't belong to any live lump, the
+	//	header or the current lump directory.
+	uint64_t dead_bytes() const;
+
+	std::vector<LumpInfo_t> lumps() const;
+	const std::string& error() const { return m_error; }
+
+private:
+	struct EditorLump_t
+	{
+		LumpInfo_t info;
+
+		//	Data that isn't in the file yet.
+		std::vector<uint8_t> pending;
+	};
+
+	bool write_compacted( const std::filesystem::path& tmp_path, std::vector<LumpInfo_t>& directory, uint64_t& pos );
+
+	static void write_directory( std::ostream& os, std::vector<LumpInfo_t> directory );
+	static void write_header( std::ostream& os, const std::string& wad_id, uint32_t numlumps, uint32_t infotableofs );
+
+	bool fail( const std::string& msg );
+
+private:
+	std::filesystem::path m_path;
+
+	std::string m_wad_id;
+	std::vector<EditorLump_t> m_lumps;
+
+	uint64_t m_filesize = 0;
+	bool m_dirty = false;
+
+	std::string m_error;
+};
+
+#endif
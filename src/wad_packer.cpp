@@ -0,0 +1,148 @@
+#include <fstream>
+#include <algorithm>
+
+#include "wad_packer.h"
+#include "wad_writer.h"
+
+bool CWadPacker::add_wad( const std::filesystem::path& path )
+{
+	//	Kept open for the lump bytes, the order matches the resolver's.
+	auto wad = std::make_unique<CWadFile>( path );
+	wad->set_memory_mapped( true );
+
+	if (!wad->open())
+		return fail( path.string() + ": " + wad->error() );
+
+	m_resolver.add_wad( *wad );
+	m_wads.push_back( std::move( wad ) );
+
+	return true;
+}
+
+bool CWadPacker::add_maps( const std::vector<std::filesystem::path>& paths, uint32_t num_threads )
+{
+	const auto reports = m_resolver.resolve_all( paths, num_threads );
+
+	for (const auto& report : reports)
+	{
+		if (!report.ok)
+			return fail( report.path.string() + ": " + report.error );
+
+		for (const auto& tex : report.textures)
+		{
+			//	Embedded textures ship with the map.
+			if (tex.source != ETextureSource::Embedded)
+				select( CWadFile::lower_name( tex.name ), tex.wad_index, tex.lump_index );
+		}
+	}
+
+	return true;
+}
+
+void CWadPacker::add_name( std::string_view name )
+{
+	const auto refs = m_resolver.index().find( name );
+
+	if (refs.empty())
+		select( CWadFile::lower_name( name ), -1, 0 );
+	else
+		select( refs.front()->name, (int32_t)refs.front()->wad_index, refs.front()->lump_index );
+}
+
+bool CWadPacker::add_name_list( const std::filesystem::path& path )
+{
+	std::ifstream file( path );
+	if (!file)
+		return fail( "Couldn't open " + path.string() + " for reading." );
+
+	std::string line;
+	while (std::getline( file, line ))
+	{
+		const size_t begin = line.find_first_not_of( " \t\r" );
+		if (begin == line.npos || line.compare( begin, 2, "//" ) == 0)
+			continue;
+
+		const size_t end = line.find_last_not_of( " \t\r" );
+		add_name( std::string_view( line ).substr( begin, end - begin + 1 ) );
+	}
+
+	return true;
+}
+
+void CWadPacker::add_all()
+{
+	for (uint32_t w = 0; w < (uint32_t)m_wads.size(); w++)
+	{
+		const auto& lumps = m_wads[w]->lumps();
+
+		for (uint32_t i = 0; i < (uint32_t)lumps.size(); i++)
+			select( CWadFile::lower_name( CWadFile::lump_name( lumps[i] ) ), (int32_t)w, i );
+	}
+}
+
+void CWadPacker::select( const std::string& name, int32_t wad_index, uint32_t lump_index )
+{
+	if (!m_names.insert( name ).second)
+		return;
+
+	if (wad_index < 0)
+		m_missing.push_back( name );
+	else
+		m_selected.push_back( { name, (uint32_t)wad_index, lump_index } );
+}
+
+bool CWadPacker::write( const std::filesystem::path& path )
+{
+	if (m_selected.empty())
+		return fail( "None of the textures were found." );
+
+	//	The lumps are read straight out of the mapped sources while the
+	//	output is written.
+	for (const auto& wad : m_wads)
+	{
+		std::error_code ec;
+		if (std::filesystem::equivalent( wad->path(), path, ec ))
+			return fail( "The WAD file has to be written to a file that isn't one of the inputs (" + wad->path().string() + ")." );
+	}
+
+	//	Copy in WAD and directory order, so the source pages are read mostly
+	//	sequentially.
+	auto order = m_selected;
+	std::sort( order.begin(), order.end(), []( const Selected_t& a, const Selected_t& b )
+	{
+		return a.wad_index != b.wad_index ? a.wad_index < b.wad_index : a.lump_index < b.lump_index;
+	} );
+
+	//	WAD2 and WAD3 lumps don't mix, Quake textures have no palette of their own.
+	const auto& first = *m_wads[order.front().wad_index];
+
+	for (const auto& sel : order)
+	{
+		const auto& wad = *m_wads[sel.wad_index];
+		if (wad.wad_id() != first.wad_id())
+			return fail( "Can't mix " + first.wad_id() + " and " + wad.wad_id() + " lumps (" + first.path().string() + ", " + wad.path().string() + ")." );
+	}
+
+	CWadWriter writer( first.wad_id() );
+
+	for (const auto& sel : order)
+	{
+		const auto& wad = *m_wads[sel.wad_index];
+		const auto lumpptr = wad.lumps()[sel.lump_index];
+
+		//	The WADs stay mapped until the writer is done with them.
+		if (!writer.add_lump_ref( CWadFile::lump_name( lumpptr ), lumpptr->type, wad.lump_data( lumpptr ), lumpptr->disksize, lumpptr->compression, lumpptr->size ))
+			return fail( writer.error() );
+	}
+
+	if (!writer.write( path ))
+		return fail( writer.error() );
+
+	return true;
+}
+
+bool CWadPacker::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
@@ -0,0 +1,79 @@
+#ifndef WAD_PACKER_H
+#define WAD_PACKER_H
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <filesystem>
+
+#include "wad.h"
+#include "map_resolver.h"
+
+//	Builds a minimal WAD out of only the textures a set of maps (or a list of
+//	names) actually uses. The source WADs stay memory mapped and the selected
+//	lumps are copied byte for byte, nothing is decoded or re-encoded.
+//
+//	A texture is taken from the WAD the map would load it from. Textures that
+//	only exist in WADs the map doesn't list are still packed, so the result
+//	is complete. When several maps resolve a name to different WADs the first
+//	one wins.
+class CWadPacker
+{
+public:
+	bool add_wad( const std::filesystem::path& path );
+
+	//	Call once after the WADs are added.
+	void build() { m_resolver.build(); }
+
+	//	Resolves the maps in parallel and selects their textures.
+	bool add_maps( const std::vector<std::filesystem::path>& paths, uint32_t num_threads = 0 );
+
+	//	Selects the texture from the first WAD that has it.
+	void add_name( std::string_view name );
+
+	//	One texture name per line, blank lines and lines starting with // are skipped.
+	bool add_name_list( const std::filesystem::path& path );
+
+	//	Selects every lump of every WAD, for merging them into one. Lumps of
+	//	any type are taken, the first WAD wins on duplicate names.
+	void add_all();
+
+	//	Fails when the selected lumps come from both WAD2 and WAD3 files, or
+	//	when path is one of the added WADs.
+	bool write( const std::filesystem::path& path );
+
+	size_t num_selected() const { return m_selected.size(); }
+
+	//	Names that none of the WADs have, lower case.
+	const std::vector<std::string>& missing() const { return m_missing; }
+
+	const std::string& error() const { return m_error; }
+
+private:
+	struct Selected_t
+	{
+		std::string name;
+		uint32_t wad_index;
+		uint32_t lump_index;
+	};
+
+	void select( const std::string& name, int32_t wad_index, uint32_t lump_index );
+
+	bool fail( const std::string& msg );
+
+private:
+	CMapResolver m_resolver;
+	std::vector<std::unique_ptr<CWadFile>> m_wads;
+
+	std::vector<Selected_t> m_selected;
+	std::unordered_set<std::string> m_names;	// Selected and missing ones
+
+	std::vector<std::string> m_missing;
+
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include "wad_repair.h"
+#include "wad_writer.h"
+#include "wad_compression.h"
+#include "mipgen.h"
+#include "parallel.h"
+
+std::vector<TextureStats_t> CWadRepair::verify( const std::vector<const CWadFile*>& wads )
+{
+	std::vector<TextureStats_t> stats;
+	analyze_wad_textures( wads, stats, m_num_threads );
+
+	m_num_checked = (uint32_t)stats.size();
+
+	std::vector<TextureStats_t> broken;
+	for (auto& s : stats)
+	{
+		if (!mips_within_tolerance( s, m_tolerance ))
+			broken.push_back( std::move( s ) );
+	}
+
+	return broken;
+}
+
+bool CWadRepair::repair( const CWadFile& wad, const std::vector<TextureStats_t>& broken, const std::filesystem::path& out )
+{
+	std::error_code ec;
+	if (std::filesystem::equivalent( wad.path(), out, ec ))
+		return fail( "The repaired WAD has to be written to a different file." );
+
+	//	Lumps to regenerate, by directory position.
+	std::vector<uint32_t> indices;
+	for (const auto& s : broken)
+		indices.push_back( s.lump_index );
+
+	std::sort( indices.begin(), indices.end() );
+	indices.erase( std::unique( indices.begin(), indices.end() ), indices.end() );
+
+	struct Repaired_t
+	{
+		std::vector<uint8_t> data;
+		char compression;
+		uint32_t size;
+		bool ok;
+	};
+
+	std::vector<Repaired_t> repaired( indices.size() );
+
+	const auto& lumps = wad.lumps();
+
+	parallel_for( indices.size(), [&]( size_t i )
+	{
+		auto& lump = repaired[i];
+
+		TextureData_t tex;
+		if (indices[i] >= lumps.size() || !wad.decode_texture( lumps[indices[i]], tex ))
+			return;
+
+		const auto lumpptr = lumps[indices[i]];
+
+		//	A decal's indices are opacities, not colors.
+		const bool generated = lumpptr->type == LUMP_TYPE_DECAL ? generate_decal_mips( tex ) : generate_mips( tex );
+
+		std::vector<uint8_t> miptex;
+		if (!generated || !CWadWriter::encode_miptex( tex, miptex ))
+			return;
+
+		lump.size = (uint32_t)miptex.size();
+
+		//	Stored the same way as the source lump.
+		if (lumpptr->compression != LUMP_COMPRESSION_NONE && compress_lump( miptex.data(), lump.size, lumpptr->compression, lump.data ))
+			lump.compression = lumpptr->compression;
+		else
+		{
+			lump.data = std::move( miptex );
+			lump.compression = LUMP_COMPRESSION_NONE;
+		}
+
+		lump.ok = true;
+	}, m_num_threads );
+
+	CWadWriter writer( wad.wad_id() );
+
+	size_t next = 0;
+
+	for (uint32_t i = 0; i < (uint32_t)lumps.size(); i++)
+	{
+		const auto lumpptr = lumps[i];
+
+		if (next < indices.size() && indices[next] == i)
+		{
+			const auto& lump = repaired[next];
+			if (!lump.ok)
+				return fail( "Couldn't regenerate the mips of " + CWadFile::lump_name( lumpptr ) + "." );
+
+			//	The directory keeps its name even when the miptex has another.
+			if (!writer.add_lump_ref( CWadFile::lump_name( lumpptr ), lumpptr->type, lump.data.data(), (uint32_t)lump.data.size(), lump.compression, lump.size ))
+				return fail( writer.error() );
+
+			next++;
+			continue;
+		}
+
+		if (!writer.add_lump_ref( CWadFile::lump_name( lumpptr ), lumpptr->type, wad.lump_data( lumpptr ), lumpptr->disksize, lumpptr->compression, lumpptr->size ))
+			return fail( writer.error() );
+	}
+
+	if (!writer.write( out ))
+		return fail( writer.error() );
+
+	return true;
+}
+
+bool CWadRepair::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
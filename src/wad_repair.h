@@ -0,0 +1,51 @@
+#ifndef WAD_REPAIR_H
+#define WAD_REPAIR_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "wad.h"
+#include "texture_analysis.h"
+
+//	Finds the textures whose mips 1..3 don't match mip 0 (stale, blank or
+//	missing lower mips) and writes fixed copies of the WAD files with those
+//	mips regenerated. Detection uses the box sums of analyze_texture(), so no
+//	palette matching is done unless a texture actually has to be repaired.
+class CWadRepair
+{
+public:
+	CWadRepair( float tolerance = MAX_MIP_ERROR ) :
+		m_tolerance(tolerance)
+	{}
+
+	//	Analyzes every texture of the opened WADs in parallel. Returns the
+	//	textures that are out of tolerance, wad_index is the position in wads.
+	std::vector<TextureStats_t> verify( const std::vector<const CWadFile*>& wads );
+
+	//	Writes a copy of the WAD with the mips of the given textures (as
+	//	returned by verify()) regenerated, every other lump is copied as is.
+	//	Repaired lumps keep their directory name, type and compression.
+	//	The output can't be the input file.
+	bool repair( const CWadFile& wad, const std::vector<TextureStats_t>& broken, const std::filesystem::path& out );
+
+	void set_num_threads( uint32_t num_threads ) { m_num_threads = num_threads; }
+
+	float tolerance() const { return m_tolerance; }
+	uint32_t num_checked() const { return m_num_checked; }
+	const std::string& error() const { return m_error; }
+
+private:
+	bool fail( const std::string& msg );
+
+private:
+	float m_tolerance;
+	uint32_t m_num_threads = 0;
+	uint32_t m_num_checked = 0;
+
+	std::string m_error;
+};
+
+#endif
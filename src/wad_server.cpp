@@ -0,0 +1,435 @@
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+#include "wad_server.h"
+#include "bmp.h"
+#include "palette_kernels.h"
+#include "wad_compression.h"
+
+#ifndef _WIN32
+#	include <poll.h>
+#	include <unistd.h>
+#	include <sys/un.h>
+#	include <sys/stat.h>
+#	include <sys/socket.h>
+#endif
+
+//	Longest texture name a client can ask for.
+static constexpr uint32_t kMaxNameLength = 64;
+
+//	Clients above this are disconnected right away.
+static constexpr uint32_t kMaxClients = 64;
+
+CWadServer::~CWadServer()
+{
+	m_running = false;
+
+	//	Wait for the client threads, they reference the WAD files.
+	while (m_num_threads)
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+}
+
+bool CWadServer::add_wad( const std::filesystem::path& path )
+{
+	auto wad = std::make_unique<CWadFile>( path );
+	wad->set_memory_mapped( true );
+
+	if (!wad->open())
+		return fail( path.string() + ": " + wad->error() );
+
+	const uint32_t wad_index = (uint32_t)m_wads.size();
+
+	for (const auto lumpptr : wad->lumps())
+	{
+		if (!CWadFile::is_texture_lump( lumpptr ) || lumpptr->disksize < (int32_t)sizeof( MipTexture_t ))
+			continue;
+
+		MipTexture_t miptex;
+
+		if (lumpptr->compression == LUMP_COMPRESSION_NONE)
+			memcpy( &miptex, wad->lump_data( lumpptr ), sizeof( miptex ) );
+		else
+		{
+			std::vector<uint8_t> data;
+			if (!wad->read_lump( lumpptr, data ) || data.size() < sizeof( miptex ))
+				continue;
+
+			memcpy( &miptex, data.data(), sizeof( miptex ) );
+		}
+
+		SwapMipTexture( miptex );
+
+		const auto name = CWadFile::lower_name( CWadFile::lump_name( lumpptr ) );
+
+		//	The first WAD wins.
+		if (m_index.count( name ))
+			continue;
+
+		m_index.emplace( name, m_textures.size() );
+		m_textures.push_back( { wad_index, lumpptr, miptex.width, miptex.height } );
+	}
+
+	if (m_verbose)
+		printf( "Loaded %s (%d lumps)\n", path.string().c_str(), (uint32_t)wad->lumps().size() );
+
+	m_wads.push_back( std::move( wad ) );
+
+	return true;
+}
+
+EServerStatus CWadServer::handle_request( const ServerRequest_t& request, const std::string& name, std::vector<uint8_t>& payload )
+{
+	payload.clear();
+
+	switch ((EServerOp)request.op)
+	{
+		case EServerOp::List:
+		{
+			const uint32_t count = LittleLong( (uint32_t)m_textures.size() );
+
+			payload.resize( sizeof( count ) + m_textures.size() * sizeof( ServerTextureInfo_t ) );
+			memcpy( payload.data(), &count, sizeof( count ) );
+
+			auto pinfo = reinterpret_cast<ServerTextureInfo_t*>(payload.data() + sizeof( count ));
+			for (const auto& entry : m_textures)
+				fill_info( entry, *pinfo++ );
+
+			return EServerStatus::Ok;
+		}
+		case EServerOp::Metadata:
+		{
+			const auto entry = find( name );
+			if (!entry)
+				return EServerStatus::NotFound;
+
+			const auto path = m_wads[entry->wad_index]->path().string();
+
+			payload.resize( sizeof( ServerTextureInfo_t ) + path.size() );
+			fill_info( *entry, *reinterpret_cast<ServerTextureInfo_t*>(payload.data()) );
+			memcpy( payload.data() + sizeof( ServerTextureInfo_t ), path.data(), path.size() );
+
+			return EServerStatus::Ok;
+		}
+		case EServerOp::GetTexture:
+		{
+			if (request.mip >= MIPLEVELS || request.format >= (uint8_t)EServerFormat::FormatCount)
+				return EServerStatus::BadRequest;
+
+			const auto entry = find( name );
+			if (!entry)
+				return EServerStatus::NotFound;
+
+			const auto& wad = *m_wads[entry->wad_index];
+			const auto mip = request.mip;
+			const auto format = (EServerFormat)request.format;
+
+			const auto blob = m_cache.get_encoded( wad, entry->lump, mip, request.format, [mip, format]( const TextureData_t& tex, std::vector<uint8_t>& out )
+			{
+				return encode_texture( tex, mip, format, out );
+			} );
+
+			if (!blob)
+				return EServerStatus::Failed;
+
+			payload = *blob;
+
+			return EServerStatus::Ok;
+		}
+		case EServerOp::Stats:
+		{
+			const CacheStats_t stats[2] = { m_cache.decoded_stats(), m_cache.encoded_stats() };
+
+			payload.resize( sizeof( stats ) );
+
+			const size_t num_fields = std::size( stats ) * sizeof( CacheStats_t ) / sizeof( uint64_t );
+
+			auto pfield = reinterpret_cast<const uint64_t*>(stats);
+			for (size_t i = 0; i < num_fields; i++)
+			{
+				const uint64_t value = LittleLongLong( pfield[i] );
+				memcpy( payload.data() + i * sizeof( uint64_t ), &value, sizeof( value ) );
+			}
+
+			return EServerStatus::Ok;
+		}
+	}
+
+	return EServerStatus::BadRequest;
+}
+
+const CWadServer::TextureEntry_t* CWadServer::find( const std::string& name ) const
+{
+	const auto it = m_index.find( CWadFile::lower_name( name ) );
+	if (it == m_index.end())
+		return nullptr;
+
+	return &m_textures[it->second];
+}
+
+void CWadServer::fill_info( const TextureEntry_t& entry, ServerTextureInfo_t& info ) const
+{
+	memset( &info, 0, sizeof( info ) );
+	memcpy( info.name, entry.lump->name, sizeof( info.name ) );
+	info.width = LittleLong( entry.width );
+	info.height = LittleLong( entry.height );
+	info.wad_index = LittleLong( entry.wad_index );
+	info.disksize = LittleLong( (uint32_t)entry.lump->disksize );
+	info.type = entry.lump->type;
+	info.compression = entry.lump->compression;
+}
+
+bool CWadServer::encode_texture( const TextureData_t& tex, uint32_t mip, EServerFormat format, std::vector<uint8_t>& out )
+{
+	const uint32_t width = CWadFile::mip_width( tex.width, mip );
+	const uint32_t height = CWadFile::mip_height( tex.height, mip );
+
+	if (!width || !height)
+		return false;
+
+	//	Always hand out a full palette.
+	std::vector<uint8_t> palette( CBitMap::kPaletteSize, 0 );
+	memcpy( palette.data(), tex.m_palette_data.data(), std::min<size_t>( palette.size(), tex.m_palette_data.size() * sizeof( ColorData_t ) ) );
+
+	switch (format)
+	{
+		case EServerFormat::Indexed:
+		{
+			const uint32_t dims[2] = { LittleLong( width ), LittleLong( height ) };
+			const auto& pixels = tex.pixel_data[mip];
+
+			out.resize( sizeof( dims ) + pixels.size() + palette.size() );
+			memcpy( out.data(), dims, sizeof( dims ) );
+			memcpy( out.data() + sizeof( dims ), pixels.data(), pixels.size() );
+			memcpy( out.data() + sizeof( dims ) + pixels.size(), palette.data(), palette.size() );
+
+			return true;
+		}
+		case EServerFormat::Bmp:
+			return CBitMap::Encode( width, height, tex.pixel_data[mip].data(), palette.data(), out ) == EBMPResult::Success;
+
+		case EServerFormat::Rgba:
+		case EServerFormat::Rgb:
+		{
+			std::vector<uint8_t> pixels;
+			const bool ok = format == EServerFormat::Rgba ? texture_to_rgba( tex, mip, pixels ) : texture_to_rgb( tex, mip, pixels );
+			if (!ok)
+				return false;
+
+			const uint32_t dims[2] = { LittleLong( width ), LittleLong( height ) };
+
+			out.resize( sizeof( dims ) + pixels.size() );
+			memcpy( out.data(), dims, sizeof( dims ) );
+			memcpy( out.data() + sizeof( dims ), pixels.data(), pixels.size() );
+
+			return true;
+		}
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+bool CWadServer::fail( const std::string& msg )
+{
+	m_error = msg;
+
+	if (m_verbose)
+		printf( "Error: %s\n", msg.c_str() );
+
+	return false;
+}
+
+#ifndef _WIN32
+
+static bool recv_all( int fd, void* buf, size_t size )
+{
+	uint8_t* p = (uint8_t*)buf;
+
+	while (size)
+	{
+		const ssize_t n = recv( fd, p, size, 0 );
+		if (n <= 0)
+			return false;
+
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool send_all( int fd, const void* buf, size_t size )
+{
+	const uint8_t* p = (const uint8_t*)buf;
+
+	while (size)
+	{
+		const ssize_t n = send( fd, p, size, MSG_NOSIGNAL );
+		if (n <= 0)
+			return false;
+
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+//	A socket that refuses connections has nobody listening on it anymore.
+static bool is_stale_socket( const sockaddr_un& addr )
+{
+	const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if (fd < 0)
+		return false;
+
+	const bool stale = connect( fd, (const sockaddr*)&addr, sizeof( addr ) ) != 0 && errno == ECONNREFUSED;
+	close( fd );
+
+	return stale;
+}
+
+bool CWadServer::run( const std::filesystem::path& socket_path )
+{
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+
+	if (socket_path.string().size() >= sizeof( addr.sun_path ))
+		return fail( "Socket path is too long: " + socket_path.string() );
+
+	strncpy( addr.sun_path, socket_path.c_str(), sizeof( addr.sun_path ) - 1 );
+
+	//	Only the socket of a previous run that's gone is removed, a file or
+	//	the socket of a server that's still running stays where it is.
+	struct stat st;
+	if (lstat( addr.sun_path, &st ) == 0)
+	{
+		if (!S_ISSOCK( st.st_mode ) || !is_stale_socket( addr ))
+			return fail( "Couldn't listen on " + socket_path.string() + ": address in use." );
+
+		unlink( addr.sun_path );
+	}
+
+	if ((m_listen_fd = socket( AF_UNIX, SOCK_STREAM, 0 )) < 0)
+		return fail( "Couldn't create the socket." );
+
+	if (bind( m_listen_fd, (sockaddr*)&addr, sizeof( addr ) ) != 0 || listen( m_listen_fd, SOMAXCONN ) != 0 || lstat( addr.sun_path, &st ) != 0)
+	{
+		close( m_listen_fd );
+		m_listen_fd = -1;
+		return fail( "Couldn't listen on " + socket_path.string() + ": " + strerror( errno ) );
+	}
+
+	if (m_verbose)
+		printf( "Serving %d textures from %d WAD files on %s\n", (uint32_t)m_textures.size(), (uint32_t)m_wads.size(), socket_path.string().c_str() );
+
+	m_running = true;
+
+	while (m_running)
+	{
+		pollfd pfd = { m_listen_fd, POLLIN, 0 };
+		if (poll( &pfd, 1, 200 ) <= 0)
+			continue;
+
+		const int client = accept( m_listen_fd, nullptr, nullptr );
+		if (client < 0)
+			continue;
+
+		{
+			std::lock_guard<std::mutex> lock( m_clients_mutex );
+
+			if (m_clients.size() >= kMaxClients)
+			{
+				close( client );
+				continue;
+			}
+
+			m_clients.insert( client );
+		}
+
+		m_num_threads++;
+		std::thread( &CWadServer::serve_client, this, client ).detach();
+	}
+
+	//	Kick out the clients that are still connected.
+	{
+		std::lock_guard<std::mutex> lock( m_clients_mutex );
+		for (const int client : m_clients)
+			shutdown( client, SHUT_RDWR );
+	}
+
+	while (m_num_threads)
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+	close( m_listen_fd );
+	m_listen_fd = -1;
+
+	//	Unless another server took the path over in the meantime.
+	struct stat now;
+	if (lstat( addr.sun_path, &now ) == 0 && now.st_dev == st.st_dev && now.st_ino == st.st_ino)
+		unlink( addr.sun_path );
+
+	return true;
+}
+
+void CWadServer::serve_client( int fd )
+{
+	std::string name;
+	std::vector<uint8_t> payload;
+
+	while (m_running)
+	{
+		ServerRequest_t request;
+		if (!recv_all( fd, &request, sizeof( request ) ))
+			break;
+
+		request.magic = LittleLong( request.magic );
+
+		ServerResponse_t response = {};
+		response.magic = LittleLong( (uint32_t)WAD_SERVER_MAGIC );
+
+		if (request.magic != WAD_SERVER_MAGIC || request.name_length > kMaxNameLength)
+		{
+			response.status = (uint8_t)EServerStatus::BadRequest;
+			send_all( fd, &response, sizeof( response ) );
+			break;
+		}
+
+		name.resize( request.name_length );
+		if (request.name_length && !recv_all( fd, name.data(), name.size() ))
+			break;
+
+		response.status = (uint8_t)handle_request( request, name, payload );
+
+		if (response.status != (uint8_t)EServerStatus::Ok)
+			payload.clear();
+
+		response.payload_size = LittleLong( (uint32_t)payload.size() );
+
+		if (!send_all( fd, &response, sizeof( response ) ) || (payload.size() && !send_all( fd, payload.data(), payload.size() )))
+			break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_clients_mutex );
+		m_clients.erase( fd );
+	}
+
+	close( fd );
+	m_num_threads--;
+}
+
+#else
+
+bool CWadServer::run( const std::filesystem::path& socket_path )
+{
+	return fail( "The server mode isn't supported on this platform." );
+}
+
+void CWadServer::serve_client( int fd )
+{
+}
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef WAD_SERVER_H
+#define WAD_SERVER_H
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <filesystem>
+
+#include "wad.h"
+#include "texture_cache.h"
+
+//	Binary protocol spoken over the unix domain socket. Every integer is in
+//	little endian. A client sends a ServerRequest_t followed by name_length
+//	bytes of the texture name (no null terminator) and gets a ServerResponse_t
+//	followed by payload_size bytes back. A connection can be reused for any
+//	number of requests.
+#define WAD_SERVER_MAGIC		('W' | ('S' << 8) | ('R' << 16) | ('V' << 24))
+
+enum class EServerOp : uint8_t
+{
+	//	Payload: uint32_t count, count * ServerTextureInfo_t
+	List = 1,
+
+	//	Payload: ServerTextureInfo_t, path of the WAD file the texture is from
+	Metadata,
+
+	//	Payload: the texture mip encoded in the requested format
+	GetTexture,
+
+	//	Payload: CacheStats_t of the decoded textures followed by CacheStats_t
+	//	of the encoded outputs, every field is an uint64_t.
+	Stats,
+};
+
+enum class EServerFormat : uint8_t
+{
+	//	uint32_t width, uint32_t height, width * height palette indices and
+	//	a 768 byte RGB palette.
+	Indexed,
+
+	//	8-bit BMP file.
+	Bmp,
+
+	//	uint32_t width, uint32_t height, width * height RGBA pixels. Index 255
+	//	of '{' textures is fully transparent.
+	Rgba,
+
+	//	uint32_t width, uint32_t height, width * height RGB pixels.
+	Rgb,
+
+	FormatCount
+};
+
+enum class EServerStatus : uint8_t
+{
+	Ok,
+
+	NotFound,
+	BadRequest,
+	Failed,
+};
+
+#pragma pack(push, 1)
+struct ServerRequest_t
+{
+	uint32_t magic;
+
+	uint8_t	 op;			// EServerOp
+	uint8_t	 mip;			// GetTexture only
+	uint8_t	 format;		// EServerFormat, GetTexture only
+	uint8_t	 name_length;	// List takes no name
+};
+
+struct ServerResponse_t
+{
+	uint32_t magic;
+
+	uint8_t	 status;		// EServerStatus
+	uint8_t	 pad[3];
+
+	uint32_t payload_size;
+};
+
+struct ServerTextureInfo_t
+{
+	char	 name[16];
+	uint32_t width, height;
+
+	uint32_t wad_index;		// Order in which the WAD files were added
+	uint32_t disksize;
+
+	char	 type;
+	char	 compression;
+	uint8_t	 pad[2];
+};
+#pragma pack(pop)
+
+static_assert( sizeof( ServerRequest_t ) == 8, "ServerRequest_t has to be 8 bytes long" );
+static_assert( sizeof( ServerResponse_t ) == 12, "ServerResponse_t has to be 12 bytes long" );
+static_assert( sizeof( ServerTextureInfo_t ) == 36, "ServerTextureInfo_t has to be 36 bytes long" );
+
+//	Keeps a set of memory mapped and indexed WAD files and answers texture
+//	lookups over a unix domain socket. Every client gets its own thread.
+//	Textures with the same name are resolved to the WAD that was added first,
+//	the same way the engine does it.
+//
+//	Decoded textures and encoded outputs are kept in a CTextureCache, the
+//	budget is split equally between the two.
+class CWadServer
+{
+public:
+	static constexpr size_t kDefaultCacheBudget = 128 * 1024 * 1024;
+
+	CWadServer( size_t cache_budget = kDefaultCacheBudget ) :
+		m_cache(cache_budget / 2, cache_budget / 2)
+	{}
+
+	CWadServer( const CWadServer& ) = delete;
+	CWadServer& operator=( const CWadServer& ) = delete;
+
+	~CWadServer();
+
+	bool add_wad( const std::filesystem::path& path );
+
+	//	Blocks until stop() is called. Fails right away when there's anything
+	//	but the socket of a server that's gone at socket_path.
+	bool run( const std::filesystem::path& socket_path );
+
+	//	Safe to call from a signal handler.
+	void stop() { m_running = false; }
+
+	//	Handles a single request, independent of the transport.
+	EServerStatus handle_request( const ServerRequest_t& request, const std::string& name, std::vector<uint8_t>& payload );
+
+	const CTextureCache& cache() const { return m_cache; }
+
+	size_t num_wads() const { return m_wads.size(); }
+	size_t num_textures() const { return m_textures.size(); }
+	const std::string& error() const { return m_error; }
+
+	void set_verbose( bool verbose ) { m_verbose = verbose; }
+
+private:
+	struct TextureEntry_t
+	{
+		uint32_t wad_index;
+		const LumpInfo_t* lump;
+
+		uint32_t width, height;
+	};
+
+	void serve_client( int fd );
+
+	const TextureEntry_t* find( const std::string& name ) const;
+	void fill_info( const TextureEntry_t& entry, ServerTextureInfo_t& info ) const;
+
+	static bool encode_texture( const TextureData_t& tex, uint32_t mip, EServerFormat format, std::vector<uint8_t>& out );
+
+	bool fail( const std::string& msg );
+
+private:
+	std::vector<std::unique_ptr<CWadFile>> m_wads;
+
+	std::vector<TextureEntry_t> m_textures;
+	std::unordered_map<std::string, size_t> m_index; // Lower case name -> m_textures
+
+	CTextureCache m_cache;
+
+	std::mutex m_clients_mutex;
+	std::unordered_set<int> m_clients;
+	std::atomic<uint32_t> m_num_threads = 0;
+
+	std::atomic<bool> m_running = false;
+	int m_listen_fd = -1;
+
+	std::string m_error;
+	bool m_verbose = false;
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include <fstream>
+#include <cstring>
+
+#include "wad_writer.h"
+#include "mapped_file.h"
+#include "metrics.h"
+
+//	Lumps are kept aligned to 4 bytes.
+static constexpr uint64_t align4( uint64_t pos )
+{
+	return (pos + 3) & ~3ull;
+}
+
+bool CWadWriter::add_texture( const TextureData_t& tex, char type )
+{
+	std::vector<uint8_t> miptex;
+	if (!encode_miptex( tex, miptex ))
+		return fail( "Couldn't encode texture " + tex.name );
+
+	return add_lump( tex.name, type, miptex.data(), (uint32_t)miptex.size() );
+}
+
+bool CWadWriter::add_lump( const std::string& name, char type, const uint8_t* data, uint32_t disksize, char compression, uint32_t size )
+{
+	const auto lump = push_lump( name, type, data, disksize, compression, size );
+	if (!lump)
+		return false;
+
+	lump->data.assign( data, data + disksize );
+
+	return true;
+}
+
+bool CWadWriter::add_lump_ref( const std::string& name, char type, const uint8_t* data, uint32_t disksize, char compression, uint32_t size )
+{
+	const auto lump = push_lump( name, type, data, disksize, compression, size );
+	if (!lump)
+		return false;
+
+	lump->ref = data;
+
+	return true;
+}
+
+CWadWriter::PendingLump_t* CWadWriter::push_lump( const std::string& name, char type, const uint8_t* data, uint32_t disksize, char compression, uint32_t size )
+{
+	if (name.empty() || name.size() >= sizeof( LumpInfo_t::name ))
+	{
+		fail( "Invalid lump name: " + name );
+		return nullptr;
+	}
+
+	if (!data || !disksize)
+	{
+		fail( "Empty lump: " + name );
+		return nullptr;
+	}
+
+	PendingLump_t lump = {};
+	lump.info.disksize = disksize;
+	lump.info.size = size ? size : disksize;
+	lump.info.type = type;
+	lump.info.compression = compression;
+	strncpy( lump.info.name, name.c_str(), sizeof( lump.info.name ) - 1 );
+
+	m_lumps.push_back( std::move( lump ) );
+
+	return &m_lumps.back();
+}
+
+bool CWadWriter::write( std::vector<uint8_t>& out )
+{
+	uint64_t total;
+	if (!check_size( total ))
+		return false;
+
+	METRICS_TIMER( timer, "wad.encode" );
+	timer.add_bytes( total );
+
+	out.assign( total, 0 );
+
+	//	Lump data goes first, each lump aligned to 4 bytes, and the directory
+	//	is at the end of the file.
+	uint32_t pos = sizeof( WadHeader_t );
+	std::vector<LumpInfo_t> directory;
+	directory.reserve( m_lumps.size() );
+
+	for (const auto& lump : m_lumps)
+	{
+		LumpInfo_t info = lump.info;
+		info.filepos = pos;
+		SwapLumpInfo( info );
+		directory.push_back( info );
+
+		memcpy( out.data() + pos, lump.bytes(), lump.info.disksize );
+		pos += (uint32_t)align4( lump.info.disksize );
+	}
+
+	const WadHeader_t header = make_header( (uint32_t)directory.size(), pos );
+	memcpy( out.data(), &header, sizeof( header ) );
+
+	if (!directory.empty())
+		memcpy( out.data() + pos, directory.data(), directory.size() * sizeof( LumpInfo_t ) );
+
+	return true;
+}
+
+bool CWadWriter::write( const std::filesystem::path& path )
+{
+	uint64_t total;
+	if (!check_size( total ))
+		return false;
+
+	METRICS_TIMER( timer, "wad.write" );
+	timer.add_bytes( total );
+
+	//	The file is written next to the output and renamed over it once it's
+	//	complete, a failed write never leaves a half written WAD behind.
+	std::filesystem::path tmp_path;
+	if (!create_temp_file( path, tmp_path ))
+		return fail( "Couldn't open output file for writing: " + path.string() );
+
+	if (!write_file( tmp_path ))
+	{
+		std::error_code ec;
+		std::filesystem::remove( tmp_path, ec );
+		return fail( "Couldn't write output file: " + path.string() );
+	}
+
+	std::error_code ec;
+	std::filesystem::rename( tmp_path, path, ec );
+
+	if (ec)
+	{
+		std::filesystem::remove( tmp_path, ec );
+		return fail( "Couldn't replace output file: " + path.string() );
+	}
+
+	return true;
+}
+
+bool CWadWriter::write_file( const std::filesystem::path& path ) const
+{
+	std::ofstream ofs( path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+
+	if (!ofs.good())
+		return false;
+
+	//	Placeholder, the real header is written once the directory is known.
+	const WadHeader_t placeholder = {};
+	ofs.write( (const char*)&placeholder, sizeof( placeholder ) );
+
+	static const uint8_t padding[4] = {};
+	uint32_t pos = sizeof( WadHeader_t );
+
+	std::vector<LumpInfo_t> directory;
+	directory.reserve( m_lumps.size() );
+
+	for (const auto& lump : m_lumps)
+	{
+		LumpInfo_t info = lump.info;
+		info.filepos = pos;
+		SwapLumpInfo( info );
+		directory.push_back( info );
+
+		ofs.write( (const char*)lump.bytes(), lump.info.disksize );
+		ofs.write( (const char*)padding, align4( lump.info.disksize ) - lump.info.disksize );
+		pos += (uint32_t)align4( lump.info.disksize );
+	}
+
+	ofs.write( (const char*)directory.data(), directory.size() * sizeof( LumpInfo_t ) );
+
+	const WadHeader_t header = make_header( (uint32_t)directory.size(), pos );
+	ofs.seekp( 0 );
+	ofs.write( (const char*)&header, sizeof( header ) );
+	ofs.flush();
+
+	//	On the disk before the rename, or a crash could leave an empty file
+	//	in place of the old one.
+	return ofs.good() && sync_file( path );
+}
+
+bool CWadWriter::check_size( uint64_t& total )
+{
+	if (m_wad_id.size() != 4 || !CWadFile::check_wad_id( m_wad_id ))
+		return fail( "Invalid WAD id: " + m_wad_id );
+
+	total = sizeof( WadHeader_t ) + m_lumps.size() * sizeof( LumpInfo_t );
+	for (const auto& lump : m_lumps)
+		total += align4( lump.info.disksize );
+
+	if (total > UINT32_MAX)
+		return fail( "The WAD file would be too big." );
+
+	return true;
+}
+
+WadHeader_t CWadWriter::make_header( uint32_t numlumps, uint32_t infotableofs ) const
+{
+	WadHeader_t header;
+	memcpy( header.identification, m_wad_id.data(), sizeof( header.identification ) );
+	header.numlumps = numlumps;
+	header.infotableofs = infotableofs;
+	SwapWadHeader( header );
+
+	return header;
+}
+
+bool CWadWriter::encode_miptex( const TextureData_t& tex, std::vector<uint8_t>& out )
+{
+	if (!tex.width || !tex.height || tex.name.empty() || tex.name.size() >= sizeof( MipTexture_t::name ))
+		return false;
+
+	if (tex.m_palette_data.size() != tex.m_palette_colors)
+		return false;
+
+	MipTexture_t miptex = {};
+	strncpy( miptex.name, tex.name.c_str(), sizeof( miptex.name ) - 1 );
+	miptex.width = tex.width;
+	miptex.height = tex.height;
+
+	uint32_t pos = sizeof( MipTexture_t );
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+	{
+		const uint32_t mip_size = CWadFile::mip_width( tex.width, m ) * CWadFile::mip_height( tex.height, m );
+
+		if (tex.pixel_data[m].size() != mip_size)
+			return false;
+
+		miptex.offsets[m] = pos;
+		pos += mip_size;
+	}
+
+	const uint32_t palette_ofs = pos;
+	pos += sizeof( uint16_t ) + tex.m_palette_colors * sizeof( ColorData_t );
+
+	//	The original tools pad the lump to 4 bytes after the palette.
+	out.assign( (pos + 3) & ~3, 0 );
+
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+		memcpy( out.data() + miptex.offsets[m], tex.pixel_data[m].data(), tex.pixel_data[m].size() );
+
+	SwapMipTexture( miptex );
+	memcpy( out.data(), &miptex, sizeof( miptex ) );
+
+	const uint16_t palette_colors = LittleShort( tex.m_palette_colors );
+	memcpy( out.data() + palette_ofs, &palette_colors, sizeof( uint16_t ) );
+
+	uint8_t* pcolordata = out.data() + palette_ofs + sizeof( uint16_t );
+	for (const auto& color : tex.m_palette_data)
+	{
+		*pcolordata++ = color.Red;
+		*pcolordata++ = color.Green;
+		*pcolordata++ = color.Blue;
+	}
+
+	return true;
+}
+
+bool CWadWriter::fail( const std::string& msg )
+{
+	m_error = msg;
+	return false;
+}
@@ -0,0 +1,79 @@
+#ifndef WAD_WRITER_H
+#define WAD_WRITER_H
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+#include "wad.h"
+
+//	Collects the lumps of a WAD file and writes them out at once, in the order
+//	they were added. Writing to a file streams the lumps one after the other,
+//	and lumps added by reference aren't copied, so repacking a memory mapped
+//	WAD never holds a second copy of it.
+class CWadWriter
+{
+public:
+	CWadWriter( const std::string& wad_id = "WAD3" ) :
+		m_wad_id(wad_id)
+	{}
+
+	//	Encodes the texture as a MipTexture_t and adds it as a texture lump.
+	bool add_texture( const TextureData_t& tex, char type = LUMP_TYPE_TEXTURE );
+
+	//	Adds raw lump bytes as they are. The size is the uncompressed size of the
+	//	lump, if it's zero the data is treated as uncompressed.
+	bool add_lump( const std::string& name, char type, const uint8_t* data, uint32_t disksize, char compression = 0, uint32_t size = 0 );
+
+	//	Same as add_lump() without copying the bytes, they have to stay valid
+	//	until the WAD is written.
+	bool add_lump_ref( const std::string& name, char type, const uint8_t* data, uint32_t disksize, char compression = 0, uint32_t size = 0 );
+
+	//	Writes a placeholder header, the lumps and the directory, then the
+	//	real header, into a temporary file that replaces path at the end. The
+	//	old file stays intact if anything fails.
+	bool write( const std::filesystem::path& path );
+
+	//	Writes the whole WAD file into a memory buffer.
+	bool write( std::vector<uint8_t>& out );
+
+	size_t num_lumps() const { return m_lumps.size(); }
+	const std::string& error() const { return m_error; }
+
+	//	Encodes a texture into the MipTexture_t layout used inside WAD files:
+	//	the header, all of the mips, the palette color count and the palette.
+	static bool encode_miptex( const TextureData_t& tex, std::vector<uint8_t>& out );
+
+private:
+	struct PendingLump_t
+	{
+		LumpInfo_t info;
+
+		//	Either a copy of the bytes or the caller's buffer.
+		std::vector<uint8_t> data;
+		const uint8_t* ref;
+
+		const uint8_t* bytes() const { return ref ? ref : data.data(); }
+	};
+
+	bool write_file( const std::filesystem::path& path ) const;
+
+	PendingLump_t* push_lump( const std::string& name, char type, const uint8_t* data, uint32_t disksize, char compression, uint32_t size );
+
+	//	Checks the WAD id and that the file fits the 32 bit offsets.
+	bool check_size( uint64_t& total );
+	WadHeader_t make_header( uint32_t numlumps, uint32_t infotableofs ) const;
+
+	bool fail( const std::string& msg );
+
+private:
+	std::string m_wad_id;
+	std::deque<PendingLump_t> m_lumps;
+
+	std::string m_error;
+};
+
+#endif
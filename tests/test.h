@@ -0,0 +1,61 @@
+#ifndef TEST_H
+#define TEST_H
+
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <filesystem>
+
+#include "wad.h"
+
+//	Minimal test harness. Every TEST registers itself, the runner executes the
+//	ones whose name starts with the filter given on the command line.
+struct TestCase_t
+{
+	const char* name;
+	void (*fn)();
+};
+
+std::vector<TestCase_t>& test_registry();
+
+struct TestRegistrar_t
+{
+	TestRegistrar_t( const char* name, void (*fn)() ) { test_registry().push_back( { name, fn } ); }
+};
+
+void test_fail( const char* file, int line, const char* expr );
+
+#define TEST( name )															\
+	static void test_##name();													\
+	static TestRegistrar_t s_registrar_##name( #name, test_##name );			\
+	static void test_##name()
+
+#define CHECK( cond )															\
+	do { if (!(cond)) test_fail( __FILE__, __LINE__, #cond ); } while (0)
+
+//	Stops the test, for checks that the rest of the test depends on.
+#define REQUIRE( cond )															\
+	do { if (!(cond)) { test_fail( __FILE__, __LINE__, #cond ); return; } } while (0)
+
+//	File in the temp directory that's removed when it goes out of scope.
+class CTempFile
+{
+public:
+	CTempFile( const std::string& extension );
+	~CTempFile();
+
+	const std::filesystem::path& path() const { return m_path; }
+
+private:
+	std::filesystem::path m_path;
+};
+
+//	Texture with random pixels in every mip and a random palette.
+TextureData_t random_texture( std::mt19937& rng, const std::string& name, uint32_t width, uint32_t height, uint32_t num_colors = 256 );
+
+bool textures_equal( const TextureData_t& a, const TextureData_t& b );
+
+#endif
@@ -0,0 +1,187 @@
+#include <cstring>
+#include <algorithm>
+
+#include "test.h"
+#include "wad_writer.h"
+#include "texture_analysis.h"
+#include "wad_repair.h"
+#include "wad_compression.h"
+#include "mipgen.h"
+
+TEST( analysis_accepts_generated_mips )
+{
+	std::mt19937 rng( 34 );
+
+	for (const char* name : { "tex", "{tex" })
+	{
+		auto tex = random_texture( rng, name, 64, 32 );
+		REQUIRE( generate_mips( tex ) );
+
+		TextureStats_t stats;
+		REQUIRE( analyze_texture( tex, stats ) );
+		CHECK( stats.mips_consistent );
+		CHECK( stats.power_of_two );
+		CHECK( stats.transparent == (name[0] == '{') );
+
+		//	Blank lower mips have to be caught.
+		for (uint32_t m = 1; m < MIPLEVELS; m++)
+			std::fill( tex.pixel_data[m].begin(), tex.pixel_data[m].end(), 0 );
+
+		REQUIRE( analyze_texture( tex, stats ) );
+		CHECK( !stats.mips_consistent );
+	}
+}
+
+TEST( repair_regenerates_broken_mips )
+{
+	std::mt19937 rng( 35 );
+
+	std::vector<TextureData_t> textures;
+	for (const char* name : { "good", "broken", "{stale" })
+	{
+		textures.push_back( random_texture( rng, name, 64, 32 ) );
+		REQUIRE( generate_mips( textures.back() ) );
+	}
+
+	//	Blank lower mips, and lower mips of a different texture.
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+		std::fill( textures[1].pixel_data[m].begin(), textures[1].pixel_data[m].end(), 0 );
+
+	auto other = random_texture( rng, "other", 64, 32 );
+	REQUIRE( generate_mips( other ) );
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+		textures[2].pixel_data[m] = other.pixel_data[m];
+
+	const uint8_t font[100] = { 1, 2, 3 };
+
+	CTempFile source( ".wad" ), repaired( ".wad" );
+
+	{
+		CWadWriter writer;
+		for (const auto& tex : textures)
+			REQUIRE( writer.add_texture( tex ) );
+
+		REQUIRE( writer.add_lump( "font", LUMP_TYPE_FONT, font, sizeof( font ) ) );
+		REQUIRE( writer.write( source.path() ) );
+	}
+
+	CWadFile wad( source.path() );
+	REQUIRE( wad.open() );
+
+	CWadRepair repair;
+	const auto broken = repair.verify( { &wad } );
+	CHECK( repair.num_checked() == textures.size() );
+
+	REQUIRE( broken.size() == 2 );
+	CHECK( broken[0].name == "broken" && broken[0].lump_index == 1 );
+	CHECK( broken[1].name == "{stale" && broken[1].lump_index == 2 );
+
+	//	Writing over the source isn't allowed.
+	CHECK( !repair.repair( wad, broken, source.path() ) );
+	REQUIRE( repair.repair( wad, broken, repaired.path() ) );
+
+	CWadFile result( repaired.path() );
+	REQUIRE( result.process() );
+	REQUIRE( result.lumps().size() == wad.lumps().size() );
+	REQUIRE( result.textures().size() == textures.size() );
+
+	CHECK( textures_equal( result.textures()[0], textures[0] ) );
+
+	for (size_t i = 1; i < textures.size(); i++)
+	{
+		CHECK( result.textures()[i].pixel_data[0] == textures[i].pixel_data[0] );
+		CHECK( result.textures()[i].pixel_data[1] != textures[i].pixel_data[1] );
+	}
+
+	const auto copied = result.lumps()[3];
+	CHECK( copied->disksize == sizeof( font ) && !memcmp( result.lump_data( copied ), font, sizeof( font ) ) );
+
+	CHECK( repair.verify( { &result } ).empty() );
+}
+
+TEST( repair_keeps_lump_names_and_compression )
+{
+	std::mt19937 rng( 36 );
+
+	auto tex = random_texture( rng, "miptex_name", 64, 32 );
+	REQUIRE( generate_mips( tex ) );
+
+	//	Decal indices are opacities, the palette is a ramp up to the color.
+	auto decal = random_texture( rng, "logo", 32, 32 );
+	for (uint32_t i = 0; i < 256; i++)
+		decal.m_palette_data[i] = { (uint8_t)i, (uint8_t)i, (uint8_t)i };
+
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+	{
+		std::fill( tex.pixel_data[m].begin(), tex.pixel_data[m].end(), 0 );
+		std::fill( decal.pixel_data[m].begin(), decal.pixel_data[m].end(), 0 );
+	}
+
+	const char compression = is_compression_supported( LUMP_COMPRESSION_DEFLATE ) ? LUMP_COMPRESSION_DEFLATE : LUMP_COMPRESSION_NONE;
+
+	CTempFile source( ".wad" ), repaired( ".wad" );
+
+	{
+		CWadWriter writer;
+
+		std::vector<uint8_t> miptex, compressed;
+		REQUIRE( CWadWriter::encode_miptex( tex, miptex ) );
+
+		if (compression != LUMP_COMPRESSION_NONE && compress_lump( miptex.data(), (uint32_t)miptex.size(), compression, compressed ))
+			REQUIRE( writer.add_lump( "dir_name", LUMP_TYPE_TEXTURE, compressed.data(), (uint32_t)compressed.size(), compression, (uint32_t)miptex.size() ) );
+		else
+			REQUIRE( writer.add_lump( "dir_name", LUMP_TYPE_TEXTURE, miptex.data(), (uint32_t)miptex.size() ) );
+
+		REQUIRE( writer.add_texture( decal, LUMP_TYPE_DECAL ) );
+		REQUIRE( writer.write( source.path() ) );
+	}
+
+	CWadFile wad( source.path() );
+	REQUIRE( wad.open() );
+
+	CWadRepair repair;
+	const auto broken = repair.verify( { &wad } );
+	REQUIRE( broken.size() == 2 );
+	REQUIRE( repair.repair( wad, broken, repaired.path() ) );
+
+	CWadFile result( repaired.path() );
+	REQUIRE( result.process() );
+	REQUIRE( result.lumps().size() == 2 );
+
+	const auto lump = result.lumps()[0];
+	CHECK( CWadFile::lump_name( lump ) == "dir_name" );
+	CHECK( lump->type == wad.lumps()[0]->type && lump->compression == wad.lumps()[0]->compression );
+
+	const auto& fixed = result.textures()[0];
+	CHECK( fixed.name == "miptex_name" );
+	CHECK( fixed.pixel_data[0] == tex.pixel_data[0] );
+	CHECK( fixed.pixel_data[1] != tex.pixel_data[1] );
+
+	//	Every decal mip pixel is the rounded average of its box of indices.
+	CHECK( result.lumps()[1]->type == LUMP_TYPE_DECAL );
+
+	const auto& logo = result.textures()[1];
+	REQUIRE( logo.pixel_data[0] == decal.pixel_data[0] );
+
+	for (uint32_t m = 1; m < MIPLEVELS; m++)
+	{
+		const uint32_t width = CWadFile::mip_width( decal.width, m ), box = 1 << m;
+		REQUIRE( logo.pixel_data[m].size() == width * CWadFile::mip_height( decal.height, m ) );
+
+		for (size_t i = 0; i < logo.pixel_data[m].size(); i++)
+		{
+			const uint32_t x = (uint32_t)(i % width) * box, y = (uint32_t)(i / width) * box;
+
+			uint32_t sum = 0;
+			for (uint32_t by = 0; by < box; by++)
+			{
+				for (uint32_t bx = 0; bx < box; bx++)
+					sum += decal.pixel_data[0][(y + by) * decal.width + x + bx];
+			}
+
+			CHECK( logo.pixel_data[m][i] == (sum + box * box / 2) / (box * box) );
+		}
+	}
+
+	CHECK( repair.verify( { &result } ).empty() );
+}
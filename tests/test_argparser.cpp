@@ -0,0 +1,112 @@
+#include <memory>
+#include <algorithm>
+
+#include "test.h"
+#include "argparser.h"
+
+//	Parses a command line given as a single string, split on spaces.
+struct Args_t
+{
+	Args_t( const std::string& line )
+	{
+		words.push_back( "wadwalk" );
+
+		size_t begin = 0;
+		while (begin < line.size())
+		{
+			const size_t end = std::min( line.find( ' ', begin ), line.size() );
+			words.push_back( line.substr( begin, end - begin ) );
+			begin = end + 1;
+		}
+
+		for (auto& word : words)
+			argv.push_back( word.data() );
+
+		argv.push_back( nullptr );
+	}
+
+	bool parse()
+	{
+		parser = std::make_unique<CArgumentParser>( (int32_t)words.size(), argv.data() );
+		return parser->parse();
+	}
+
+	std::vector<std::string> words;
+	std::vector<char*> argv;
+	std::unique_ptr<CArgumentParser> parser;
+};
+
+TEST( argparser_typed_options )
+{
+	Args_t args( "export a.wad dir --mips 3 -o out --threads=4" );
+	REQUIRE( args.parse() );
+
+	const auto& p = *args.parser;
+	CHECK( p.command() == CmdExport );
+	CHECK( p.inputs() == std::vector<std::string>( { "a.wad", "dir" } ) );
+	CHECK( p.get_uint( OptMips, 1 ) == 3 );
+	CHECK( p.get_uint( OptThreads ) == 4 );
+	CHECK( p.value( OptOut ) == "out" );
+	CHECK( !p.has( OptMetrics ) );
+	CHECK( p.value( OptTrace, "fallback" ) == "fallback" );
+}
+
+TEST( argparser_repeatable_and_dashes )
+{
+	//	Values can start with a dash, inputs after -- too.
+	Args_t args( "edit --delete -0floor --add a.bmp --add b.bmp --compact -- -odd.wad" );
+	REQUIRE( args.parse() );
+
+	const auto& p = *args.parser;
+	CHECK( p.values( OptAdd ) == std::vector<std::string>( { "a.bmp", "b.bmp" } ) );
+	CHECK( p.value( OptDelete ) == "-0floor" );
+	CHECK( p.has( OptCompact ) );
+	CHECK( p.inputs() == std::vector<std::string>( { "-odd.wad" } ) );
+}
+
+TEST( argparser_rejects_invalid )
+{
+	const char* invalid[] =
+	{
+		"",
+		"frob a.wad",
+		"export",							// No input
+		"export a.wad --mips 5",			// Out of range
+		"export a.wad --mips 1x",			// Not a number
+		"export a.wad --mips",				// No value
+		"export a.wad --out a --out b",		// Not repeatable
+		"export a.wad --compact",			// Not an option of export
+		"export a.wad --frob",
+		"info a.wad --metrics=1",			// Flags take no value
+		"search a.wad",						// --query is required
+		"search a.wad -q x --mode fuzzy",	// Not one of the choices
+		"verify a.wad --tolerance 300",
+		"verify a.wad --tolerance abc",
+		"repair a.wad b.wad -o c.wad",		// Single input
+		"bench a.wad",
+	};
+
+	for (const char* line : invalid)
+	{
+		Args_t args( line );
+		const bool accepted = args.parse();
+
+		if (accepted)
+			printf( "  accepted: \"%s\"\n", line );
+
+		CHECK( !accepted );
+		CHECK( !args.parser->error().empty() );
+	}
+}
+
+TEST( argparser_help )
+{
+	Args_t args( "pack --help" );
+	REQUIRE( args.parse() );
+	CHECK( args.parser->command() == CmdPack );
+	CHECK( args.parser->has( OptHelp ) );
+
+	Args_t help( "--help" );
+	REQUIRE( help.parse() );
+	CHECK( help.parser->command() == CmdHelp );
+}
@@ -0,0 +1,124 @@
+#include <fstream>
+
+#include <cstring>
+
+#include "test.h"
+#include "bmp.h"
+
+//	Write -> Read gives back the same pixels and palette, for every row padding.
+TEST( bmp_roundtrip )
+{
+	std::mt19937 rng( 10 );
+
+	for (uint32_t width = 1; width <= 33; width++)
+	{
+		const uint32_t height = 1 + rng() % 20;
+
+		std::vector<uint8_t> bits( width * height ), palette( CBitMap::kPaletteSize );
+		for (auto& b : bits)
+			b = (uint8_t)rng();
+		for (auto& p : palette)
+			p = (uint8_t)rng();
+
+		CTempFile file( ".bmp" );
+		REQUIRE( CBitMap::Write( file.path().string().c_str(), width, height, bits.data(), palette.data() ) == EBMPResult::Success );
+
+		uint8_t* read_bits = nullptr;
+		uint8_t* read_palette = nullptr;
+		uint32_t read_width = 0, read_height = 0;
+
+		REQUIRE( CBitMap::Read( file.path().string().c_str(), &read_bits, &read_palette, &read_width, &read_height ) == EBMPResult::Success );
+
+		CHECK( read_width == width );
+		CHECK( read_height == height );
+
+		if (read_width == width && read_height == height)
+			CHECK( !memcmp( read_bits, bits.data(), bits.size() ) );
+
+		CHECK( !memcmp( read_palette, palette.data(), palette.size() ) );
+
+		free( read_bits );
+		free( read_palette );
+	}
+}
+
+TEST( bmp_encode_matches_header )
+{
+	std::vector<uint8_t> bits( 5 * 3, 7 ), palette( CBitMap::kPaletteSize, 1 ), out;
+	REQUIRE( CBitMap::Encode( 5, 3, bits.data(), palette.data(), out ) == EBMPResult::Success );
+
+	BitmapFileHeader_t bmfh;
+	BitmapInfoHeader_t bmih;
+	memcpy( &bmfh, out.data(), sizeof( bmfh ) );
+	memcpy( &bmih, out.data() + sizeof( bmfh ), sizeof( bmih ) );
+	SwapBitmapFileHeader( bmfh );
+	SwapBitmapInfoHeader( bmih );
+
+	CHECK( bmfh.bfSize == out.size() );
+	CHECK( bmih.biWidth == 5 );
+	CHECK( bmih.biHeight == 3 );
+
+	//	Rows are padded to 8 bytes.
+	CHECK( out.size() == bmfh.bfOffBits + 8 * 3 );
+}
+
+//	Garbage and truncated files have to fail cleanly.
+TEST( bmp_rejects_garbage )
+{
+	std::mt19937 rng( 11 );
+
+	std::vector<uint8_t> bits( 16 * 16 ), palette( CBitMap::kPaletteSize ), valid;
+	REQUIRE( CBitMap::Encode( 16, 16, bits.data(), palette.data(), valid ) == EBMPResult::Success );
+
+	for (uint32_t iteration = 0; iteration < 64; iteration++)
+	{
+		auto data = valid;
+
+		if (iteration & 1)
+			data.resize( rng() % data.size() );
+		else
+		{
+			for (uint32_t i = 0; i < 4; i++)
+				data[rng() % (sizeof( BitmapFileHeader_t ) + sizeof( BitmapInfoHeader_t ))] = (uint8_t)rng();
+		}
+
+		CTempFile file( ".bmp" );
+		{
+			std::ofstream ofs( file.path(), std::ios::binary );
+			ofs.write( (const char*)data.data(), data.size() );
+		}
+
+		uint8_t* read_bits = nullptr;
+		uint8_t* read_palette = nullptr;
+
+		if (CBitMap::Read( file.path().string().c_str(), &read_bits, &read_palette ) == EBMPResult::Success)
+		{
+			free( read_bits );
+			free( read_palette );
+		}
+	}
+}
+
+//	The width specialized row writers produce the same rows as the padded one.
+TEST( bmp_row_writers_match_padded )
+{
+	std::mt19937 rng( 12 );
+
+	for (uint32_t width = 1; width <= 520; width++)
+	{
+		const uint32_t height = 3;
+
+		std::vector<uint8_t> bits( width * height );
+		for (auto& b : bits)
+			b = (uint8_t)rng();
+
+		std::vector<uint8_t> reference( ((width + 3) & ~3) * height + 1, 0xCD );
+		std::vector<uint8_t> out( reference.size(), 0xCD );
+
+		CBitMap::WriteRowsPadded( bits.data(), width, height, reference.data() );
+		CBitMap::GetRowWriter( width )( bits.data(), width, height, out.data() );
+
+		CHECK( out == reference );
+		CHECK( out.back() == 0xCD );
+	}
+}
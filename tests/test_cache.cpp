@@ -0,0 +1,181 @@
+#include "test.h"
+#include "lru_cache.h"
+#include "texture_cache.h"
+#include "wad_writer.h"
+
+TEST( lru_cache_respects_budget )
+{
+	std::mt19937 rng( 33 );
+
+	CShardedLruCache<uint32_t, uint32_t> cache( 4096, 4 );
+
+	for (uint32_t i = 0; i < 10000; i++)
+	{
+		const uint32_t key = rng() % 512;
+
+		if (const auto value = cache.get( key ))
+			CHECK( *value == key * 3 );
+		else
+			cache.put( key, std::make_shared<const uint32_t>( key * 3 ), 1 + rng() % 64 );
+
+		CHECK( cache.stats().bytes <= 4096 );
+	}
+
+	const auto stats = cache.stats();
+	CHECK( stats.hits + stats.misses == 10000 );
+	CHECK( stats.evictions > 0 );
+}
+
+static bool write_wad( const std::vector<TextureData_t>& textures, const std::filesystem::path& path )
+{
+	CWadWriter writer;
+
+	for (const auto& tex : textures)
+	{
+		if (!writer.add_texture( tex ))
+			return false;
+	}
+
+	return writer.write( path );
+}
+
+//	The decoded texture and every mip and format encoded out of it are cached
+//	under their own keys.
+TEST( texture_cache_keys_textures_and_encodings )
+{
+	std::mt19937 rng( 34 );
+
+	const auto tex = random_texture( rng, "crete1", 32, 32 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( { tex }, file.path() ) );
+
+	CWadFile wad( file.path() );
+	REQUIRE( wad.open() );
+
+	const auto lump = wad.lumps()[0];
+	CTextureCache cache( 1 << 20, 1 << 20, 4 );
+
+	const auto decoded = cache.get_texture( wad, lump );
+	REQUIRE( decoded );
+	CHECK( textures_equal( *decoded, tex ) );
+	CHECK( cache.get_texture( wad, lump ) == decoded );
+
+	//	The encoder tags its output with the mip and format it was asked for.
+	uint32_t encodes = 0;
+
+	const auto encoded = [&]( uint32_t mip, uint32_t format )
+	{
+		return cache.get_encoded( wad, lump, mip, format, [&]( const TextureData_t& t, std::vector<uint8_t>& out )
+		{
+			encodes++;
+			out = { (uint8_t)mip, (uint8_t)format, (uint8_t)t.width };
+			return true;
+		} );
+	};
+
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		for (uint32_t mip = 0; mip < MIPLEVELS; mip++)
+		{
+			for (uint32_t format = 0; format < 2; format++)
+			{
+				const auto blob = encoded( mip, format );
+				REQUIRE( blob );
+				CHECK( *blob == std::vector<uint8_t>( { (uint8_t)mip, (uint8_t)format, 32 } ) );
+			}
+		}
+	}
+
+	CHECK( encodes == MIPLEVELS * 2 );
+
+	//	Every encoding was made out of the one decoded texture.
+	const auto decoded_stats = cache.decoded_stats();
+	CHECK( decoded_stats.entries == 1 && decoded_stats.misses == 1 );
+
+	const auto encoded_stats = cache.encoded_stats();
+	CHECK( encoded_stats.entries == MIPLEVELS * 2 );
+	CHECK( encoded_stats.hits == MIPLEVELS * 2 && encoded_stats.misses == MIPLEVELS * 2 );
+
+	//	A failed encoding isn't cached.
+	CHECK( !cache.get_encoded( wad, lump, 0, 7, []( const TextureData_t&, std::vector<uint8_t>& ) { return false; } ) );
+	CHECK( cache.encoded_stats().entries == MIPLEVELS * 2 );
+}
+
+//	Entries are keyed by CWadFile::serial(), so a WAD that's opened again
+//	after the file changed never gets the textures of the old one.
+TEST( texture_cache_tells_wad_files_apart )
+{
+	std::mt19937 rng( 35 );
+
+	const auto before = random_texture( rng, "crete1", 16, 16 );
+	const auto after = random_texture( rng, "crete1", 32, 16 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( { before }, file.path() ) );
+
+	CTextureCache cache( 1 << 20, 1 << 20, 4 );
+
+	CWadFile old_wad( file.path() );
+	REQUIRE( old_wad.open() );
+
+	const auto old_tex = cache.get_texture( old_wad, old_wad.lumps()[0] );
+	REQUIRE( old_tex );
+	CHECK( textures_equal( *old_tex, before ) );
+
+	REQUIRE( write_wad( { after }, file.path() ) );
+
+	CWadFile new_wad( file.path() );
+	REQUIRE( new_wad.open() );
+	CHECK( new_wad.serial() != old_wad.serial() );
+
+	const auto new_tex = cache.get_texture( new_wad, new_wad.lumps()[0] );
+	REQUIRE( new_tex );
+	CHECK( textures_equal( *new_tex, after ) );
+
+	//	The old WAD still gets its own texture.
+	CHECK( cache.get_texture( old_wad, old_wad.lumps()[0] ) == old_tex );
+	CHECK( cache.decoded_stats().entries == 2 );
+}
+
+//	Something bigger than a shard's part of the budget is handed out, but
+//	never cached.
+TEST( texture_cache_rejects_oversized_entries )
+{
+	std::mt19937 rng( 36 );
+
+	const auto tex = random_texture( rng, "big", 64, 64 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( { tex }, file.path() ) );
+
+	CWadFile wad( file.path() );
+	REQUIRE( wad.open() );
+
+	const auto lump = wad.lumps()[0];
+
+	//	A shard gets 1 KiB of each budget, the texture has 5 KiB of pixels.
+	CTextureCache cache( 4096, 4096, 4 );
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		const auto decoded = cache.get_texture( wad, lump );
+		REQUIRE( decoded );
+		CHECK( textures_equal( *decoded, tex ) );
+	}
+
+	auto stats = cache.decoded_stats();
+	CHECK( stats.rejections == 2 && stats.entries == 0 && stats.bytes == 0 );
+
+	const auto blob = cache.get_encoded( wad, lump, 0, 0, []( const TextureData_t& t, std::vector<uint8_t>& out )
+	{
+		out = t.pixel_data[0];
+		return true;
+	} );
+
+	REQUIRE( blob );
+	CHECK( *blob == tex.pixel_data[0] );
+
+	stats = cache.encoded_stats();
+	CHECK( stats.rejections == 1 && stats.entries == 0 );
+}
@@ -0,0 +1,305 @@
+#include <fstream>
+#include <cstring>
+
+#include "test.h"
+#include "bmp.h"
+#include "sprite.h"
+#include "model.h"
+
+template<typename T>
+static void append( std::vector<uint8_t>& out, const T& value )
+{
+	const size_t pos = out.size();
+	out.resize( pos + sizeof( T ) );
+	memcpy( out.data() + pos, &value, sizeof( T ) );
+}
+
+static void append_random( std::mt19937& rng, std::vector<uint8_t>& out, size_t count, uint32_t modulo = 256 )
+{
+	for (size_t i = 0; i < count; i++)
+		out.push_back( (uint8_t)(rng() % modulo) );
+}
+
+static void write_file( const std::filesystem::path& path, const std::vector<uint8_t>& data )
+{
+	std::ofstream ofs( path, std::ios_base::binary | std::ios_base::trunc );
+	ofs.write( (const char*)data.data(), data.size() );
+}
+
+struct FrameSize_t
+{
+	int32_t width, height;
+};
+
+//	A sprite with the frames as single frames, except for the ones in [group_begin, group_end).
+static std::vector<uint8_t> make_sprite( std::mt19937& rng, const std::vector<FrameSize_t>& frames, size_t group_begin, size_t group_end, uint16_t num_colors )
+{
+	std::vector<uint8_t> out;
+
+	SpriteHeader_t header = {};
+	memcpy( header.ident, "IDSP", 4 );
+	header.version = SPRITE_VERSION;
+	header.tex_format = SPRITE_ALPHATEST;
+	header.numframes = (int32_t)(frames.size() - (group_end - group_begin) + (group_end > group_begin ? 1 : 0));
+	append( out, header );
+
+	append( out, num_colors );
+	append_random( rng, out, num_colors * 3 );
+
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		if (i == group_begin && group_end > group_begin)
+		{
+			append( out, (int32_t)SPRITE_FRAME_GROUP );
+			append( out, (int32_t)(group_end - group_begin) );
+
+			for (size_t j = group_begin; j < group_end; j++)
+				append( out, 0.1f );
+		}
+
+		if (i < group_begin || i >= group_end)
+			append( out, (int32_t)SPRITE_FRAME_SINGLE );
+
+		append( out, SpriteFrameHeader_t{ { -(int32_t)i, (int32_t)i }, frames[i].width, frames[i].height } );
+		append_random( rng, out, frames[i].width * frames[i].height, num_colors );
+	}
+
+	return out;
+}
+
+static std::vector<uint8_t> make_model( std::mt19937& rng, const std::vector<FrameSize_t>& textures )
+{
+	std::vector<uint8_t> out( 244 );
+
+	ModelHeader_t header = {};
+	memcpy( header.ident, "IDST", 4 );
+	header.version = MODEL_VERSION;
+	header.numtextures = (int32_t)textures.size();
+	header.textureindex = (int32_t)out.size();
+	header.texturedataindex = header.textureindex + (int32_t)(textures.size() * sizeof( ModelTextureHeader_t ));
+	memcpy( out.data(), &header, sizeof( header ) );
+
+	int32_t index = header.texturedataindex;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		ModelTextureHeader_t texture = {};
+		snprintf( texture.name, sizeof( texture.name ), "skin%d.bmp", (int)i );
+		texture.flags = i ? MODEL_NF_MASKED : 0;
+		texture.width = textures[i].width;
+		texture.height = textures[i].height;
+		texture.index = index;
+		append( out, texture );
+
+		index += textures[i].width * textures[i].height + MODEL_PALETTE_SIZE;
+	}
+
+	for (const auto& texture : textures)
+		append_random( rng, out, texture.width * texture.height + MODEL_PALETTE_SIZE );
+
+	return out;
+}
+
+TEST( sprite_reads_single_and_grouped_frames )
+{
+	std::mt19937 rng( 50 );
+
+	const std::vector<FrameSize_t> sizes = { { 8, 4 }, { 5, 3 }, { 3, 7 }, { 1, 1 } };
+	const auto data = make_sprite( rng, sizes, 1, 3, 200 );
+
+	CTempFile file( ".spr" );
+	write_file( file.path(), data );
+
+	CSpriteFile sprite( file.path() );
+	REQUIRE( sprite.open() );
+	REQUIRE( sprite.frames().size() == sizes.size() );
+
+	CHECK( sprite.header().tex_format == SPRITE_ALPHATEST );
+
+	//	The frames come right after each other, so the pixels can be found by
+	//	walking the buffer backwards from the end.
+	size_t end = data.size();
+	for (size_t i = sizes.size(); i-- > 0;)
+	{
+		const auto& frame = sprite.frames()[i];
+		const size_t size = sizes[i].width * sizes[i].height;
+
+		CHECK( frame.image.name == file.path().stem().string() + "_" + std::to_string( i ) );
+		CHECK( frame.image.width == (uint32_t)sizes[i].width );
+		CHECK( frame.image.height == (uint32_t)sizes[i].height );
+		CHECK( frame.image.num_colors == 200 );
+		CHECK( frame.image.palette == sprite.frames()[0].image.palette );
+		CHECK( frame.origin_x == -(int32_t)i && frame.origin_y == (int32_t)i );
+		CHECK( !memcmp( frame.image.pixels, data.data() + end - size, size ) );
+
+		end -= size + sizeof( SpriteFrameHeader_t );
+
+		//	The frame type, and the group header before the first frame of the group.
+		if (i == 0 || i == 3)
+			end -= sizeof( int32_t );
+		else if (i == 1)
+			end -= 2 * sizeof( int32_t ) + 2 * sizeof( float );
+	}
+
+	CHECK( !memcmp( sprite.frames()[0].image.palette, data.data() + sizeof( SpriteHeader_t ) + sizeof( uint16_t ), 200 * 3 ) );
+}
+
+TEST( sprite_rejects_truncated_and_quake_sprites )
+{
+	std::mt19937 rng( 51 );
+
+	const auto data = make_sprite( rng, { { 4, 4 }, { 2, 6 }, { 3, 3 } }, 1, 3, 256 );
+
+	//	Every prefix of the file is missing a part of a frame, or the palette.
+	for (size_t size = 0; size < data.size(); size += 1 + size / 8)
+	{
+		CTempFile file( ".spr" );
+		write_file( file.path(), std::vector<uint8_t>( data.begin(), data.begin() + size ) );
+
+		CSpriteFile sprite( file.path() );
+		CHECK( !sprite.open() );
+	}
+
+	auto quake = data;
+	quake[4] = 1;
+
+	CTempFile file( ".spr" );
+	write_file( file.path(), quake );
+
+	CSpriteFile sprite( file.path() );
+	CHECK( !sprite.open() );
+}
+
+TEST( model_reads_textures )
+{
+	std::mt19937 rng( 52 );
+
+	const std::vector<FrameSize_t> sizes = { { 16, 8 }, { 7, 5 } };
+	const auto data = make_model( rng, sizes );
+
+	CTempFile file( ".mdl" );
+	write_file( file.path(), data );
+
+	CModelFile model( file.path() );
+	REQUIRE( model.open() );
+	REQUIRE( model.textures().size() == sizes.size() );
+
+	CHECK( model.texture_path() == file.path() );
+
+	size_t index = 244 + sizes.size() * sizeof( ModelTextureHeader_t );
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		const auto& texture = model.textures()[i];
+		const size_t size = sizes[i].width * sizes[i].height;
+
+		CHECK( texture.image.name == "skin" + std::to_string( i ) + ".bmp" );
+		CHECK( texture.image.width == (uint32_t)sizes[i].width );
+		CHECK( texture.image.height == (uint32_t)sizes[i].height );
+		CHECK( texture.image.num_colors == 256 );
+		CHECK( (texture.flags & MODEL_NF_MASKED) == (i ? MODEL_NF_MASKED : 0) );
+		CHECK( !memcmp( texture.image.pixels, data.data() + index, size ) );
+		CHECK( !memcmp( texture.image.palette, data.data() + index + size, MODEL_PALETTE_SIZE ) );
+
+		index += size + MODEL_PALETTE_SIZE;
+	}
+
+	//	A texture that runs past the end of the file.
+	CTempFile truncated( ".mdl" );
+	write_file( truncated.path(), std::vector<uint8_t>( data.begin(), data.end() - 1 ) );
+
+	CModelFile bad( truncated.path() );
+	CHECK( !bad.open() );
+}
+
+TEST( model_reads_external_textures )
+{
+	std::mt19937 rng( 53 );
+
+	CTempFile file( ".mdl" );
+	write_file( file.path(), make_model( rng, {} ) );
+
+	//	Without the T.mdl the model simply has no textures.
+	{
+		CModelFile model( file.path() );
+		REQUIRE( model.open() );
+		CHECK( model.textures().empty() );
+	}
+
+	auto texture_path = file.path();
+	texture_path.replace_filename( file.path().stem().string() + "T.mdl" );
+	write_file( texture_path, make_model( rng, { { 4, 4 } } ) );
+
+	CModelFile model( file.path() );
+	CHECK( model.open() );
+	CHECK( model.textures().size() == 1 );
+	CHECK( model.texture_path() == texture_path );
+
+	std::error_code ec;
+	std::filesystem::remove( texture_path, ec );
+}
+
+//	WAD mips, sprite frames and model skins all go through the same writer
+//	and come back the same, the palette entries past num_colors as black.
+TEST( images_write_bmp_images )
+{
+	std::mt19937 rng( 54 );
+
+	const auto tex = random_texture( rng, "images", 32, 16, 100 );
+
+	CTempFile sprite_file( ".spr" );
+	write_file( sprite_file.path(), make_sprite( rng, { { 5, 5 }, { 3, 9 }, { 12, 1 } }, 0, 2, 17 ) );
+
+	CSpriteFile sprite( sprite_file.path() );
+	REQUIRE( sprite.open() );
+
+	CTempFile model_file( ".mdl" );
+	write_file( model_file.path(), make_model( rng, { { 6, 2 } } ) );
+
+	CModelFile model( model_file.path() );
+	REQUIRE( model.open() );
+
+	std::vector<CTempFile> outputs;
+	std::vector<ImageFile_t> files;
+	outputs.reserve( 16 );
+
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+		files.push_back( { outputs.emplace_back( ".bmp" ).path(), tex.mip_image( m ) } );
+
+	for (const auto& frame : sprite.frames())
+		files.push_back( { outputs.emplace_back( ".bmp" ).path(), frame.image } );
+
+	for (const auto& texture : model.textures())
+		files.push_back( { outputs.emplace_back( ".bmp" ).path(), texture.image } );
+
+	std::string error;
+	REQUIRE( write_bmp_images( files, error, 4 ) );
+
+	for (const auto& file : files)
+	{
+		IndexedImage_t image;
+		REQUIRE( CBitMap::Read( file.path.string().c_str(), image ) == EBMPResult::Success );
+
+		CHECK( image.width == file.image.width );
+		CHECK( image.height == file.image.height );
+		CHECK( !memcmp( image.pixels.data(), file.image.pixels, image.pixels.size() ) );
+
+		REQUIRE( image.palette.size() == 256 );
+		CHECK( !memcmp( image.palette.data(), file.image.palette, file.image.num_colors * sizeof( ColorData_t ) ) );
+
+		for (uint32_t i = file.image.num_colors; i < 256; i++)
+			CHECK( !image.palette[i].Red && !image.palette[i].Green && !image.palette[i].Blue );
+	}
+
+	//	The first file that can't be written is reported.
+	files[2].path = std::filesystem::temp_directory_path() / "wadtest_missing_dir" / "a.bmp";
+	files[4].path = files[2].path;
+	CHECK( !write_bmp_images( files, error ) );
+	CHECK( error.find( "wadtest_missing_dir" ) != std::string::npos );
+}
+
+TEST( images_file_names )
+{
+	CHECK( image_file_name( "skin.bmp" ) == "skin" );
+	CHECK( image_file_name( "dir/skin.bmp" ) == "dir_skin" );
+	CHECK( image_file_name( "a:b\\c" ) == "a_b_c" );
+	CHECK( image_file_name( ".hidden" ) == ".hidden" );
+}
@@ -0,0 +1,155 @@
+#include <set>
+#include <algorithm>
+
+#include "test.h"
+#include "texture_index.h"
+#include "perceptual_hash.h"
+#include "mipgen.h"
+
+static std::string random_name( std::mt19937& rng )
+{
+	static const char prefixes[][3] = { "", "", "+0", "+1", "+a", "-0", "{" };
+	static const char alphabet[] = "abc12";
+
+	std::string name = prefixes[rng() % std::size( prefixes )];
+	const uint32_t length = 1 + rng() % 6;
+
+	for (uint32_t i = 0; i < length; i++)
+		name += alphabet[rng() % (std::size( alphabet ) - 1)];
+
+	return name;
+}
+
+static std::vector<uint32_t> lump_indices( const std::vector<const TextureRef_t*>& refs )
+{
+	std::vector<uint32_t> out;
+	for (const auto ref : refs)
+		out.push_back( ref->lump_index );
+
+	std::sort( out.begin(), out.end() );
+	return out;
+}
+
+TEST( texture_index_matches_brute_force )
+{
+	std::mt19937 rng( 30 );
+
+	std::vector<std::string> names;
+	CTextureIndex original;
+
+	for (uint32_t i = 0; i < 500; i++)
+	{
+		names.push_back( random_name( rng ) );
+		original.add( names.back(), 0, i );
+	}
+
+	original.build();
+
+	//	A copy works on its own, even once the original is reused for other names.
+	const CTextureIndex index = original;
+
+	original.clear();
+	for (uint32_t i = 0; i < 500; i++)
+		original.add( "+0zzzzz", 0, i );
+
+	original.build();
+
+	for (uint32_t iteration = 0; iteration < 300; iteration++)
+	{
+		const auto query = random_name( rng ).substr( 0, 1 + rng() % 3 );
+
+		std::vector<uint32_t> prefix, substring, family;
+
+		const auto query_family = CTextureIndex::family_name( query );
+
+		for (uint32_t i = 0; i < (uint32_t)names.size(); i++)
+		{
+			if (names[i].compare( 0, query.size(), query ) == 0)
+				prefix.push_back( i );
+
+			if (names[i].find( query ) != std::string::npos)
+				substring.push_back( i );
+
+			const auto f = CTextureIndex::family_name( names[i] );
+			if (!f.empty() && f == (query_family.empty() ? std::string_view( query ) : query_family))
+				family.push_back( i );
+		}
+
+		CHECK( lump_indices( index.search( query, ESearchMode::Prefix ) ) == prefix );
+		CHECK( lump_indices( index.search( query, ESearchMode::Substring ) ) == substring );
+		CHECK( lump_indices( index.search( query, ESearchMode::Family ) ) == family );
+	}
+
+	//	Case insensitive, exact lookups.
+	CHECK( index.find( "NOPE_NOT_THERE" ).empty() );
+	CHECK( !index.find( names[0] ).empty() );
+}
+
+TEST( hash_index_matches_brute_force )
+{
+	std::mt19937_64 rng( 31 );
+
+	std::vector<uint64_t> hashes;
+	CHashIndex index;
+
+	for (uint32_t i = 0; i < 2000; i++)
+	{
+		//	Clusters, so small radius queries have something to find.
+		const uint64_t hash = i % 4 ? hashes[rng() % hashes.size()] ^ (1ull << (rng() % 64)) ^ (1ull << (rng() % 64)) : rng();
+
+		hashes.push_back( hash );
+		index.add( hash, i );
+	}
+
+	for (uint32_t iteration = 0; iteration < 100; iteration++)
+	{
+		const uint64_t query = hashes[rng() % hashes.size()] ^ (1ull << (rng() % 64));
+		const uint32_t radius = rng() % 12;
+
+		std::set<uint32_t> expected, found;
+
+		for (uint32_t i = 0; i < (uint32_t)hashes.size(); i++)
+		{
+			if (hash_distance( hashes[i], query ) <= radius)
+				expected.insert( i );
+		}
+
+		for (const auto& match : index.find( query, radius ))
+		{
+			CHECK( match.distance == hash_distance( hashes[match.id], query ) );
+			found.insert( match.id );
+		}
+
+		CHECK( found == expected );
+	}
+}
+
+TEST( perceptual_hash_is_stable )
+{
+	std::mt19937 rng( 32 );
+
+	auto tex = random_texture( rng, "tex", 64, 64 );
+	REQUIRE( generate_mips( tex ) );
+
+	uint64_t a, b;
+	REQUIRE( perceptual_hash( tex, a ) );
+
+	//	Same picture with a shuffled palette.
+	auto shuffled = tex;
+	std::vector<uint8_t> order( 256 );
+	for (uint32_t i = 0; i < 256; i++)
+		order[i] = (uint8_t)i;
+	std::shuffle( order.begin(), order.end(), rng );
+
+	for (uint32_t i = 0; i < 256; i++)
+		shuffled.m_palette_data[order[i]] = tex.m_palette_data[i];
+
+	for (auto& mip : shuffled.pixel_data)
+	{
+		for (auto& p : mip)
+			p = order[p];
+	}
+
+	REQUIRE( perceptual_hash( shuffled, b ) );
+	CHECK( a == b );
+}
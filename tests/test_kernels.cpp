@@ -0,0 +1,109 @@
+#include <cstring>
+
+#include "test.h"
+#include "palette_kernels.h"
+#include "mipgen.h"
+
+//	Every optimized kernel against the scalar reference, on every length and
+//	alignment, so the vector bodies and the scalar tails are both covered.
+TEST( kernels_match_scalar )
+{
+	std::mt19937 rng( 20 );
+
+	std::vector<uint8_t> rgb( 256 * 3 );
+	for (auto& c : rgb)
+		c = (uint8_t)rng();
+
+	alignas(32) uint8_t palette[RGBA_PALETTE_SIZE];
+	palette_rgb_to_rgba( rgb.data(), 256, false, palette, EKernel::Scalar );
+
+	std::vector<uint8_t> indices( 300 );
+	for (auto& i : indices)
+		i = (uint8_t)rng();
+
+	//	The ones the CPU doesn't support fall back to the scalar kernel, so
+	//	every kernel can be asked for.
+	for (uint32_t k = 0; k < (uint32_t)EKernel::KernelCount; k++)
+	{
+		const auto kernel = (EKernel)k;
+
+		for (size_t offset = 0; offset < 4; offset++)
+		{
+			for (size_t count = 0; count + offset <= 200; count++)
+			{
+				std::vector<uint8_t> reference( count * 4 + 1, 0xCD ), out( count * 4 + 1, 0xCD );
+
+				expand_indexed_rgba( indices.data() + offset, count, palette, reference.data(), EKernel::Scalar );
+				expand_indexed_rgba( indices.data() + offset, count, palette, out.data(), kernel );
+				CHECK( out == reference );
+
+				reference.assign( count * 3 + 1, 0xCD );
+				out.assign( count * 3 + 1, 0xCD );
+
+				expand_indexed_rgb( indices.data() + offset, count, palette, reference.data(), EKernel::Scalar );
+				expand_indexed_rgb( indices.data() + offset, count, palette, out.data(), kernel );
+				CHECK( out == reference );
+			}
+		}
+
+		for (uint32_t num_colors = 0; num_colors <= 256; num_colors++)
+		{
+			uint8_t reference[RGBA_PALETTE_SIZE], out[RGBA_PALETTE_SIZE];
+
+			palette_rgb_to_rgba( rgb.data(), num_colors, num_colors & 1, reference, EKernel::Scalar );
+			palette_rgb_to_rgba( rgb.data(), num_colors, num_colors & 1, out, kernel );
+			CHECK( !memcmp( reference, out, sizeof( out ) ) );
+
+			palette_rgb_to_bgrx( rgb.data(), num_colors, reference, EKernel::Scalar );
+			palette_rgb_to_bgrx( rgb.data(), num_colors, out, kernel );
+			CHECK( !memcmp( reference, out, sizeof( out ) ) );
+		}
+	}
+}
+
+TEST( kernels_scalar_reference )
+{
+	const uint8_t rgb[] = { 1, 2, 3, 4, 5, 6 };
+	uint8_t rgba[RGBA_PALETTE_SIZE], bgrx[RGBA_PALETTE_SIZE];
+
+	palette_rgb_to_rgba( rgb, 2, true, rgba, EKernel::Scalar );
+	palette_rgb_to_bgrx( rgb, 2, bgrx, EKernel::Scalar );
+
+	const uint8_t expected_rgba[] = { 1, 2, 3, 255, 4, 5, 6, 255, 0, 0, 0, 255 };
+	const uint8_t expected_bgrx[] = { 3, 2, 1, 0, 6, 5, 4, 0, 0, 0, 0, 0 };
+
+	CHECK( !memcmp( rgba, expected_rgba, sizeof( expected_rgba ) ) );
+	CHECK( !memcmp( bgrx, expected_bgrx, sizeof( expected_bgrx ) ) );
+
+	//	The transparent entry.
+	CHECK( rgba[255 * 4 + 3] == 0 );
+}
+
+TEST( kernels_texture_transparency )
+{
+	std::mt19937 rng( 21 );
+
+	for (const char* name : { "{fence", "fence" })
+	{
+		auto tex = random_texture( rng, name, 16, 16 );
+		tex.pixel_data[0][0] = TRANSPARENT_INDEX;
+
+		std::vector<uint8_t> rgba, rgb;
+		REQUIRE( texture_to_rgba( tex, 0, rgba ) );
+		REQUIRE( texture_to_rgb( tex, 0, rgb ) );
+		REQUIRE( rgba.size() == 16 * 16 * 4 );
+		REQUIRE( rgb.size() == 16 * 16 * 3 );
+
+		CHECK( (rgba[3] == 0) == is_transparent_texture( tex ) );
+
+		//	The transparent index comes out black in RGB as well.
+		for (size_t i = 0; i < 16 * 16; i++)
+		{
+			const auto index = tex.pixel_data[0][i];
+			const bool black = index == TRANSPARENT_INDEX && is_transparent_texture( tex );
+			const auto& color = black ? ColorData_t{ 0, 0, 0 } : tex.m_palette_data[index];
+
+			CHECK( rgb[i * 3 + 0] == color.Red && rgb[i * 3 + 1] == color.Green && rgb[i * 3 + 2] == color.Blue );
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#include <atomic>
+#include <cstring>
+
+#include "test.h"
+
+static int s_failures = 0;
+
+std::vector<TestCase_t>& test_registry()
+{
+	static std::vector<TestCase_t> registry;
+	return registry;
+}
+
+void test_fail( const char* file, int line, const char* expr )
+{
+	printf( "  %s:%d: CHECK( %s ) failed\n", file, line, expr );
+	s_failures++;
+}
+
+CTempFile::CTempFile( const std::string& extension )
+{
+	static std::atomic<uint32_t> counter = 0;
+
+	m_path = std::filesystem::temp_directory_path() / ("wadtest_" + std::to_string( std::random_device{}() ) + "_" + std::to_string( counter++ ) + extension);
+}
+
+CTempFile::~CTempFile()
+{
+	std::error_code ec;
+	std::filesystem::remove( m_path, ec );
+}
+
+TextureData_t random_texture( std::mt19937& rng, const std::string& name, uint32_t width, uint32_t height, uint32_t num_colors )
+{
+	TextureData_t tex;
+	tex.name = name;
+	tex.width = width;
+	tex.height = height;
+
+	for (uint32_t m = 0; m < MIPLEVELS; m++)
+	{
+		auto& mip = tex.pixel_data[m];
+		mip.resize( CWadFile::mip_width( width, m ) * CWadFile::mip_height( height, m ) );
+
+		for (auto& p : mip)
+			p = (uint8_t)(rng() % num_colors);
+	}
+
+	tex.m_palette_colors = (uint16_t)num_colors;
+	tex.m_palette_data.resize( num_colors );
+
+	for (auto& c : tex.m_palette_data)
+		c = { (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng() };
+
+	return tex;
+}
+
+bool textures_equal( const TextureData_t& a, const TextureData_t& b )
+{
+	if (a.name != b.name || a.width != b.width || a.height != b.height || a.m_palette_colors != b.m_palette_colors)
+		return false;
+
+	if (a.pixel_data != b.pixel_data || a.m_palette_data.size() != b.m_palette_data.size())
+		return false;
+
+	return !a.m_palette_data.size() || !memcmp( a.m_palette_data.data(), b.m_palette_data.data(), a.m_palette_data.size() * sizeof( ColorData_t ) );
+}
+
+int main( int argc, char** argv )
+{
+	const std::string filter = argc > 1 ? argv[1] : "";
+
+	uint32_t num_run = 0, num_failed = 0;
+
+	for (const auto& test : test_registry())
+	{
+		if (std::strncmp( test.name, filter.c_str(), filter.size() ))
+			continue;
+
+		const int failures = s_failures;
+
+		printf( "[ RUN  ] %s\n", test.name );
+		test.fn();
+		printf( "[ %s ] %s\n", s_failures == failures ? " OK " : "FAIL", test.name );
+
+		num_run++;
+		num_failed += s_failures != failures;
+	}
+
+	printf( "%d of %d tests passed\n", num_run - num_failed, num_run );
+
+	return num_failed || !num_run ? 1 : 0;
+}
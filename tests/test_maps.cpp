@@ -0,0 +1,378 @@
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <algorithm>
+
+#include "test.h"
+#include "wad_writer.h"
+#include "bsp.h"
+#include "map_resolver.h"
+#include "wad_packer.h"
+
+//	A texture of the map, either embedded with all of its mips or only its
+//	name and size, the way the compile tools leave the WAD textures.
+struct MapTexture_t
+{
+	TextureData_t tex;
+	bool embedded;
+};
+
+template<typename T>
+static void append( std::vector<uint8_t>& out, const T& value )
+{
+	const size_t pos = out.size();
+	out.resize( pos + sizeof( T ) );
+	memcpy( out.data() + pos, &value, sizeof( T ) );
+}
+
+//	Writes a BSP with only the entities and the texture lumps filled in, an
+//	empty texture slot is stored as -1.
+static bool write_bsp( const std::filesystem::path& path, const std::string& wads, const std::vector<MapTexture_t>& textures, bool empty_slot = false )
+{
+	const std::string entities = "{\n\"classname\" \"worldspawn\"\n\"wad\" \"" + wads + "\"\n}\n{\n\"classname\" \"light\"\n}\n";
+
+	std::vector<uint8_t> lump;
+	append( lump, (int32_t)(textures.size() + empty_slot) );
+	lump.resize( lump.size() + (textures.size() + empty_slot) * sizeof( int32_t ) );
+
+	std::vector<int32_t> offsets;
+	if (empty_slot)
+		offsets.push_back( -1 );
+
+	for (const auto& texture : textures)
+	{
+		offsets.push_back( (int32_t)lump.size() );
+
+		if (texture.embedded)
+		{
+			std::vector<uint8_t> miptex;
+			if (!CWadWriter::encode_miptex( texture.tex, miptex ))
+				return false;
+
+			lump.insert( lump.end(), miptex.begin(), miptex.end() );
+			continue;
+		}
+
+		MipTexture_t miptex = {};
+		memcpy( miptex.name, texture.tex.name.data(), std::min( texture.tex.name.size(), sizeof( miptex.name ) ) );
+		miptex.width = texture.tex.width;
+		miptex.height = texture.tex.height;
+		append( lump, miptex );
+	}
+
+	memcpy( lump.data() + sizeof( int32_t ), offsets.data(), offsets.size() * sizeof( int32_t ) );
+
+	BspHeader_t header = {};
+	header.version = BSP_VERSION;
+	header.lumps[BSP_LUMP_ENTITIES] = { (int32_t)sizeof( header ), (int32_t)entities.size() };
+	header.lumps[BSP_LUMP_TEXTURES] = { (int32_t)(sizeof( header ) + entities.size()), (int32_t)lump.size() };
+
+	std::ofstream ofs( path, std::ios::binary );
+	ofs.write( (const char*)&header, sizeof( header ) );
+	ofs.write( entities.data(), entities.size() );
+	ofs.write( (const char*)lump.data(), lump.size() );
+
+	return ofs.good();
+}
+
+static bool write_wad( const std::vector<TextureData_t>& textures, const std::filesystem::path& path )
+{
+	CWadWriter writer;
+
+	for (const auto& tex : textures)
+	{
+		if (!writer.add_texture( tex ))
+			return false;
+	}
+
+	return writer.write( path );
+}
+
+TEST( bsp_reads_textures_and_wads )
+{
+	std::mt19937 rng( 70 );
+
+	const std::vector<MapTexture_t> textures =
+	{
+		{ random_texture( rng, "embedded", 32, 16 ), true },
+		{ random_texture( rng, "External", 64, 64 ), false },
+		{ random_texture( rng, "{FENCE", 16, 32, 12 ), true },
+
+		//	Fills the name field, there's no terminator.
+		{ random_texture( rng, "sixteen_chars_xx", 16, 16 ), false },
+	};
+
+	CTempFile file( ".bsp" );
+	REQUIRE( write_bsp( file.path(), "\\half-life\\valve\\HalfLife.wad;/maps/extra.wad;;decals.wad", textures, true ) );
+
+	CBspFile bsp( file.path() );
+	REQUIRE( bsp.open() );
+	REQUIRE( bsp.textures().size() == textures.size() + 1 );
+
+	CHECK( bsp.wads() == std::vector<std::string>( { "halflife.wad", "extra.wad", "decals.wad" } ) );
+	CHECK( bsp.num_embedded() == 2 );
+	CHECK( bsp.textures().back().name.size() == 16 );
+
+	//	The empty slot keeps the indices the same as the map's.
+	CHECK( bsp.textures()[0].name.empty() && !bsp.textures()[0].miptex );
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const auto& tex = bsp.textures()[i + 1];
+		CHECK( tex.name == textures[i].tex.name );
+		CHECK( tex.width == textures[i].tex.width && tex.height == textures[i].tex.height );
+		CHECK( (tex.miptex != nullptr) == textures[i].embedded );
+
+		TextureData_t decoded;
+		CHECK( bsp.decode_texture( (uint32_t)i + 1, decoded ) == textures[i].embedded );
+
+		if (textures[i].embedded)
+			CHECK( textures_equal( decoded, textures[i].tex ) );
+	}
+}
+
+TEST( bsp_rejects_invalid_files )
+{
+	std::mt19937 rng( 71 );
+
+	CTempFile file( ".bsp" );
+	REQUIRE( write_bsp( file.path(), "", { { random_texture( rng, "tex", 16, 16 ), true } } ) );
+
+	std::vector<uint8_t> data;
+	{
+		std::ifstream ifs( file.path(), std::ios::binary );
+		data.assign( std::istreambuf_iterator<char>( ifs ), std::istreambuf_iterator<char>() );
+	}
+
+	//	The texture lump reaches the end of the file, so any shorter file has
+	//	a lump out of range.
+	for (size_t size = 0; size < data.size(); size += 1 + size / 4)
+	{
+		{
+			std::ofstream ofs( file.path(), std::ios::binary | std::ios::trunc );
+			ofs.write( (const char*)data.data(), size );
+		}
+
+		CBspFile bsp( file.path() );
+		CHECK( !bsp.open() );
+	}
+
+	//	Quake maps are version 29.
+	auto quake = data;
+	quake[0] = 29;
+
+	{
+		std::ofstream ofs( file.path(), std::ios::binary | std::ios::trunc );
+		ofs.write( (const char*)quake.data(), quake.size() );
+	}
+
+	CBspFile bsp( file.path() );
+	CHECK( !bsp.open() );
+}
+
+TEST( bsp_resolver_follows_the_wad_list )
+{
+	std::mt19937 rng( 72 );
+
+	CTempFile listed( ".wad" ), unlisted( ".wad" ), map( ".bsp" );
+	REQUIRE( write_wad( { random_texture( rng, "floor", 16, 16 ), random_texture( rng, "wall", 16, 16 ) }, listed.path() ) );
+	REQUIRE( write_wad( { random_texture( rng, "wall", 16, 16 ), random_texture( rng, "sky", 16, 16 ) }, unlisted.path() ) );
+
+	const std::vector<MapTexture_t> textures =
+	{
+		{ random_texture( rng, "embedded", 16, 16 ), true },
+		{ random_texture( rng, "WALL", 16, 16 ), false },
+		{ random_texture( rng, "Sky", 16, 16 ), false },
+		{ random_texture( rng, "nowhere", 16, 16 ), false },
+	};
+
+	REQUIRE( write_bsp( map.path(), "\\valve\\" + listed.path().filename().string() + ";\\valve\\gone.wad", textures ) );
+
+	//	The unlisted WAD is added first, the map's list still decides.
+	CMapResolver resolver;
+	REQUIRE( resolver.add_wad( unlisted.path() ) );
+	REQUIRE( resolver.add_wad( listed.path() ) );
+	resolver.build();
+
+	const auto reports = resolver.resolve_all( { map.path(), map.path().string() + ".missing" } );
+	REQUIRE( reports.size() == 2 );
+	CHECK( !reports[1].ok );
+
+	const auto& report = reports[0];
+	REQUIRE( report.ok );
+	REQUIRE( report.textures.size() == textures.size() );
+
+	CHECK( report.missing_wads == std::vector<std::string>( { "gone.wad" } ) );
+
+	//	Looked up case insensitively, reported the way the map spells them.
+	for (size_t i = 0; i < textures.size(); i++)
+		CHECK( report.textures[i].name == textures[i].tex.name );
+
+	CHECK( report.textures[0].source == ETextureSource::Embedded );
+	CHECK( report.textures[1].source == ETextureSource::Wad && report.textures[1].wad_index == 1 && report.textures[1].lump_index == 1 );
+	CHECK( report.textures[2].source == ETextureSource::UnlistedWad && report.textures[2].wad_index == 0 && report.textures[2].lump_index == 1 );
+	CHECK( report.textures[3].source == ETextureSource::Missing && report.textures[3].wad_index == -1 );
+
+	CHECK( report.count( ETextureSource::Missing ) == 1 );
+}
+
+//	Every packed lump has to be a byte for byte copy of the one it was taken from.
+static bool lump_copied( const CWadFile& packed, const CWadFile& source, const std::string& name )
+{
+	const auto a = packed.find_lump( name ), b = source.find_lump( name );
+	if (!a || !b || a->disksize != b->disksize || a->size != b->size || a->type != b->type || a->compression != b->compression)
+		return false;
+
+	return !memcmp( packed.lump_data( a ), source.lump_data( b ), a->disksize );
+}
+
+TEST( pack_takes_what_the_maps_use )
+{
+	std::mt19937 rng( 73 );
+
+	CTempFile first( ".wad" ), second( ".wad" ), map( ".bsp" ), names( ".txt" ), out( ".wad" );
+	REQUIRE( write_wad( { random_texture( rng, "floor", 16, 16 ), random_texture( rng, "unused", 16, 16 ), random_texture( rng, "wall", 32, 16 ) }, first.path() ) );
+	REQUIRE( write_wad( { random_texture( rng, "Wall", 16, 16 ), random_texture( rng, "sky", 64, 16 ), random_texture( rng, "crate", 16, 16 ) }, second.path() ) );
+
+	//	The map only lists the second WAD, so its wall wins over the first one's.
+	const std::vector<MapTexture_t> textures =
+	{
+		{ random_texture( rng, "embedded", 16, 16 ), true },
+		{ random_texture( rng, "wall", 16, 16 ), false },
+		{ random_texture( rng, "Floor", 16, 16 ), false },
+		{ random_texture( rng, "NoWhere", 16, 16 ), false },
+	};
+
+	REQUIRE( write_bsp( map.path(), second.path().filename().string(), textures ) );
+
+	{
+		std::ofstream ofs( names.path() );
+		ofs << "// Needed by the scripts\n  CRATE \r\n\nfloor\nMissing\n";
+	}
+
+	CWadPacker packer;
+	REQUIRE( packer.add_wad( first.path() ) );
+	REQUIRE( packer.add_wad( second.path() ) );
+	packer.build();
+
+	REQUIRE( packer.add_maps( { map.path() } ) );
+	REQUIRE( packer.add_name_list( names.path() ) );
+	REQUIRE( packer.write( out.path() ) );
+
+	CHECK( packer.num_selected() == 3 );
+	CHECK( packer.missing() == std::vector<std::string>( { "nowhere", "missing" } ) );
+
+	CWadFile packed( out.path() ), a( first.path() ), b( second.path() );
+	REQUIRE( packed.open() && a.open() && b.open() );
+	REQUIRE( packed.lumps().size() == 3 );
+
+	CHECK( lump_copied( packed, b, "wall" ) );
+	CHECK( lump_copied( packed, a, "floor" ) );
+	CHECK( lump_copied( packed, b, "crate" ) );
+
+	//	Nothing selected, nothing written.
+	CWadPacker empty;
+	REQUIRE( empty.add_wad( first.path() ) );
+	empty.build();
+	empty.add_name( "nowhere" );
+	CHECK( !empty.write( out.path() ) );
+}
+
+TEST( pack_merge_keeps_the_first_duplicate )
+{
+	std::mt19937 rng( 74 );
+
+	CTempFile first( ".wad" ), second( ".wad" ), out( ".wad" );
+	REQUIRE( write_wad( { random_texture( rng, "wall", 16, 16 ), random_texture( rng, "floor", 16, 16 ) }, first.path() ) );
+
+	{
+		CWadWriter writer;
+		REQUIRE( writer.add_texture( random_texture( rng, "WALL", 32, 32 ) ) );
+
+		const uint8_t font[64] = {};
+		REQUIRE( writer.add_lump( "conchars", LUMP_TYPE_FONT, font, sizeof( font ) ) );
+		REQUIRE( writer.write( second.path() ) );
+	}
+
+	CWadPacker packer;
+	REQUIRE( packer.add_wad( first.path() ) );
+	REQUIRE( packer.add_wad( second.path() ) );
+	packer.build();
+	packer.add_all();
+
+	REQUIRE( packer.write( out.path() ) );
+	CHECK( packer.num_selected() == 3 );
+
+	CWadFile merged( out.path() ), a( first.path() ), b( second.path() );
+	REQUIRE( merged.open() && a.open() && b.open() );
+	REQUIRE( merged.lumps().size() == 3 );
+
+	CHECK( lump_copied( merged, a, "wall" ) );
+	CHECK( lump_copied( merged, a, "floor" ) );
+	CHECK( lump_copied( merged, b, "conchars" ) );
+}
+
+TEST( pack_rejects_mixed_wad_ids )
+{
+	std::mt19937 rng( 75 );
+
+	CTempFile wad3( ".wad" ), wad2( ".wad" ), out( ".wad" );
+	REQUIRE( write_wad( { random_texture( rng, "wall", 16, 16 ) }, wad3.path() ) );
+
+	{
+		CWadWriter writer( "WAD2" );
+
+		const uint8_t palette[768] = {};
+		REQUIRE( writer.add_lump( "palette", LUMP_TYPE_CACHE, palette, sizeof( palette ) ) );
+		REQUIRE( writer.write( wad2.path() ) );
+	}
+
+	CWadPacker packer;
+	REQUIRE( packer.add_wad( wad3.path() ) );
+	REQUIRE( packer.add_wad( wad2.path() ) );
+	packer.build();
+	packer.add_all();
+
+	CHECK( !packer.write( out.path() ) );
+	CHECK( packer.error().find( "WAD2" ) != std::string::npos );
+
+	//	Only WAD3 lumps selected, the WAD2 file doesn't get in the way.
+	CWadPacker textures;
+	REQUIRE( textures.add_wad( wad2.path() ) );
+	REQUIRE( textures.add_wad( wad3.path() ) );
+	textures.build();
+	textures.add_name( "wall" );
+
+	REQUIRE( textures.write( out.path() ) );
+
+	CWadFile packed( out.path() );
+	REQUIRE( packed.open() );
+	CHECK( packed.wad_id() == "WAD3" );
+}
+
+static std::vector<uint8_t> read_file( const std::filesystem::path& path )
+{
+	std::ifstream ifs( path, std::ios::binary );
+	return std::vector<uint8_t>( std::istreambuf_iterator<char>( ifs ), std::istreambuf_iterator<char>() );
+}
+
+TEST( pack_never_overwrites_its_inputs )
+{
+	std::mt19937 rng( 76 );
+
+	CTempFile first( ".wad" ), second( ".wad" );
+	REQUIRE( write_wad( { random_texture( rng, "wall", 64, 64 ), random_texture( rng, "floor", 32, 32 ) }, first.path() ) );
+	REQUIRE( write_wad( { random_texture( rng, "sky", 64, 64 ) }, second.path() ) );
+
+	const auto original = read_file( first.path() );
+
+	CWadPacker packer;
+	REQUIRE( packer.add_wad( first.path() ) );
+	REQUIRE( packer.add_wad( second.path() ) );
+	packer.build();
+	packer.add_all();
+
+	CHECK( !packer.write( first.path() ) );
+	CHECK( !packer.error().empty() );
+	CHECK( read_file( first.path() ) == original );
+}
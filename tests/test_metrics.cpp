@@ -0,0 +1,126 @@
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+#include "test.h"
+#include "metrics.h"
+
+static const StageStats_t* find_stage( const std::vector<StageStats_t>& stages, const char* name )
+{
+	for (const auto& stage : stages)
+	{
+		if (stage.name == name)
+			return &stage;
+	}
+
+	return nullptr;
+}
+
+static void timed_work( uint64_t bytes )
+{
+	METRICS_TIMER( timer, "test.work" );
+	timer.add_bytes( bytes );
+}
+
+TEST( metrics_disabled_records_nothing )
+{
+	auto& metrics = CMetrics::instance();
+	metrics.set_mode( MetricsOff );
+	metrics.reset();
+
+	timed_work( 100 );
+
+	CHECK( !find_stage( metrics.snapshot(), "test.work" ) );
+}
+
+#ifndef WAD_NO_METRICS
+TEST( metrics_counts_stages_across_threads )
+{
+	auto& metrics = CMetrics::instance();
+	metrics.set_mode( MetricsStats | MetricsTrace );
+	metrics.reset();
+
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < 4; t++)
+	{
+		threads.emplace_back( []()
+		{
+			for (uint32_t i = 0; i < 250; i++)
+				timed_work( 10 );
+		} );
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	metrics.set_mode( MetricsOff );
+
+	const auto stages = metrics.snapshot();
+	const auto stage = find_stage( stages, "test.work" );
+	REQUIRE( stage );
+
+	CHECK( stage->count == 1000 );
+	CHECK( stage->bytes == 10000 );
+	CHECK( stage->min_ns <= stage->max_ns );
+	CHECK( stage->percentile_ns( 0.5 ) <= stage->max_ns );
+
+	uint64_t histogram_total = 0;
+	for (const auto bucket : stage->histogram)
+		histogram_total += bucket;
+
+	CHECK( histogram_total == 1000 );
+
+	//	Every timed scope ends up in the trace.
+	CTempFile trace( ".json" );
+	std::string error;
+	REQUIRE( metrics.write_trace( trace.path(), error ) );
+
+	std::ifstream ifs( trace.path() );
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	const auto json = ss.str();
+
+	size_t events = 0;
+	for (size_t pos = 0; (pos = json.find( "\"name\":\"test.work\"", pos )) != std::string::npos; pos++)
+		events++;
+
+	CHECK( events == 1000 );
+	CHECK( json.front() == '{' && json.find( "]}" ) != std::string::npos );
+
+	metrics.reset();
+}
+
+//	Threads that come and go reuse the trace buffers of the ones that exited.
+TEST( metrics_recycles_thread_buffers )
+{
+	auto& metrics = CMetrics::instance();
+	metrics.set_mode( MetricsTrace );
+	metrics.reset();
+
+	for (uint32_t t = 0; t < 64; t++)
+		std::thread( []() { timed_work( 10 ); } ).join();
+
+	metrics.set_mode( MetricsOff );
+
+	CTempFile trace( ".json" );
+	std::string error;
+	REQUIRE( metrics.write_trace( trace.path(), error ) );
+
+	std::ifstream ifs( trace.path() );
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	const auto json = ss.str();
+
+	size_t threads = 0, events = 0;
+	for (size_t pos = 0; (pos = json.find( "\"thread_name\"", pos )) != std::string::npos; pos++)
+		threads++;
+
+	for (size_t pos = 0; (pos = json.find( "\"name\":\"test.work\"", pos )) != std::string::npos; pos++)
+		events++;
+
+	CHECK( threads < 64 );
+	CHECK( events == 64 );
+
+	metrics.reset();
+}
+#endif
@@ -0,0 +1,189 @@
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+#ifndef _WIN32
+#	include <unistd.h>
+#	include <sys/un.h>
+#	include <sys/socket.h>
+#endif
+
+#include "test.h"
+#include "wad_writer.h"
+#include "wad_server.h"
+
+static ServerRequest_t make_request( EServerOp op, uint32_t mip = 0, EServerFormat format = EServerFormat::Indexed )
+{
+	ServerRequest_t request = {};
+	request.magic = WAD_SERVER_MAGIC;
+	request.op = (uint8_t)op;
+	request.mip = (uint8_t)mip;
+	request.format = (uint8_t)format;
+
+	return request;
+}
+
+static bool write_wad( const std::vector<TextureData_t>& textures, const std::filesystem::path& path )
+{
+	CWadWriter writer;
+
+	for (const auto& tex : textures)
+	{
+		if (!writer.add_texture( tex ))
+			return false;
+	}
+
+	return writer.write( path );
+}
+
+//	Lookups go through handle_request(), the same way the socket clients' do.
+TEST( server_handles_requests )
+{
+	std::mt19937 rng( 40 );
+
+	const std::vector<TextureData_t> first = { random_texture( rng, "crete1", 64, 32 ), random_texture( rng, "{grate", 16, 16, 20 ) };
+	const std::vector<TextureData_t> second = { random_texture( rng, "CRETE1", 32, 32 ), random_texture( rng, "water", 32, 64 ) };
+
+	CTempFile a( ".wad" ), b( ".wad" );
+	REQUIRE( write_wad( first, a.path() ) );
+	REQUIRE( write_wad( second, b.path() ) );
+
+	CWadServer server;
+	REQUIRE( server.add_wad( a.path() ) );
+	REQUIRE( server.add_wad( b.path() ) );
+	CHECK( server.num_textures() == 3 );
+
+	std::vector<uint8_t> payload;
+
+	REQUIRE( server.handle_request( make_request( EServerOp::List ), "", payload ) == EServerStatus::Ok );
+	REQUIRE( payload.size() == sizeof( uint32_t ) + 3 * sizeof( ServerTextureInfo_t ) );
+
+	uint32_t count;
+	memcpy( &count, payload.data(), sizeof( count ) );
+	CHECK( LittleLong( count ) == 3 );
+
+	//	Names are case insensitive and the WAD that was added first wins.
+	REQUIRE( server.handle_request( make_request( EServerOp::Metadata ), "Crete1", payload ) == EServerStatus::Ok );
+	REQUIRE( payload.size() > sizeof( ServerTextureInfo_t ) );
+
+	ServerTextureInfo_t info;
+	memcpy( &info, payload.data(), sizeof( info ) );
+	CHECK( !strcmp( info.name, "crete1" ) );
+	CHECK( LittleLong( info.width ) == 64 && LittleLong( info.height ) == 32 );
+	CHECK( LittleLong( info.wad_index ) == 0 );
+	CHECK( std::string( payload.begin() + sizeof( info ), payload.end() ) == a.path().string() );
+
+	for (uint32_t mip = 0; mip < MIPLEVELS; mip++)
+	{
+		REQUIRE( server.handle_request( make_request( EServerOp::GetTexture, mip ), "{grate", payload ) == EServerStatus::Ok );
+
+		const auto& tex = first[1];
+		const auto& pixels = tex.pixel_data[mip];
+
+		uint32_t dims[2];
+		REQUIRE( payload.size() == sizeof( dims ) + pixels.size() + 256 * 3 );
+		memcpy( dims, payload.data(), sizeof( dims ) );
+
+		CHECK( LittleLong( dims[0] ) == CWadFile::mip_width( tex.width, mip ) );
+		CHECK( LittleLong( dims[1] ) == CWadFile::mip_height( tex.height, mip ) );
+		CHECK( !memcmp( payload.data() + sizeof( dims ), pixels.data(), pixels.size() ) );
+
+		//	The palette is always full, the colors the texture doesn't have are black.
+		const uint8_t* palette = payload.data() + sizeof( dims ) + pixels.size();
+		CHECK( !memcmp( palette, tex.m_palette_data.data(), tex.m_palette_data.size() * 3 ) );
+		CHECK( std::all_of( palette + tex.m_palette_data.size() * 3, palette + 256 * 3, []( uint8_t c ) { return c == 0; } ) );
+	}
+
+	REQUIRE( server.handle_request( make_request( EServerOp::GetTexture, 0, EServerFormat::Bmp ), "water", payload ) == EServerStatus::Ok );
+	CHECK( payload.size() > 2 && payload[0] == 'B' && payload[1] == 'M' );
+
+	//	The same request again comes out of the cache.
+	std::vector<uint8_t> cached;
+	REQUIRE( server.handle_request( make_request( EServerOp::GetTexture, 0, EServerFormat::Bmp ), "water", cached ) == EServerStatus::Ok );
+	CHECK( cached == payload );
+
+	CHECK( server.handle_request( make_request( EServerOp::Metadata ), "missing", payload ) == EServerStatus::NotFound );
+	CHECK( server.handle_request( make_request( EServerOp::GetTexture ), "missing", payload ) == EServerStatus::NotFound );
+	CHECK( server.handle_request( make_request( EServerOp::GetTexture, MIPLEVELS ), "water", payload ) == EServerStatus::BadRequest );
+	CHECK( server.handle_request( make_request( EServerOp::GetTexture, 0, EServerFormat::FormatCount ), "water", payload ) == EServerStatus::BadRequest );
+	CHECK( server.handle_request( make_request( (EServerOp)0 ), "water", payload ) == EServerStatus::BadRequest );
+}
+
+TEST( server_rejects_invalid_wads )
+{
+	CTempFile file( ".wad" );
+
+	CWadServer server;
+	CHECK( !server.add_wad( file.path() ) );
+	CHECK( !server.error().empty() );
+	CHECK( server.num_wads() == 0 );
+}
+
+#ifndef _WIN32
+
+static bool listen_on( int fd, const std::filesystem::path& path )
+{
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, path.c_str(), sizeof( addr.sun_path ) - 1 );
+
+	return bind( fd, (sockaddr*)&addr, sizeof( addr ) ) == 0 && listen( fd, 1 ) == 0;
+}
+
+TEST( server_keeps_what_is_at_the_socket_path )
+{
+	std::mt19937 rng( 41 );
+
+	CTempFile wad( ".wad" ), path( ".sock" );
+	REQUIRE( write_wad( { random_texture( rng, "crete1", 16, 16 ) }, wad.path() ) );
+
+	CWadServer server;
+	REQUIRE( server.add_wad( wad.path() ) );
+
+	//	A mistyped path to a regular file.
+	{
+		std::ofstream ofs( path.path() );
+		ofs << "keep";
+	}
+
+	CHECK( !server.run( path.path() ) );
+	CHECK( std::filesystem::is_regular_file( path.path() ) );
+	std::filesystem::remove( path.path() );
+
+	//	The socket of another server that's still running.
+	const int other = socket( AF_UNIX, SOCK_STREAM, 0 );
+	REQUIRE( listen_on( other, path.path() ) );
+
+	CHECK( !server.run( path.path() ) );
+	CHECK( std::filesystem::is_socket( path.path() ) );
+
+	//	Once it's gone its socket is left over and taken over.
+	close( other );
+
+	bool ran = false;
+	std::thread thread( [&]() { ran = server.run( path.path() ); } );
+
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, path.path().c_str(), sizeof( addr.sun_path ) - 1 );
+
+	bool connected = false;
+	for (uint32_t i = 0; i < 500 && !connected; i++)
+	{
+		const int client = socket( AF_UNIX, SOCK_STREAM, 0 );
+		connected = connect( client, (sockaddr*)&addr, sizeof( addr ) ) == 0;
+		close( client );
+
+		if (!connected)
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+
+	server.stop();
+	thread.join();
+
+	CHECK( ran && connected );
+	CHECK( !std::filesystem::exists( path.path() ) );
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+#include "test.h"
+#include "wad_writer.h"
+#include "wad_compression.h"
+#include "palette_transform.h"
+
+static bool colors_equal( const ColorData_t& a, uint8_t r, uint8_t g, uint8_t b )
+{
+	return a.Red == r && a.Green == g && a.Blue == b;
+}
+
+TEST( transform_palette )
+{
+	const std::vector<ColorData_t> colors = { { 0, 0, 0 }, { 255, 0, 0 }, { 100, 100, 100 }, { 10, 200, 40 } };
+
+	//	Nothing changes without parameters, or with a full turn of the hue.
+	for (float hue : { 0.f, 360.f, -360.f })
+	{
+		CPaletteTransform identity( 1.f, 1.f, hue );
+		CHECK( identity.is_identity() );
+
+		auto palette = colors;
+		identity.apply( palette.data(), (uint32_t)palette.size() );
+		CHECK( !memcmp( palette.data(), colors.data(), colors.size() * sizeof( ColorData_t ) ) );
+	}
+
+	{
+		CPaletteTransform brighter( 1.f, 2.f );
+		CHECK( !brighter.is_identity() );
+
+		auto palette = colors;
+		brighter.apply( palette.data(), (uint32_t)palette.size() );
+		CHECK( colors_equal( palette[0], 0, 0, 0 ) );
+		CHECK( colors_equal( palette[1], 255, 0, 0 ) );
+		CHECK( colors_equal( palette[2], 200, 200, 200 ) );
+		CHECK( colors_equal( palette[3], 20, 255, 80 ) );
+	}
+
+	{
+		//	Gamma keeps black and white, and brightens everything between.
+		CPaletteTransform gamma( 2.2f );
+
+		std::vector<ColorData_t> palette = { { 0, 0, 0 }, { 255, 255, 255 }, { 64, 128, 192 } };
+		gamma.apply( palette.data(), (uint32_t)palette.size() );
+		CHECK( colors_equal( palette[0], 0, 0, 0 ) );
+		CHECK( colors_equal( palette[1], 255, 255, 255 ) );
+		CHECK( palette[2].Red > 64 && palette[2].Green > 128 && palette[2].Blue > 192 );
+	}
+
+	{
+		//	A third of a turn moves red onto green, grays stay gray.
+		CPaletteTransform hue( 1.f, 1.f, 120.f );
+
+		auto palette = colors;
+		hue.apply( palette.data(), (uint32_t)palette.size() );
+		CHECK( colors_equal( palette[1], 0, 255, 0 ) );
+		CHECK( colors_equal( palette[2], 100, 100, 100 ) );
+		CHECK( colors_equal( palette[3], 40, 10, 200 ) );
+	}
+}
+
+TEST( transform_load_remap )
+{
+	CTempFile file( ".txt" );
+
+	{
+		std::ofstream ofs( file.path() );
+		ofs << "// Move the first ramp onto the second one\n";
+		ofs << "0-15 16\r\n";
+		ofs << "\n";
+		ofs << "  200 3  \n";
+		ofs << "255 0\n";
+	}
+
+	CPaletteTransform transform( 1.f, 1.f, 0.f );
+	REQUIRE( transform.load_remap( file.path() ) );
+	CHECK( transform.has_remap() );
+	CHECK( !transform.is_identity() );
+
+	const char* invalid[] =
+	{
+		"1",			// No destination
+		"1 2 3",
+		"256 0",		// Out of range
+		"0 256",
+		"250-255 251",	// Moved past the end
+		"5-3 0",		// Reversed range
+		"-1 0",
+		"1 -2",
+		"a b",
+	};
+
+	for (const char* line : invalid)
+	{
+		{
+			std::ofstream ofs( file.path() );
+			ofs << line << "\n";
+		}
+
+		CPaletteTransform bad( 1.f, 1.f, 0.f );
+		CHECK( !bad.load_remap( file.path() ) );
+		CHECK( bad.error().find( ":1:" ) != std::string::npos );
+	}
+
+	CPaletteTransform missing;
+	CHECK( !missing.load_remap( file.path().string() + ".missing" ) );
+}
+
+//	Every texture of the written WAD equals the source texture with its palette
+//	transformed and its pixels remapped, the other lumps are copied as they are.
+TEST( transform_wad )
+{
+	std::mt19937 rng( 60 );
+
+	std::vector<TextureData_t> textures;
+	textures.push_back( random_texture( rng, "plain", 64, 32 ) );
+	textures.push_back( random_texture( rng, "{fence", 32, 32 ) );
+	textures.push_back( random_texture( rng, "decal", 16, 16 ) );
+	textures.push_back( random_texture( rng, "fewcolors", 16, 48, 3 ) );
+
+	std::vector<uint8_t> font( 1000 );
+	for (auto& b : font)
+		b = (uint8_t)rng();
+
+	CTempFile source( ".wad" );
+
+	{
+		CWadWriter writer;
+		for (const auto& tex : textures)
+			REQUIRE( writer.add_texture( tex, tex.name == "decal" ? LUMP_TYPE_DECAL : LUMP_TYPE_TEXTURE ) );
+
+		REQUIRE( writer.add_lump( "font", LUMP_TYPE_FONT, font.data(), (uint32_t)font.size() ) );
+		REQUIRE( writer.write( source.path() ) );
+	}
+
+	std::array<uint8_t, 256> remap;
+	for (uint32_t i = 0; i < 256; i++)
+		remap[i] = (uint8_t)(i + 1);
+
+	CPaletteTransform transform( 1.5f, 1.2f, 45.f );
+	transform.set_remap( remap );
+
+	CTempFile compressed( ".wad" );
+	const bool deflate = is_compression_supported( LUMP_COMPRESSION_DEFLATE );
+
+	for (const auto& path : { source.path(), compressed.path() })
+	{
+		if (path == compressed.path())
+		{
+			if (!deflate)
+				break;
+
+			std::string error;
+			CWadFile wad( source.path() );
+			REQUIRE( wad.open() );
+			REQUIRE( convert_wad( wad, compressed.path(), LUMP_COMPRESSION_DEFLATE, error ) );
+		}
+
+		CWadFile wad( path );
+		REQUIRE( wad.open() );
+
+		CTempFile out( ".wad" );
+		REQUIRE( transform.transform_wad( wad, out.path() ) );
+		CHECK( transform.num_transformed() == textures.size() );
+
+		//	Writing over the source isn't allowed.
+		CHECK( !transform.transform_wad( wad, path ) );
+
+		CWadFile result( out.path() );
+		REQUIRE( result.process() );
+		REQUIRE( result.textures().size() == textures.size() );
+		REQUIRE( result.lumps().size() == textures.size() + 1 );
+
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			auto expected = textures[i];
+			const bool transparent = expected.name[0] == '{';
+
+			transform.apply( expected.m_palette_data.data(), transparent ? 255 : expected.m_palette_colors );
+
+			for (uint32_t m = 0; m < MIPLEVELS && expected.name != "decal"; m++)
+			{
+				for (auto& p : expected.pixel_data[m])
+				{
+					if (!transparent || (p != 254 && p != 255))
+						p = remap[p];
+				}
+			}
+
+			CHECK( textures_equal( result.textures()[i], expected ) );
+			CHECK( result.lumps()[i]->compression == wad.lumps()[i]->compression );
+		}
+
+		std::vector<uint8_t> copied;
+		REQUIRE( result.read_lump( result.lumps()[textures.size()], copied ) );
+		CHECK( copied == font );
+	}
+}
+
+//	A texture lump that can't be decoded is copied as it is, the others are
+//	still transformed.
+TEST( transform_wad_copies_undecodable_lumps )
+{
+	std::mt19937 rng( 61 );
+
+	const auto tex = random_texture( rng, "plain", 32, 32 );
+
+	std::vector<uint8_t> garbage( 100 );
+	for (auto& b : garbage)
+		b = (uint8_t)rng();
+
+	CTempFile source( ".wad" ), out( ".wad" );
+
+	{
+		CWadWriter writer;
+		REQUIRE( writer.add_lump( "broken", LUMP_TYPE_TEXTURE, garbage.data(), (uint32_t)garbage.size() ) );
+		REQUIRE( writer.add_texture( tex ) );
+		REQUIRE( writer.write( source.path() ) );
+	}
+
+	CWadFile wad( source.path() );
+	REQUIRE( wad.open() );
+
+	CPaletteTransform transform( 2.f, 1.f, 0.f );
+	REQUIRE( transform.transform_wad( wad, out.path() ) );
+
+	CHECK( transform.num_transformed() == 1 );
+	REQUIRE( transform.warnings().size() == 1 );
+	CHECK( transform.warnings()[0].find( "broken" ) != std::string::npos );
+
+	CWadFile result( out.path() );
+	REQUIRE( result.process() );
+	REQUIRE( result.lumps().size() == 2 );
+
+	std::vector<uint8_t> copied;
+	REQUIRE( result.read_lump( result.lumps()[0], copied ) );
+	CHECK( copied == garbage );
+
+	auto expected = tex;
+	transform.apply( expected.m_palette_data.data(), expected.m_palette_colors );
+
+	REQUIRE( result.textures().size() == 1 );
+	CHECK( textures_equal( result.textures()[0], expected ) );
+}
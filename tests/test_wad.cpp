@@ -0,0 +1,444 @@
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#ifndef _WIN32
+#	include <csignal>
+#	include <sys/resource.h>
+#endif
+
+#include "test.h"
+#include "wad_writer.h"
+#include "wad_editor.h"
+#include "wad_compression.h"
+
+static const uint32_t kSizes[][2] = { { 16, 16 }, { 32, 16 }, { 64, 64 }, { 48, 80 }, { 128, 32 }, { 256, 256 }, { 16, 512 } };
+
+static std::vector<TextureData_t> random_textures( std::mt19937& rng, uint32_t count )
+{
+	std::vector<TextureData_t> textures;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const auto& size = kSizes[rng() % std::size( kSizes )];
+		textures.push_back( random_texture( rng, "tex" + std::to_string( i ), size[0], size[1], 1 + rng() % 256 ) );
+	}
+
+	return textures;
+}
+
+static bool write_wad( const std::vector<TextureData_t>& textures, const std::filesystem::path& path )
+{
+	CWadWriter writer;
+
+	for (const auto& tex : textures)
+	{
+		if (!writer.add_texture( tex ))
+			return false;
+	}
+
+	return writer.write( path );
+}
+
+static std::vector<uint8_t> read_file( const std::filesystem::path& path )
+{
+	std::ifstream ifs( path, std::ios::binary );
+	return std::vector<uint8_t>( std::istreambuf_iterator<char>( ifs ), std::istreambuf_iterator<char>() );
+}
+
+//	write -> process() -> every mip and palette byte equal, for every way of reading.
+TEST( wad_roundtrip )
+{
+	std::mt19937 rng( 1 );
+
+	for (uint32_t iteration = 0; iteration < 16; iteration++)
+	{
+		const auto textures = random_textures( rng, 1 + rng() % 12 );
+
+		CTempFile file( ".wad" );
+		REQUIRE( write_wad( textures, file.path() ) );
+
+		CWadFile wad( file.path() );
+		wad.set_memory_mapped( iteration & 1 );
+		wad.set_num_threads( iteration & 2 ? 0 : 1 );
+
+		REQUIRE( wad.process() );
+		REQUIRE( wad.textures().size() == textures.size() );
+
+		for (size_t i = 0; i < textures.size(); i++)
+			CHECK( textures_equal( wad.textures()[i], textures[i] ) );
+	}
+}
+
+TEST( wad_writer_memory_matches_file )
+{
+	std::mt19937 rng( 2 );
+	const auto textures = random_textures( rng, 5 );
+
+	CWadWriter writer;
+	for (const auto& tex : textures)
+		REQUIRE( writer.add_texture( tex ) );
+
+	//	Referenced bytes end up in both, the odd size needs padding.
+	const uint8_t font[37] = { 1, 2, 3 };
+	REQUIRE( writer.add_lump_ref( "font", LUMP_TYPE_FONT, font, sizeof( font ) ) );
+
+	CTempFile file( ".wad" );
+	std::vector<uint8_t> memory;
+
+	REQUIRE( writer.write( memory ) );
+	REQUIRE( writer.write( file.path() ) );
+
+	CHECK( read_file( file.path() ) == memory );
+}
+
+//	The output is only replaced by a complete file, and nothing is left next to it.
+static size_t files_next_to( const std::filesystem::path& path )
+{
+	size_t count = 0;
+	for (const auto& entry : std::filesystem::directory_iterator( path.parent_path() ))
+		count += entry.path().string().rfind( path.string(), 0 ) == 0;
+
+	return count;
+}
+
+TEST( wad_writer_replaces_whole_files )
+{
+	std::mt19937 rng( 13 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( random_textures( rng, 4 ), file.path() ) );
+
+	const auto textures = random_textures( rng, 2 );
+	REQUIRE( write_wad( textures, file.path() ) );
+
+	CWadFile wad( file.path() );
+	REQUIRE( wad.process() );
+	REQUIRE( wad.textures().size() == textures.size() );
+	CHECK( textures_equal( wad.textures()[1], textures[1] ) );
+	CHECK( files_next_to( file.path() ) == 1 );
+
+	//	A directory can't be replaced by the file, the temporary one goes away.
+	CTempFile dir( "" );
+	REQUIRE( std::filesystem::create_directory( dir.path() ) );
+	{
+		std::ofstream ofs( dir.path() / "keep" );
+	}
+
+	CHECK( !write_wad( textures, dir.path() ) );
+	CHECK( files_next_to( dir.path() ) == 1 );
+
+	std::filesystem::remove_all( dir.path() );
+}
+
+TEST( wad_miptex_roundtrip )
+{
+	std::mt19937 rng( 3 );
+
+	for (uint32_t i = 0; i < 32; i++)
+	{
+		const auto& size = kSizes[i % std::size( kSizes )];
+		const auto tex = random_texture( rng, "{grate", size[0], size[1], 1 + rng() % 256 );
+
+		std::vector<uint8_t> miptex;
+		REQUIRE( CWadWriter::encode_miptex( tex, miptex ) );
+
+		TextureData_t decoded;
+		REQUIRE( CWadFile::decode_miptex( miptex.data(), (uint32_t)miptex.size(), decoded ) );
+		CHECK( textures_equal( decoded, tex ) );
+
+		//	Anything shorter has to be rejected, not read past.
+		const uint32_t truncated = (uint32_t)(rng() % miptex.size());
+		std::vector<uint8_t> shorter( miptex.begin(), miptex.begin() + truncated );
+		CHECK( !CWadFile::decode_miptex( shorter.data(), truncated, decoded ) );
+	}
+}
+
+TEST( wad_parallel_decode_matches_serial )
+{
+	std::mt19937 rng( 4 );
+	const auto textures = random_textures( rng, 64 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( textures, file.path() ) );
+
+	CWadFile serial( file.path() ), parallel( file.path() );
+	serial.set_num_threads( 1 );
+	parallel.set_num_threads( 8 );
+
+	REQUIRE( serial.process() );
+	REQUIRE( parallel.process() );
+	REQUIRE( serial.textures().size() == parallel.textures().size() );
+
+	for (size_t i = 0; i < serial.textures().size(); i++)
+		CHECK( textures_equal( serial.textures()[i], parallel.textures()[i] ) );
+}
+
+//	Random damage inside the lump data must never be read out of bounds.
+TEST( wad_corrupted_lumps )
+{
+	std::mt19937 rng( 5 );
+	const auto textures = random_textures( rng, 4 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( textures, file.path() ) );
+
+	const auto original = read_file( file.path() );
+
+	for (uint32_t iteration = 0; iteration < 64; iteration++)
+	{
+		auto data = original;
+
+		//	Leave the header and the directory alone, they're checked up front.
+		const size_t directory = data.size() - textures.size() * sizeof( LumpInfo_t );
+		for (uint32_t i = 0; i < 8; i++)
+			data[sizeof( WadHeader_t ) + rng() % (directory - sizeof( WadHeader_t ))] = (uint8_t)rng();
+
+		{
+			std::ofstream ofs( file.path(), std::ios::binary );
+			ofs.write( (const char*)data.data(), data.size() );
+		}
+
+		CWadFile wad( file.path() );
+		REQUIRE( wad.open() );
+
+		for (const auto lumpptr : wad.lumps())
+		{
+			TextureData_t tex;
+			wad.decode_texture( lumpptr, tex );
+		}
+	}
+}
+
+TEST( wad_skips_undecodable_lumps )
+{
+	std::mt19937 rng( 12 );
+	const auto textures = random_textures( rng, 3 );
+
+	std::vector<std::vector<uint8_t>> miptex( textures.size() );
+	for (size_t i = 0; i < textures.size(); i++)
+		REQUIRE( CWadWriter::encode_miptex( textures[i], miptex[i] ) );
+
+	//	An unknown compression type with the full size is taken as stored, a
+	//	deflate lump that isn't one can't be read at all.
+	const std::vector<uint8_t> garbage( 64, 0xAB );
+
+	CTempFile file( ".wad" );
+
+	{
+		CWadWriter writer;
+		REQUIRE( writer.add_lump( textures[0].name, LUMP_TYPE_TEXTURE, miptex[0].data(), (uint32_t)miptex[0].size() ) );
+		REQUIRE( writer.add_lump( textures[1].name, LUMP_TYPE_TEXTURE, miptex[1].data(), (uint32_t)miptex[1].size(), 7, (uint32_t)miptex[1].size() ) );
+		REQUIRE( writer.add_lump( "broken", LUMP_TYPE_TEXTURE, garbage.data(), (uint32_t)garbage.size(), LUMP_COMPRESSION_DEFLATE, (uint32_t)miptex[2].size() ) );
+		REQUIRE( writer.add_lump( textures[2].name, LUMP_TYPE_TEXTURE, miptex[2].data(), (uint32_t)miptex[2].size() ) );
+		REQUIRE( writer.write( file.path() ) );
+	}
+
+	CWadFile wad( file.path() );
+	REQUIRE( wad.process() );
+	REQUIRE( wad.textures().size() == textures.size() );
+
+	for (size_t i = 0; i < textures.size(); i++)
+		CHECK( textures_equal( wad.textures()[i], textures[i] ) );
+
+	REQUIRE( wad.warnings().size() == 1 );
+	CHECK( wad.warnings()[0].find( "broken" ) != std::string::npos );
+
+	std::vector<uint8_t> out;
+	std::string error;
+	CHECK( !wad.read_lump( wad.find_lump( "broken" ), out, error ) );
+	CHECK( !error.empty() );
+}
+
+TEST( wad_compressed_roundtrip )
+{
+	if (!is_compression_supported( LUMP_COMPRESSION_DEFLATE ))
+		return;
+
+	std::mt19937 rng( 6 );
+
+	//	Few colors, so the lumps actually shrink.
+	std::vector<TextureData_t> textures;
+	for (uint32_t i = 0; i < 8; i++)
+		textures.push_back( random_texture( rng, "tex" + std::to_string( i ), 64, 64, 1 + i ) );
+
+	CTempFile plain( ".wad" ), compressed( ".wad" ), restored( ".wad" );
+	REQUIRE( write_wad( textures, plain.path() ) );
+
+	std::string error;
+
+	{
+		CWadFile wad( plain.path() );
+		REQUIRE( wad.open() );
+		REQUIRE( convert_wad( wad, compressed.path(), LUMP_COMPRESSION_DEFLATE, error ) );
+	}
+
+	CWadFile wad( compressed.path() );
+	REQUIRE( wad.process() );
+	REQUIRE( wad.textures().size() == textures.size() );
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		CHECK( wad.lumps()[i]->compression == LUMP_COMPRESSION_DEFLATE );
+		CHECK( wad.lumps()[i]->disksize < wad.lumps()[i]->size );
+		CHECK( textures_equal( wad.textures()[i], textures[i] ) );
+	}
+
+	REQUIRE( convert_wad( wad, restored.path(), LUMP_COMPRESSION_NONE, error ) );
+	CHECK( read_file( restored.path() ) == read_file( plain.path() ) );
+}
+
+TEST( wad_editor_roundtrip )
+{
+	std::mt19937 rng( 7 );
+	auto textures = random_textures( rng, 6 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( textures, file.path() ) );
+
+	//	Someone else's file where compact() used to write its copy.
+	const auto tmp_path = file.path().string() + ".tmp";
+	{
+		std::ofstream ofs( tmp_path );
+		ofs << "keep";
+	}
+
+	{
+		CWadEditor editor( file.path() );
+		REQUIRE( editor.open() );
+
+		textures[2] = random_texture( rng, "tex2", 32, 32 );
+		REQUIRE( editor.put_texture( textures[2] ) );
+		REQUIRE( editor.delete_lump( "tex4" ) );
+		textures.erase( textures.begin() + 4 );
+
+		textures.push_back( random_texture( rng, "added", 16, 48 ) );
+		REQUIRE( editor.put_texture( textures.back() ) );
+
+		REQUIRE( editor.commit() );
+		CHECK( editor.dead_bytes() > 0 );
+
+		REQUIRE( editor.compact() );
+		CHECK( editor.dead_bytes() == 0 );
+	}
+
+	CHECK( files_next_to( file.path() ) == 2 );
+	CHECK( read_file( tmp_path ) == std::vector<uint8_t>( { 'k', 'e', 'e', 'p' } ) );
+	std::filesystem::remove( tmp_path );
+
+	CWadFile wad( file.path() );
+	REQUIRE( wad.process() );
+	REQUIRE( wad.textures().size() == textures.size() );
+
+	for (const auto& tex : textures)
+	{
+		const auto decoded = wad.find_texture( tex.name );
+		REQUIRE( decoded );
+		CHECK( textures_equal( *decoded, tex ) );
+	}
+}
+
+//	The size check comes before anything is written, a commit that would make
+//	the WAD too big leaves the file as it was.
+TEST( wad_editor_rejects_oversized_commits )
+{
+	std::mt19937 rng( 8 );
+	const auto textures = random_textures( rng, 3 );
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( textures, file.path() ) );
+
+	//	Sparse space after the directory, just short of the 4 GiB limit.
+	const uint64_t size = UINT32_MAX - 0x10000;
+	std::filesystem::resize_file( file.path(), size );
+
+	CWadEditor editor( file.path() );
+	REQUIRE( editor.open() );
+
+	const std::vector<uint8_t> big( 0x20000, 1 );
+	REQUIRE( editor.put_texture( random_texture( rng, "small", 16, 16 ) ) );
+	REQUIRE( editor.add_lump( "big", LUMP_TYPE_FONT, big.data(), (uint32_t)big.size() ) );
+
+	CHECK( !editor.commit() );
+	CHECK( std::filesystem::file_size( file.path() ) == size );
+	CHECK( editor.has_changes() );
+
+	REQUIRE( editor.delete_lump( "big" ) );
+	REQUIRE( editor.commit() );
+
+	CWadEditor reopened( file.path() );
+	REQUIRE( reopened.open() );
+	CHECK( reopened.lumps().size() == textures.size() + 1 );
+	CHECK( reopened.find_lump( "small" ) == (int32_t)textures.size() );
+}
+
+#ifndef _WIN32
+//	A commit that fails halfway through writing the new lumps, the file size
+//	limit stands in for a full disk.
+TEST( wad_editor_survives_failed_commits )
+{
+	std::mt19937 rng( 9 );
+	auto textures = random_textures( rng, 4 );
+	const auto before = textures;
+
+	CTempFile file( ".wad" );
+	REQUIRE( write_wad( textures, file.path() ) );
+	const auto original = read_file( file.path() );
+
+	CWadEditor editor( file.path() );
+	REQUIRE( editor.open() );
+
+	textures[1] = random_texture( rng, "tex1", 256, 256 );
+	REQUIRE( editor.put_texture( textures[1] ) );
+	textures.push_back( random_texture( rng, "added", 64, 64 ) );
+	REQUIRE( editor.put_texture( textures.back() ) );
+
+	rlimit limit, old;
+	REQUIRE( getrlimit( RLIMIT_FSIZE, &old ) == 0 );
+	limit = old;
+	limit.rlim_cur = original.size() + 4096;
+
+	const auto handler = signal( SIGXFSZ, SIG_IGN );
+	REQUIRE( setrlimit( RLIMIT_FSIZE, &limit ) == 0 );
+
+	const bool committed = editor.commit();
+
+	setrlimit( RLIMIT_FSIZE, &old );
+	signal( SIGXFSZ, handler );
+
+	REQUIRE( !committed );
+	CHECK( editor.has_changes() );
+
+	//	Part of the new data made it into the file, the header doesn't point to it.
+	const auto partial = read_file( file.path() );
+	REQUIRE( partial.size() > original.size() );
+	CHECK( std::equal( original.begin(), original.end(), partial.begin() ) );
+
+	{
+		CWadFile wad( file.path() );
+		REQUIRE( wad.process() );
+		REQUIRE( wad.textures().size() == before.size() );
+
+		for (const auto& tex : before)
+		{
+			const auto decoded = wad.find_texture( tex.name );
+			REQUIRE( decoded );
+			CHECK( textures_equal( *decoded, tex ) );
+		}
+	}
+
+	//	The changes are still pending and go through once there's space.
+	REQUIRE( editor.commit() );
+
+	CWadFile wad( file.path() );
+	REQUIRE( wad.process() );
+	REQUIRE( wad.textures().size() == textures.size() );
+
+	for (const auto& tex : textures)
+	{
+		const auto decoded = wad.find_texture( tex.name );
+		REQUIRE( decoded );
+		CHECK( textures_equal( *decoded, tex ) );
+	}
+}
+#endif